@@ -1,4 +1,5 @@
 #include "BleConnectionStatus.h"
+#include "BleReportQueue.h"
 #include "NimBLELog.h"
 
 static const char* LOG_TAG = "BleConnectionStatus";
@@ -10,6 +11,8 @@ BleConnectionStatus::BleConnectionStatus(void)
 void BleConnectionStatus::onConnect(NimBLEServer *pServer, NimBLEConnInfo& connInfo)
 {
     NIMBLE_LOGD(LOG_TAG, "onConnect - Connected Address: %s", std::string(connInfo.getAddress()).c_str());
+    this->connectionInterval = connInfo.getConnInterval();
+    this->mtu = connInfo.getMTU();
     pServer->updateConnParams(connInfo.getConnHandle(), 6, 7, 0, 600);
 }
 
@@ -17,10 +20,39 @@ void BleConnectionStatus::onDisconnect(NimBLEServer* pServer, NimBLEConnInfo& co
 {
     NIMBLE_LOGD(LOG_TAG, "onDisconnectConnect - Disconnected Address: %s", std::string(connInfo.getAddress()).c_str());
     this->connected = false;
+    this->connectionInterval = 0;
+    this->mtu = 23;
 }
 
 void BleConnectionStatus::onAuthenticationComplete(NimBLEConnInfo& connInfo)
 {
     NIMBLE_LOGD(LOG_TAG, "onAuthenticationComplete - Authenticated Address: %s", std::string(connInfo.getAddress()).c_str());
+    this->connectionCount++;
     this->connected = true;
+    checkReportSize();
+}
+
+void BleConnectionStatus::onConnParamsUpdate(NimBLEConnInfo& connInfo)
+{
+    NIMBLE_LOGD(LOG_TAG, "onConnParamsUpdate - Connection interval: %d", connInfo.getConnInterval());
+    this->connectionInterval = connInfo.getConnInterval();
+}
+
+void BleConnectionStatus::onMTUChange(uint16_t MTU, NimBLEConnInfo& connInfo)
+{
+    NIMBLE_LOGD(LOG_TAG, "onMTUChange - MTU: %d", MTU);
+    this->mtu = MTU;
+    checkReportSize();
+}
+
+// A report cannot be split across notifications, so one that does not fit is
+// held back for the host to agree to a larger MTU, and dropped if it does not,
+// see BleReportQueue
+void BleConnectionStatus::checkReportSize()
+{
+    if (this->connected && this->largestReportSize > this->mtu - 3)
+    {
+        NIMBLE_LOGW(LOG_TAG, "Report ID %d has %d bytes, more than the %d bytes MTU %d allows. It is held back for up to %d ms for the MTU to be raised, then dropped.",
+                    this->largestReportId, this->largestReportSize, this->mtu - 3, this->mtu, REPORT_QUEUE_MTU_WAIT_MS);
+    }
 }
@@ -15,10 +15,20 @@ class BleConnectionStatus : public NimBLEServerCallbacks
 public:
     BleConnectionStatus(void);
     bool connected = false;
+    uint16_t connectionCount = 0; // Incremented for every new connection
+    uint16_t connectionInterval = 0; // In 1.25 ms units, 0 while disconnected
+    uint16_t mtu = 23; // ATT MTU of the connection, a notification carries up to mtu - 3 bytes
+    uint16_t largestReportSize = 0; // Longest input report, checked against the MTU
+    uint8_t largestReportId = 0;
     void onConnect(NimBLEServer *pServer, NimBLEConnInfo& connInfo) override;
     void onDisconnect(NimBLEServer *pServer, NimBLEConnInfo& connInfo, int reason) override;
     void onAuthenticationComplete(NimBLEConnInfo& connInfo) override;
+    void onConnParamsUpdate(NimBLEConnInfo& connInfo) override;
+    void onMTUChange(uint16_t MTU, NimBLEConnInfo& connInfo) override;
     NimBLECharacteristic *inputController;
+
+private:
+    void checkReportSize();
 };
 
 #endif // CONFIG_BT_NIMBLE_ROLE_PERIPHERAL
@@ -10,6 +10,7 @@
 #include <NimBLEServer.h>
 #include <NimBLEUtils.h>
 
+#include <cstdarg>
 #include <stdexcept>
 
 #if defined(CONFIG_ARDUHAL_ESP_LOG)
@@ -63,7 +64,8 @@ BleController::BleController(std::string deviceName,
       _hat4(0), _gX(0), _gY(0), _gZ(0), _aX(0), _aY(0), _aZ(0),
       _batteryPowerInformation(0), _dischargingState(0), _chargingState(0),
       _powerLevel(0), hid(0), pCharacteristic_Power_State(0), configuration(),
-      pServer(nullptr), nus(nullptr) {
+      pServer(nullptr), nus(nullptr), dirtyFields(0), stateWriters(0),
+      stateVersion(0), senderRequests(0), pipelineTask(nullptr) {
   this->resetButtons();
   this->deviceName = deviceName;
   this->deviceManufacturer = deviceManufacturer;
@@ -73,1225 +75,1475 @@ BleController::BleController(std::string deviceName,
 
   // Initialize keyboard and mouse reports
   memset(&_keyboardReport, 0, sizeof(_keyboardReport));
+  memset(&_keyboardNkroReport, 0, sizeof(_keyboardNkroReport));
   memset(&_mouseReport, 0, sizeof(_mouseReport));
 
+  hidReportDescriptor = nullptr;
+  hidReportMap = nullptr;
   hidReportDescriptorSize = 0;
-  hidReportSize = 0;
+  controllerReportCount = 0;
+  currentControllerReport = 0;
+  memset(extraControllers, 0, sizeof(extraControllers));
+  extraControllerCount = 0;
+  owner = nullptr;
+  keyboardReportId = 0;
+  mouseReportId = 0;
+  keyboardNkroReportId = 0;
+  featureReportCount = 0;
   numOfButtonBytes = 0;
+  reportFieldCount = 0;
+  reportDirtyMask = 0;
+  reportPacker = nullptr;
+  reportBuffer = nullptr;
+  lastSentConnection = 0;
+  suppressedReportCount = 0;
+  reportSchedulerTask = nullptr;
+  reportQueueConnection = 0;
+  reportQueueMtu = 0;
+  controllerQueueConnection = 0;
+  controllerQueueMtu = 0;
+  resetStats();
+  updateDepth = 0;
+  deferredReport = 0;
+  scheduledReportDeferred = false;
+  pipelineDroppedCount = 0;
+  typingTask = nullptr;
+  typingPending = 0;
+  typingCompleteCallback = nullptr;
   enableOutputReport = false;
   outputReportLength = 64;
   nusInitialized = false;
 }
 
-void BleController::resetButtons() { memset(&_buttons, 0, sizeof(_buttons)); }
+void BleController::resetButtons() {
+  if (pipelineTask != nullptr) {
+    for (uint8_t i = 0; i < sizeof(_buttons); i++) {
+      pushDelta(STATE_DELTA_SET_BYTE, &_buttons[i], 0, DIRTY_BUTTONS);
+    }
+    return;
+  }
+
+  beginStateWrite();
+  memset(&_buttons, 0, sizeof(_buttons));
+  markDirty(DIRTY_BUTTONS);
+  endStateWrite();
+}
 
 void BleController::begin(BleControllerConfiguration *config) {
   configuration =
       *config; // we make a copy, so the user can't change actual values midway
                // through operation, without calling the begin function again
 
+  // Each extra controller is a copy of this one with its own report ID. Only
+  // this controller runs the server, scheduler and pipeline.
+  extraControllerCount = configuration.getControllerCount() - 1;
+  for (uint8_t i = 0; i < extraControllerCount; i++) {
+    if (extraControllers[i] == nullptr) {
+      extraControllers[i] = new BleController(deviceName, deviceManufacturer,
+                                              batteryLevel, delayAdvertising);
+      delete extraControllers[i]->connectionStatus;
+      extraControllers[i]->connectionStatus = connectionStatus;
+      extraControllers[i]->owner = this;
+    }
+
+    BleControllerConfiguration &extra = extraControllers[i]->configuration;
+    extra = configuration;
+    extra.setControllerCount(1);
+    for (uint8_t group = 0; group < FIELD_GROUPS; group++) {
+      extra.setFieldGroupReportId(group, 0);
+    }
+    extra.setEnableOutputReport(false);
+    extra.setEnableNordicUARTService(false);
+    extra.setEnableReportScheduler(false);
+    extra.setEnablePipeline(false);
+    extra.setIncludeKeyboard(false);
+    extra.setIncludeMouse(false);
+  }
+  allocateReportIds();
+
+  // Measure first, then write the descriptor into a buffer of exactly that
+  // size. It also lays out the controller reports.
+  BleHidDescriptorBuilder measure;
+  buildHidDescriptor(measure);
+
+  delete[] hidReportDescriptor;
+  hidReportDescriptor = new uint8_t[measure.getSize()];
+  BleHidDescriptorBuilder builder(hidReportDescriptor, measure.getSize());
+  buildHidDescriptor(builder);
+  hidReportDescriptorSize = builder.getSize();
+  hidReportMap = hidReportDescriptor;
+  reportPacker = nullptr;
+
+  if (!builder.isValid()) {
+    NIMBLE_LOGE(LOG_TAG, "begin - Invalid HID report descriptor");
+  }
+
+  beginServer();
+}
+
+// Shared by begin() and beginStatic() once the report map and the controller
+// report size are known
+void BleController::beginServer() {
   enableOutputReport = configuration.getEnableOutputReport();
   outputReportLength = configuration.getOutputReportLength();
 
-  uint8_t buttonPaddingBits = 8 - (configuration.getButtonCount() % 8);
-  if (buttonPaddingBits == 8) {
-    buttonPaddingBits = 0;
+  for (uint8_t i = 0; i < getControllerCount(); i++) {
+    controller(i).beginControllerReports();
   }
-  uint8_t specialButtonPaddingBits =
-      8 - (configuration.getTotalSpecialButtonCount() % 8);
-  if (specialButtonPaddingBits == 8) {
-    specialButtonPaddingBits = 0;
+
+  // Mouse movement is relative after the buttons byte, and keyboard edges
+  // must all reach the host
+  keyboardQueue.begin(sizeof(keyboard_report_t),
+                      configuration.getReportQueueDepth(), REPORT_QUEUE_FIFO);
+  mouseQueue.begin(sizeof(mouse_report_t), configuration.getReportQueueDepth(),
+                   REPORT_QUEUE_ACCUMULATE, 1);
+  keyboardNkroQueue.begin(sizeof(keyboard_nkro_report_t),
+                          configuration.getReportQueueDepth(),
+                          REPORT_QUEUE_FIFO);
+  checkReportSizes();
+
+  // Set task priority from 5 to 1 in order to get ESP32-C3 working
+  xTaskCreate(this->taskServer, "server", 20000, (void *)this, 1, NULL);
+
+  if (configuration.getEnableReportScheduler() &&
+      reportSchedulerTask == nullptr) {
+    xTaskCreate(this->taskReportScheduler, "reports", 4096, (void *)this, 1,
+                &reportSchedulerTask);
   }
-  uint8_t numOfAxisBytes = configuration.getAxisCount() * 2;
-  uint8_t numOfSimulationBytes = configuration.getSimulationCount() * 2;
 
-  numOfButtonBytes = configuration.getButtonCount() / 8;
-  if (buttonPaddingBits > 0) {
-    numOfButtonBytes++;
+  if (configuration.getEnablePipeline() && pipelineTask == nullptr) {
+    pipelineRing.begin(configuration.getPipelineDepth());
+    xTaskCreatePinnedToCore(this->taskPipeline, "pipeline", 4096, (void *)this,
+                            1, &pipelineTask, configuration.getPipelineCore());
   }
+}
 
-  uint8_t numOfSpecialButtonBytes =
-      configuration.getTotalSpecialButtonCount() / 8;
-  if (specialButtonPaddingBits > 0) {
-    numOfSpecialButtonBytes++;
+// Controller report IDs come from the configuration. Extra controllers, the
+// keyboard, the mouse and the N-key rollover keyboard take the first free ID
+// from their usual one upwards, so no two collections share a report ID.
+void BleController::allocateReportIds() {
+  BleReportIdAllocator reportIds;
+
+  // Field groups may share the controller's report ID on purpose
+  if (!reportIds.reserve(configuration.getHidReportId())) {
+    NIMBLE_LOGE(LOG_TAG, "begin - Report ID 0 is not a valid report ID");
+  }
+  for (uint8_t group = 0; group < FIELD_GROUPS; group++) {
+    reportIds.reserve(configuration.getFieldGroupReportId(group));
+  }
+  for (uint8_t i = 0; i < featureReportCount; i++) {
+    reportIds.reserve(featureReports[i].reportId);
   }
 
-  uint8_t numOfMotionBytes = 0;
-  if (configuration.getIncludeAccelerometer()) {
-    numOfMotionBytes += 6;
+  for (uint8_t i = 0; i < extraControllerCount; i++) {
+    extraControllers[i]->configuration.setHidReportId(
+        reportIds.allocate(configuration.getHidReportId() + 1 + i));
   }
 
-  if (configuration.getIncludeGyroscope()) {
-    numOfMotionBytes += 6;
+  keyboardReportId = configuration.getIncludeKeyboard()
+                         ? reportIds.allocate(KEYBOARD_REPORT_ID)
+                         : 0;
+  mouseReportId =
+      configuration.getIncludeMouse() ? reportIds.allocate(MOUSE_REPORT_ID) : 0;
+  keyboardNkroReportId =
+      configuration.getIncludeKeyboard() && configuration.getKeyboardNkro()
+          ? reportIds.allocate(KEYBOARD_NKRO_REPORT_ID)
+          : 0;
+
+  if (keyboardReportId != 0 && keyboardReportId != KEYBOARD_REPORT_ID) {
+    NIMBLE_LOGW(LOG_TAG, "begin - Keyboard moved to report ID %d",
+                keyboardReportId);
+  }
+  if (mouseReportId != 0 && mouseReportId != MOUSE_REPORT_ID) {
+    NIMBLE_LOGW(LOG_TAG, "begin - Mouse moved to report ID %d", mouseReportId);
   }
+}
 
-  hidReportSize = numOfButtonBytes + numOfSpecialButtonBytes + numOfAxisBytes +
-                  numOfSimulationBytes + numOfMotionBytes +
-                  configuration.getHatSwitchCount();
+// Report buffers and send queues of this controller's input reports
+void BleController::beginControllerReports() {
+  uint16_t reportBufferSize = 0;
+  for (uint8_t i = 0; i < controllerReportCount; i++) {
+    reportBufferSize += controllerReports[i].size * 2;
+  }
 
-  // USAGE_PAGE (Generic Desktop)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+  delete[] reportBuffer;
+  // Zeroed so padding between bit-packed fields stays zero
+  reportBuffer = new uint8_t[reportBufferSize]();
 
-  // USAGE (Joystick - 0x04; Controller - 0x05; Multi-axis Controller - 0x08)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-  tempHidReportDescriptor[hidReportDescriptorSize++] =
-      configuration.getControllerType();
+  // Controller state is absolute, so queued reports are merged
+  uint8_t *buffer = reportBuffer;
+  for (uint8_t i = 0; i < controllerReportCount; i++) {
+    controller_report_t &report = controllerReports[i];
+    report.pending = buffer;
+    report.lastSent = buffer + report.size;
+    report.lastSentValid = false;
+    buffer += report.size * 2;
+    report.queue.begin(report.size, configuration.getReportQueueDepth(),
+                       REPORT_QUEUE_MERGE);
+  }
+}
 
-  // COLLECTION (Application)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0xa1;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+// Finds the longest input report, which decides the ATT MTU the device asks
+// for and is checked against the MTU the host agrees to
+void BleController::checkReportSizes() {
+  uint16_t largestSize = 0;
+  uint8_t largestId = 0;
+  for (uint8_t i = 0; i < getControllerCount(); i++) {
+    BleController &player = controller(i);
+    for (uint8_t j = 0; j < player.controllerReportCount; j++) {
+      if (player.controllerReports[j].size > largestSize) {
+        largestSize = player.controllerReports[j].size;
+        largestId = player.controllerReports[j].reportId;
+      }
+    }
+  }
+  if (keyboardReportId != 0 && sizeof(keyboard_report_t) > largestSize) {
+    largestSize = sizeof(keyboard_report_t);
+    largestId = keyboardReportId;
+  }
+  if (mouseReportId != 0 && sizeof(mouse_report_t) > largestSize) {
+    largestSize = sizeof(mouse_report_t);
+    largestId = mouseReportId;
+  }
+  if (keyboardNkroReportId != 0 &&
+      sizeof(keyboard_nkro_report_t) > largestSize) {
+    largestSize = sizeof(keyboard_nkro_report_t);
+    largestId = keyboardNkroReportId;
+  }
 
-  // REPORT_ID (Default: 3)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x85;
-  tempHidReportDescriptor[hidReportDescriptorSize++] =
-      configuration.getHidReportId();
+  connectionStatus->largestReportSize = largestSize;
+  connectionStatus->largestReportId = largestId;
 
-  if (configuration.getButtonCount() > 0) {
-    // USAGE_PAGE (Button)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
+  // Longest attribute value in ATT
+  if (largestSize > 512) {
+    NIMBLE_LOGE(LOG_TAG, "begin - Report ID %d has %d bytes, at most 512 fit "
+                "in a notification", largestId, largestSize);
+  }
+}
 
-    // LOGICAL_MINIMUM (0)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x15;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
+void BleController::end(void) {}
 
-    // LOGICAL_MAXIMUM (1)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x25;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+BleController &BleController::controller(uint8_t index) {
+  if (index == 0 || index > extraControllerCount) {
+    return *this;
+  }
+  return *extraControllers[index - 1];
+}
 
-    // REPORT_SIZE (1)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+uint8_t BleController::getControllerCount() { return 1 + extraControllerCount; }
 
-    // USAGE_MINIMUM (Button 1)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x19;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+uint8_t BleController::getKeyboardReportId() { return keyboardReportId; }
 
-    // USAGE_MAXIMUM (Up to 128 buttons possible)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x29;
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        configuration.getButtonCount();
+uint8_t BleController::getMouseReportId() { return mouseReportId; }
 
-    // REPORT_COUNT (# of buttons)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        configuration.getButtonCount();
+uint8_t BleController::getKeyboardNkroReportId() {
+  return keyboardNkroReportId;
+}
 
-    // INPUT (Data,Var,Abs)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
+bool BleController::addFeatureReport(uint8_t reportId, uint16_t size,
+                                     BleFeatureReportCallbacks *callbacks,
+                                     bool readOnly) {
+  if (featureReportCount == MAX_FEATURE_REPORTS || reportId == 0 ||
+      size == 0 || size > MAX_FEATURE_REPORT_SIZE) {
+    NIMBLE_LOGE(LOG_TAG, "addFeatureReport - Invalid feature report %d",
+                reportId);
+    return false;
+  }
+  for (uint8_t i = 0; i < featureReportCount; i++) {
+    if (featureReports[i].reportId == reportId) {
+      NIMBLE_LOGE(LOG_TAG, "addFeatureReport - Report ID %d already added",
+                  reportId);
+      return false;
+    }
+  }
 
-    if (buttonPaddingBits > 0) {
+  feature_report_t &report = featureReports[featureReportCount++];
+  report.reportId = reportId;
+  report.size = size;
+  report.readOnly = readOnly;
+  report.callbacks = callbacks;
+  return true;
+}
 
-      // REPORT_SIZE (1)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+// Seqlock over the controller state. Setters on any task bracket their writes
+// with beginStateWrite()/endStateWrite() and never wait; the sender packs the
+// report without a lock and retries if a setter ran in the meantime. Writers
+// are counted rather than flagged in the version, so several tasks can write
+// at once.
+//
+// With the pipeline enabled, setters only queue deltas and the pipeline task is
+// the one writer. The input task must not hold the seqlock while it waits for
+// ring space, or the pipeline task would wait for it in turn.
+void BleController::beginStateWrite() {
+  if (pipelineTask == nullptr || xTaskGetCurrentTaskHandle() == pipelineTask) {
+    stateWriters.fetch_add(1);
+  }
+}
 
-      // REPORT_COUNT (# of padding bits)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = buttonPaddingBits;
+void BleController::endStateWrite() {
+  if (pipelineTask == nullptr || xTaskGetCurrentTaskHandle() == pipelineTask) {
+    stateVersion.fetch_add(1);
+    stateWriters.fetch_sub(1);
+  }
+}
 
-      // INPUT (Const,Var,Abs)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x03;
+// Waits for running setters to finish and returns the state version. The
+// writer may be a lower priority task on the same core, so after a few
+// yields the sender sleeps for a tick to let it run.
+uint32_t BleController::beginStateRead() {
+  for (uint8_t spins = 0; stateWriters.load() != 0; spins++) {
+    if (spins < 16) {
+      taskYIELD();
+    } else {
+      vTaskDelay(1);
+    }
+  }
+  return stateVersion.load();
+}
 
-    } // Padding Bits Needed
+bool BleController::endStateRead(uint32_t version) {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return stateWriters.load() == 0 && stateVersion.load() == version;
+}
 
-  } // Buttons
+void BleController::markDirty(uint32_t dirtyBits) {
+#if BLE_CONTROLLER_STATS == 1
+  if (dirtyFields.fetch_or(dirtyBits) == 0) {
+    changedAt = micros();
+  }
+#else
+  dirtyFields |= dirtyBits;
+#endif
+}
 
-  if (configuration.getTotalSpecialButtonCount() > 0) {
-    // LOGICAL_MINIMUM (0)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x15;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
+// -32768 has no positive counterpart, so it is clamped to -32767. Only a real
+// change marks the member dirty.
+void BleController::updateValue(int16_t &field, int16_t value,
+                                uint32_t dirtyBit) {
+  if (value == -32768) {
+    value = -32767;
+  }
 
-    // LOGICAL_MAXIMUM (1)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x25;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+  if (pipelineTask != nullptr) {
+    pushDelta(STATE_DELTA_SET, &field, value, dirtyBit);
+  } else if (field != value) {
+    field = value;
+    markDirty(dirtyBit);
+  }
+}
 
-    // REPORT_SIZE (1)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+void BleController::updateHat(int16_t &hat, signed char value,
+                              uint32_t dirtyBit) {
+  if (pipelineTask != nullptr) {
+    pushDelta(STATE_DELTA_SET, &hat, value, dirtyBit);
+  } else if (hat != value) {
+    hat = value;
+    markDirty(dirtyBit);
+  }
+}
 
-    if (configuration.getDesktopSpecialButtonCount() > 0) {
+// Other bits in the same byte may be changed by another task, so the byte is
+// updated atomically
+void BleController::setStateBits(uint8_t &field, uint8_t bitmask,
+                                 uint32_t dirtyBit) {
+  if (pipelineTask != nullptr) {
+    pushDelta(STATE_DELTA_OR, &field, bitmask, dirtyBit);
+    return;
+  }
 
-      // USAGE_PAGE (Generic Desktop)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+  uint8_t previous = __atomic_fetch_or(&field, bitmask, __ATOMIC_RELAXED);
+  if ((previous & bitmask) == 0) {
+    markDirty(dirtyBit);
+  }
+}
 
-      // REPORT_COUNT
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-      tempHidReportDescriptor[hidReportDescriptorSize++] =
-          configuration.getDesktopSpecialButtonCount();
+void BleController::clearStateBits(uint8_t &field, uint8_t bitmask,
+                                   uint32_t dirtyBit) {
+  if (pipelineTask != nullptr) {
+    pushDelta(STATE_DELTA_AND, &field, (uint8_t)~bitmask, dirtyBit);
+    return;
+  }
 
-      if (configuration.getIncludeStart()) {
-        // USAGE (Start)
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x3D;
-      }
+  uint8_t previous =
+      __atomic_fetch_and(&field, (uint8_t)~bitmask, __ATOMIC_RELAXED);
+  if (previous & bitmask) {
+    markDirty(dirtyBit);
+  }
+}
 
-      if (configuration.getIncludeSelect()) {
-        // USAGE (Select)
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x3E;
-      }
+void BleController::setAxes(int16_t x, int16_t y, int16_t z, int16_t rX,
+                            int16_t rY, int16_t rZ, int16_t slider1,
+                            int16_t slider2) {
+  beginStateWrite();
+  updateValue(_x, x, DIRTY_X);
+  updateValue(_y, y, DIRTY_Y);
+  updateValue(_z, z, DIRTY_Z);
+  updateValue(_rZ, rZ, DIRTY_RZ);
+  updateValue(_rX, rX, DIRTY_RX);
+  updateValue(_rY, rY, DIRTY_RY);
+  updateValue(_slider1, slider1, DIRTY_SLIDER1);
+  updateValue(_slider2, slider2, DIRTY_SLIDER2);
+  endStateWrite();
 
-      if (configuration.getIncludeMenu()) {
-        // USAGE (App Menu)
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x86;
-      }
+  requestReport(false);
+}
 
-      // INPUT (Data,Var,Abs)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
-    }
+void BleController::setHIDAxes(int16_t x, int16_t y, int16_t z, int16_t rZ,
+                               int16_t rX, int16_t rY, int16_t slider1,
+                               int16_t slider2) {
+  beginStateWrite();
+  updateValue(_x, x, DIRTY_X);
+  updateValue(_y, y, DIRTY_Y);
+  updateValue(_z, z, DIRTY_Z);
+  updateValue(_rZ, rZ, DIRTY_RZ);
+  updateValue(_rX, rX, DIRTY_RX);
+  updateValue(_rY, rY, DIRTY_RY);
+  updateValue(_slider1, slider1, DIRTY_SLIDER1);
+  updateValue(_slider2, slider2, DIRTY_SLIDER2);
+  endStateWrite();
 
-    if (configuration.getConsumerSpecialButtonCount() > 0) {
+  requestReport(false);
+}
 
-      // USAGE_PAGE (Consumer Page)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x0C;
+void BleController::setSimulationControls(int16_t rudder, int16_t throttle,
+                                          int16_t accelerator, int16_t brake,
+                                          int16_t steering) {
+  beginStateWrite();
+  updateValue(_rudder, rudder, DIRTY_RUDDER);
+  updateValue(_throttle, throttle, DIRTY_THROTTLE);
+  updateValue(_accelerator, accelerator, DIRTY_ACCELERATOR);
+  updateValue(_brake, brake, DIRTY_BRAKE);
+  updateValue(_steering, steering, DIRTY_STEERING);
+  endStateWrite();
 
-      // REPORT_COUNT
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-      tempHidReportDescriptor[hidReportDescriptorSize++] =
-          configuration.getConsumerSpecialButtonCount();
+  requestReport(false);
+}
 
-      if (configuration.getIncludeHome()) {
-        // USAGE (Home)
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x0A;
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x23;
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
-      }
+void BleController::setHats(signed char hat1, signed char hat2,
+                            signed char hat3, signed char hat4) {
+  beginStateWrite();
+  updateHat(_hat1, hat1, DIRTY_HAT1);
+  updateHat(_hat2, hat2, DIRTY_HAT2);
+  updateHat(_hat3, hat3, DIRTY_HAT3);
+  updateHat(_hat4, hat4, DIRTY_HAT4);
+  endStateWrite();
 
-      if (configuration.getIncludeBack()) {
-        // USAGE (Back)
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x0A;
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x24;
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
-      }
+  requestReport(true);
+}
 
-      if (configuration.getIncludeVolumeInc()) {
-        // USAGE (Volume Increment)
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0xE9;
-      }
+void BleController::setSliders(int16_t slider1, int16_t slider2) {
+  beginStateWrite();
+  updateValue(_slider1, slider1, DIRTY_SLIDER1);
+  updateValue(_slider2, slider2, DIRTY_SLIDER2);
+  endStateWrite();
 
-      if (configuration.getIncludeVolumeDec()) {
-        // USAGE (Volume Decrement)
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0xEA;
-      }
+  requestReport(false);
+}
 
-      if (configuration.getIncludeVolumeMute()) {
-        // USAGE (Mute)
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-        tempHidReportDescriptor[hidReportDescriptorSize++] = 0xE2;
-      }
+// Report bits per value, 16 unless a narrower supported width was asked for
+static uint8_t valueBits(uint8_t bits) {
+  return bits >= 8 && bits < 16 ? bits : 16;
+}
 
-      // INPUT (Data,Var,Abs)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
+// Right shift that brings minimum..maximum down to bits bits. The range keeps
+// its sign, so 0..0x7FFF at 10 bits becomes 0..1023 and -32767..32767
+// becomes -512..511.
+static uint8_t valueShift(int16_t minimum, int16_t maximum, uint8_t bits) {
+  uint8_t rangeBits = 1;
+  if (minimum < 0) {
+    while (rangeBits < 16 && (minimum < -(1L << (rangeBits - 1)) ||
+                              maximum >= (1L << (rangeBits - 1)))) {
+      rangeBits++;
+    }
+  } else {
+    while (rangeBits < 16 && maximum >= (1L << rangeBits)) {
+      rangeBits++;
     }
+  }
+  return rangeBits > bits ? rangeBits - bits : 0;
+}
 
-    if (specialButtonPaddingBits > 0) {
+void BleController::addReportField(const void *source, uint8_t width,
+                                   uint32_t dirtyBit) {
+  const uint8_t *bytes = (const uint8_t *)source;
+  uint16_t bitOffset = 0;
 
-      // REPORT_SIZE (1)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+  reportDirtyMask |= dirtyBit;
+  controllerReports[currentControllerReport].dirtyMask |= dirtyBit;
 
-      // REPORT_COUNT (# of padding bits)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-      tempHidReportDescriptor[hidReportDescriptorSize++] =
-          specialButtonPaddingBits;
+  // Continue after the last field of the same report
+  for (int i = reportFieldCount - 1; i >= 0; i--) {
+    report_field_t &previous = reportLayout[i];
+    if (previous.report != currentControllerReport) {
+      continue;
+    }
 
-      // INPUT (Const,Var,Abs)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x03;
+    // Packed groups are padded to whole bytes, so round up past the padding
+    bitOffset = previous.width > 0 ? previous.bitOffset + previous.width * 8
+                                   : (previous.bitOffset + previous.bits + 7) &
+                                         ~7;
+
+    // Neighbouring state members that are also neighbours in the report are
+    // merged, so x/y/z or the whole motion block become a single copy
+    if (i == reportFieldCount - 1 && previous.width > 0 &&
+        previous.source + previous.width == bytes) {
+      previous.width += width;
+      previous.dirtyMask |= dirtyBit;
+      return;
+    }
+    break;
+  }
 
-    } // Padding Bits Needed
+  report_field_t &field = reportLayout[reportFieldCount++];
+  field.source = bytes;
+  field.report = currentControllerReport;
+  field.bitOffset = bitOffset;
+  field.width = width;
+  field.bits = 0;
+  field.shift = 0;
+  field.dirtyMask = dirtyBit;
+}
 
-  } // Special Buttons
+// Full width values stay plain copies; anything else is bit-packed
+void BleController::addValueField(const int16_t *source, uint16_t bitOffset,
+                                  uint8_t bits, uint8_t shift,
+                                  uint32_t dirtyBit) {
+  if (bits == 16 || (bits == 8 && shift == 0 && bitOffset % 8 == 0)) {
+    addReportField(source, bits / 8, dirtyBit);
+    return;
+  }
 
-  if (configuration.getAxisCount() > 0) {
-    // USAGE_PAGE (Generic Desktop)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+  reportDirtyMask |= dirtyBit;
+  controllerReports[currentControllerReport].dirtyMask |= dirtyBit;
 
-    // USAGE (Pointer)
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+  report_field_t &field = reportLayout[reportFieldCount++];
+  field.source = (const uint8_t *)source;
+  field.report = currentControllerReport;
+  field.bitOffset = bitOffset;
+  field.width = 0;
+  field.bits = bits;
+  field.shift = shift;
+  field.dirtyMask = dirtyBit;
+}
 
-    // LOGICAL_MINIMUM (-32767)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x16;
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        lowByte(configuration.getAxesMin());
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        highByte(configuration.getAxesMin());
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;    // Use
-    // these two lines for 0 min
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;    // Use
-    // these two lines for -32767 min
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x80;
+// Makes reportId the one the following controller fields go to, adding it to
+// controllerReports the first time it is used
+void BleController::selectControllerReport(BleHidDescriptorBuilder &hid,
+                                           uint8_t reportId) {
+  uint8_t index = 0;
+  while (index < controllerReportCount &&
+         controllerReports[index].reportId != reportId) {
+    index++;
+  }
 
-    // LOGICAL_MAXIMUM (+32767)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x26;
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        lowByte(configuration.getAxesMax());
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        highByte(configuration.getAxesMax());
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0xFF;	// Use
-    // these two lines for 255 max
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0xFF;	// Use
-    // these two lines for +32767 max
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x7F;
+  if (index == controllerReportCount) {
+    controller_report_t &report = controllerReports[controllerReportCount++];
+    report.reportId = reportId;
+    report.size = 0;
+    report.dirtyMask = 0;
+  }
+  currentControllerReport = index;
 
-    // REPORT_SIZE (16)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x10;
+  if (hid.getReportId() != reportId) {
+    hid.reportId(reportId);
+  }
+}
 
-    // REPORT_COUNT (configuration.getAxisCount())
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        configuration.getAxisCount();
+// Writes this controller's collection and, from the same model, the report
+// layout that packReport() fills. Field groups with their own report ID (see
+// setFieldGroupReportId()) switch report IDs within the collection.
+void BleController::buildControllerDescriptor(BleHidDescriptorBuilder &hid) {
+  reportFieldCount = 0;
+  reportDirtyMask = 0;
 
-    // COLLECTION (Physical)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0xA1;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
+  // The controller report is always first, even if every group moved away
+  controllerReportCount = 1;
+  controllerReports[0].reportId = configuration.getHidReportId();
+  controllerReports[0].size = 0;
+  controllerReports[0].dirtyMask = 0;
 
-    if (configuration.getIncludeXAxis()) {
-      // USAGE (X)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x30;
-    }
+  // =================== CONTROLLER DESCRIPTOR ===================
+  // Joystick - 0x04; Controller - 0x05; Multi-axis Controller - 0x08
+  hid.usagePage(0x01).usage(configuration.getControllerType());
+  hid.collection(HID_COLLECTION_APPLICATION);
+  selectControllerReport(
+      hid, configuration.getFieldGroupReportId(FIELD_GROUP_BUTTONS));
 
-    if (configuration.getIncludeYAxis()) {
-      // USAGE (Y)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x31;
-    }
+  if (configuration.getButtonCount() > 0) {
+    // Up to 128 buttons, padded to whole bytes
+    hid.usagePage(0x09).logicalMinimum(0).logicalMaximum(1).reportSize(1);
+    hid.usageMinimum(1).usageMaximum(configuration.getButtonCount());
+    hid.reportCount(configuration.getButtonCount()).input(HID_DATA_VAR_ABS);
+    hid.padToByte();
+
+    numOfButtonBytes = hid.getReportBits() / 8;
+    addReportField(_buttons, numOfButtonBytes, DIRTY_BUTTONS);
+  } else {
+    numOfButtonBytes = 0;
+  }
 
-    if (configuration.getIncludeZAxis()) {
-      // USAGE (Z)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x32;
-    }
+  if (configuration.getTotalSpecialButtonCount() > 0) {
+    hid.logicalMinimum(0).logicalMaximum(1).reportSize(1);
 
-    if (configuration.getIncludeRzAxis()) {
-      // USAGE (Rz)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x35;
+    if (configuration.getDesktopSpecialButtonCount() > 0) {
+      hid.usagePage(0x01);
+      hid.reportCount(configuration.getDesktopSpecialButtonCount());
+      if (configuration.getIncludeStart()) {
+        hid.usage(0x3D); // Start
+      }
+      if (configuration.getIncludeSelect()) {
+        hid.usage(0x3E); // Select
+      }
+      if (configuration.getIncludeMenu()) {
+        hid.usage(0x86); // App Menu
+      }
+      hid.input(HID_DATA_VAR_ABS);
     }
 
-    if (configuration.getIncludeRxAxis()) {
-      // USAGE (Rx)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x33;
+    if (configuration.getConsumerSpecialButtonCount() > 0) {
+      hid.usagePage(0x0C);
+      hid.reportCount(configuration.getConsumerSpecialButtonCount());
+      if (configuration.getIncludeHome()) {
+        hid.usage(0x223); // AC Home
+      }
+      if (configuration.getIncludeBack()) {
+        hid.usage(0x224); // AC Back
+      }
+      if (configuration.getIncludeVolumeInc()) {
+        hid.usage(0xE9); // Volume Increment
+      }
+      if (configuration.getIncludeVolumeDec()) {
+        hid.usage(0xEA); // Volume Decrement
+      }
+      if (configuration.getIncludeVolumeMute()) {
+        hid.usage(0xE2); // Mute
+      }
+      hid.input(HID_DATA_VAR_ABS);
     }
 
-    if (configuration.getIncludeRyAxis()) {
-      // USAGE (Ry)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x34;
-    }
+    hid.padToByte();
+    addReportField(&_specialButtons, 1, DIRTY_SPECIAL_BUTTONS);
+  }
 
-    if (configuration.getIncludeSlider1()) {
-      // USAGE (Slider)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x36;
+  if (configuration.getAxisCount() > 0) {
+    selectControllerReport(
+        hid, configuration.getFieldGroupReportId(FIELD_GROUP_AXES));
+
+    // Axes in HID report order: x, y, z, rZ, rX, rY, slider1, slider2
+    const int16_t *axes[POSSIBLEAXES] = {&_x,  &_y,  &_z,       &_rZ,
+                                         &_rX, &_rY, &_slider1, &_slider2};
+    const uint32_t axisDirtyBits[POSSIBLEAXES] = {
+        DIRTY_X,  DIRTY_Y,  DIRTY_Z,       DIRTY_RZ,
+        DIRTY_RX, DIRTY_RY, DIRTY_SLIDER1, DIRTY_SLIDER2};
+    const bool includeAxes[POSSIBLEAXES] = {
+        configuration.getIncludeXAxis(),   configuration.getIncludeYAxis(),
+        configuration.getIncludeZAxis(),   configuration.getIncludeRzAxis(),
+        configuration.getIncludeRxAxis(),  configuration.getIncludeRyAxis(),
+        configuration.getIncludeSlider1(), configuration.getIncludeSlider2()};
+    const uint8_t axisUsages[POSSIBLEAXES] = {0x30, 0x31, 0x32, 0x35,
+                                              0x33, 0x34, 0x36, 0x36};
+
+    const uint8_t bits = valueBits(configuration.getAxesBits());
+    const uint8_t shift = valueShift(configuration.getAxesMin(),
+                                     configuration.getAxesMax(), bits);
+    uint16_t bitOffset = hid.getReportBits();
+
+    hid.usagePage(0x01);
+    hid.logicalMinimum(configuration.getAxesMin() >> shift, 2);
+    hid.logicalMaximum(configuration.getAxesMax() >> shift, 2);
+    hid.reportSize(bits).reportCount(configuration.getAxisCount());
+    hid.collection(HID_COLLECTION_PHYSICAL);
+    for (int i = 0; i < POSSIBLEAXES; i++) {
+      if (includeAxes[i]) {
+        hid.usage(axisUsages[i]);
+        addValueField(axes[i], bitOffset, bits, shift, axisDirtyBits[i]);
+        bitOffset += bits;
+      }
     }
+    hid.input(HID_DATA_VAR_ABS);
+    hid.endCollection();
+    hid.padToByte();
+  }
 
-    if (configuration.getIncludeSlider2()) {
-      // USAGE (Slider)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x36;
+  if (configuration.getSimulationCount() > 0) {
+    selectControllerReport(
+        hid, configuration.getFieldGroupReportId(FIELD_GROUP_SIMULATION));
+
+    // Rudder, throttle, accelerator, brake, steering
+    const int16_t *simulationControls[POSSIBLESIMULATIONCONTROLS] = {
+        &_rudder, &_throttle, &_accelerator, &_brake, &_steering};
+    const uint32_t simulationDirtyBits[POSSIBLESIMULATIONCONTROLS] = {
+        DIRTY_RUDDER, DIRTY_THROTTLE, DIRTY_ACCELERATOR, DIRTY_BRAKE,
+        DIRTY_STEERING};
+    const uint8_t simulationUsages[POSSIBLESIMULATIONCONTROLS] = {
+        0xBA, 0xBB, 0xC4, 0xC5, 0xC8};
+
+    const uint8_t bits = valueBits(configuration.getSimulationBits());
+    const uint8_t shift = valueShift(configuration.getSimulationMin(),
+                                     configuration.getSimulationMax(), bits);
+    uint16_t bitOffset = hid.getReportBits();
+
+    hid.usagePage(0x02);
+    hid.logicalMinimum(configuration.getSimulationMin() >> shift, 2);
+    hid.logicalMaximum(configuration.getSimulationMax() >> shift, 2);
+    hid.reportSize(bits).reportCount(configuration.getSimulationCount());
+    hid.collection(HID_COLLECTION_PHYSICAL);
+    for (int i = 0; i < POSSIBLESIMULATIONCONTROLS; i++) {
+      if (configuration.getWhichSimulationControls()[i]) {
+        hid.usage(simulationUsages[i]);
+        addValueField(simulationControls[i], bitOffset, bits, shift,
+                      simulationDirtyBits[i]);
+        bitOffset += bits;
+      }
     }
+    hid.input(HID_DATA_VAR_ABS);
+    hid.endCollection();
+    hid.padToByte();
+  }
 
-    // INPUT (Data,Var,Abs)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
-
-    // END_COLLECTION (Physical)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0xc0;
+  if (configuration.getIncludeGyroscope() ||
+      configuration.getIncludeAccelerometer()) {
+    selectControllerReport(
+        hid, configuration.getFieldGroupReportId(FIELD_GROUP_MOTION));
 
-  } // X, Y, Z, Rx, Ry, and Rz Axis
+    const uint8_t bits = valueBits(configuration.getMotionBits());
+    const uint8_t shift = valueShift(configuration.getMotionMin(),
+                                     configuration.getMotionMax(), bits);
 
-  if (configuration.getSimulationCount() > 0) {
+    if (configuration.getIncludeGyroscope()) {
+      // Rx, Ry, Rz
+      uint16_t bitOffset = hid.getReportBits();
+
+      hid.collection(HID_COLLECTION_PHYSICAL);
+      hid.usagePage(0x01).usage(0x33).usage(0x34).usage(0x35);
+      hid.logicalMinimum(configuration.getMotionMin() >> shift, 2);
+      hid.logicalMaximum(configuration.getMotionMax() >> shift, 2);
+      hid.reportSize(bits).reportCount(3).input(HID_DATA_VAR_ABS);
+      hid.endCollection();
+      hid.padToByte();
+
+      addValueField(&_gX, bitOffset, bits, shift, DIRTY_GX);
+      addValueField(&_gY, bitOffset + bits, bits, shift, DIRTY_GY);
+      addValueField(&_gZ, bitOffset + 2 * bits, bits, shift, DIRTY_GZ);
+    }
 
-    // USAGE_PAGE (Simulation Controls)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
-
-    // LOGICAL_MINIMUM (-32767)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x16;
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        lowByte(configuration.getSimulationMin());
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        highByte(configuration.getSimulationMin());
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;	    //
-    // Use these two lines for 0 min
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;	    //
-    // Use these two lines for -32767 min
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x80;
-
-    // LOGICAL_MAXIMUM (+32767)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x26;
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        lowByte(configuration.getSimulationMax());
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        highByte(configuration.getSimulationMax());
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0xFF;	    //
-    // Use these two lines for 255 max
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0xFF;	    //
-    // Use these two lines for +32767 max
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x7F;
-
-    // REPORT_SIZE (16)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x10;
-
-    // REPORT_COUNT (configuration.getSimulationCount())
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        configuration.getSimulationCount();
-
-    // COLLECTION (Physical)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0xA1;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-
-    if (configuration.getIncludeRudder()) {
-      // USAGE (Rudder)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0xBA;
-    }
-
-    if (configuration.getIncludeThrottle()) {
-      // USAGE (Throttle)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0xBB;
-    }
-
-    if (configuration.getIncludeAccelerator()) {
-      // USAGE (Accelerator)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0xC4;
-    }
-
-    if (configuration.getIncludeBrake()) {
-      // USAGE (Brake)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0xC5;
-    }
-
-    if (configuration.getIncludeSteering()) {
-      // USAGE (Steering)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0xC8;
-    }
-
-    // INPUT (Data,Var,Abs)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
-
-    // END_COLLECTION (Physical)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0xc0;
-
-  } // Simulation Controls
-
-  // Gyroscope
-  if (configuration.getIncludeGyroscope()) {
-    // COLLECTION (Physical)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0xA1;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-
-    // USAGE_PAGE (Generic Desktop)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-    // USAGE (Gyroscope - Rotational X - Rx)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x33;
-
-    // USAGE (Rotational - Rotational Y - Ry)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x34;
-
-    // USAGE (Rotational - Rotational Z - Rz)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x35;
-
-    // LOGICAL_MINIMUM (-32767)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x16;
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        lowByte(configuration.getMotionMin());
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        highByte(configuration.getMotionMin());
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;	    //
-    // Use these two lines for 0 min
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;	    //
-    // Use these two lines for -32767 min
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x80;
-
-    // LOGICAL_MAXIMUM (+32767)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x26;
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        lowByte(configuration.getMotionMax());
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        highByte(configuration.getMotionMax());
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0xFF;	    //
-    // Use these two lines for 255 max
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0xFF;	    //
-    // Use these two lines for +32767 max
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x7F;
-
-    // REPORT_SIZE (16)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x10;
-
-    // REPORT_COUNT (3)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x03;
-
-    // INPUT (Data,Var,Abs)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
-
-    // END_COLLECTION (Physical)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0xc0;
-
-  } // Gyroscope
-
-  // Accelerometer
-  if (configuration.getIncludeAccelerometer()) {
-    // COLLECTION (Physical)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0xA1;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-
-    // USAGE_PAGE (Generic Desktop)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-    // USAGE (Accelerometer - Vector X - Vx)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x40;
-
-    // USAGE (Accelerometer - Vector Y - Vy)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x41;
-
-    // USAGE (Accelerometer - Vector Z - Vz)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x42;
-
-    // LOGICAL_MINIMUM (-32767)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x16;
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        lowByte(configuration.getMotionMin());
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        highByte(configuration.getMotionMin());
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;	    //
-    // Use these two lines for 0 min
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;	    //
-    // Use these two lines for -32767 min
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x80;
-
-    // LOGICAL_MAXIMUM (+32767)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x26;
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        lowByte(configuration.getMotionMax());
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        highByte(configuration.getMotionMax());
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0xFF;	    //
-    // Use these two lines for 255 max
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0xFF;	    //
-    // Use these two lines for +32767 max
-    // tempHidReportDescriptor[hidReportDescriptorSize++] = 0x7F;
-
-    // REPORT_SIZE (16)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x10;
-
-    // REPORT_COUNT (3)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x03;
-
-    // INPUT (Data,Var,Abs)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
-
-    // END_COLLECTION (Physical)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0xc0;
-
-  } // Accelerometer
+    if (configuration.getIncludeAccelerometer()) {
+      // Vx, Vy, Vz
+      uint16_t bitOffset = hid.getReportBits();
+
+      hid.collection(HID_COLLECTION_PHYSICAL);
+      hid.usagePage(0x01).usage(0x40).usage(0x41).usage(0x42);
+      hid.logicalMinimum(configuration.getMotionMin() >> shift, 2);
+      hid.logicalMaximum(configuration.getMotionMax() >> shift, 2);
+      hid.reportSize(bits).reportCount(3).input(HID_DATA_VAR_ABS);
+      hid.endCollection();
+      hid.padToByte();
+
+      addValueField(&_aX, bitOffset, bits, shift, DIRTY_AX);
+      addValueField(&_aY, bitOffset + bits, bits, shift, DIRTY_AY);
+      addValueField(&_aZ, bitOffset + 2 * bits, bits, shift, DIRTY_AZ);
+    }
+  }
 
   if (configuration.getHatSwitchCount() > 0) {
+    selectControllerReport(
+        hid, configuration.getFieldGroupReportId(FIELD_GROUP_HATS));
 
-    // COLLECTION (Physical)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0xA1;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-
-    // USAGE_PAGE (Generic Desktop)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = USAGE_PAGE(1);
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+    // A byte or a nibble per hat: 1-8 clockwise from up, 0 is centered (null)
+    const uint8_t bits = configuration.getHatBits() <= 4 ? 4 : 8;
+    uint16_t bitOffset = hid.getReportBits();
 
-    // USAGE (Hat Switch)
+    hid.collection(HID_COLLECTION_PHYSICAL);
+    hid.usagePage(0x01);
     for (int currentHatIndex = 0;
          currentHatIndex < configuration.getHatSwitchCount();
          currentHatIndex++) {
-      tempHidReportDescriptor[hidReportDescriptorSize++] = USAGE(1);
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x39;
+      hid.usage(0x39);
     }
-
-    // Logical Min (1)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x15;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-    // Logical Max (8)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x25;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x08;
-
-    // Physical Min (0)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x35;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-
-    // Physical Max (315)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x46;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x3B;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-    // Unit (SI Rot : Ang Pos)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x65;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x12;
-
-    // Report Size (8)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x08;
-
-    // Report Count (4)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-    tempHidReportDescriptor[hidReportDescriptorSize++] =
-        configuration.getHatSwitchCount();
-
-    // Input (Data, Variable, Absolute)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x42;
-
-    // END_COLLECTION (Physical)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0xc0;
-  } // Hat Switches
+    hid.logicalMinimum(1).logicalMaximum(8);
+    hid.physicalMinimum(0).physicalMaximum(315);
+    hid.unit(0x12); // SI Rotation: Angular Position
+    hid.reportSize(bits).reportCount(configuration.getHatSwitchCount());
+    hid.input(HID_DATA_VAR_ABS_NULL);
+    hid.endCollection();
+    hid.padToByte();
+
+    // Hats are reported last to first
+    const int16_t *hats[4] = {&_hat1, &_hat2, &_hat3, &_hat4};
+    const uint32_t hatDirtyBits[4] = {DIRTY_HAT1, DIRTY_HAT2, DIRTY_HAT3,
+                                      DIRTY_HAT4};
+    for (int currentHatIndex = configuration.getHatSwitchCount() - 1;
+         currentHatIndex >= 0; currentHatIndex--) {
+      addValueField(hats[currentHatIndex], bitOffset, bits, 0,
+                    hatDirtyBits[currentHatIndex]);
+      bitOffset += bits;
+    }
+  }
 
   if (configuration.getEnableOutputReport()) {
-    // Usage Page (Vendor Defined 0xFF00)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x06;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0xFF;
-
-    // Usage (Vendor Usage 0x01)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-    // Usage (0x01)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-    // Logical Minimum (0)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x15;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-
-    // Logical Maximum (255)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x26;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0xFF;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-
-    // Report Size (8 bits)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x08;
-
-    if (configuration.getOutputReportLength() <= 0xFF) {
-      // Report Count (0~255 bytes)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-      tempHidReportDescriptor[hidReportDescriptorSize++] =
-          configuration.getOutputReportLength();
-    } else {
-      // Report Count (0~65535 bytes)
-      tempHidReportDescriptor[hidReportDescriptorSize++] = 0x96;
-      tempHidReportDescriptor[hidReportDescriptorSize++] =
-          lowByte(configuration.getOutputReportLength());
-      tempHidReportDescriptor[hidReportDescriptorSize++] =
-          highByte(configuration.getOutputReportLength());
+    selectControllerReport(hid, configuration.getHidReportId());
+
+    // Vendor defined bytes received by the output report callback
+    hid.usagePage(0xFF00).usage(0x01).usage(0x01);
+    hid.logicalMinimum(0).logicalMaximum(255).reportSize(8);
+    hid.reportCount(configuration.getOutputReportLength());
+    hid.output(HID_DATA_VAR_ABS);
+  }
+
+  // Vendor defined bytes of each registered feature report. They stay in this
+  // collection, as some hosts want all of a report ID's reports in one
+  // application collection.
+  for (uint8_t i = 0; i < featureReportCount; i++) {
+    const feature_report_t &report = featureReports[i];
+    if (hid.getReportId() != report.reportId) {
+      hid.reportId(report.reportId);
     }
+    hid.usagePage(0xFF00).usage(0x02 + i);
+    hid.logicalMinimum(0).logicalMaximum(255).reportSize(8);
+    hid.reportCount(report.size);
+    hid.feature(HID_DATA_VAR_ABS);
+  }
 
-    // Output (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null
-    // Position,Non-volatile)
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x91;
-    tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
+  // Taken before the mouse collection, which may share a report ID
+  for (uint8_t i = 0; i < controllerReportCount; i++) {
+    controllerReports[i].size =
+        hid.getReportSize(controllerReports[i].reportId);
   }
+  hid.endCollection();
+}
 
-  // END_COLLECTION (Application) - End Controller collection
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0xc0;
+// Writes the HID report map: every controller collection, then keyboard and
+// mouse. Called twice by begin(): once to measure the descriptor and once to
+// write it into a buffer of exactly that size.
+void BleController::buildHidDescriptor(BleHidDescriptorBuilder &hid) {
+  for (uint8_t i = 0; i < getControllerCount(); i++) {
+    controller(i).buildControllerDescriptor(hid);
+  }
 
   // =================== KEYBOARD DESCRIPTOR ===================
-  // USAGE_PAGE (Generic Desktop)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-  // USAGE (Keyboard)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x06;
-
-  // COLLECTION (Application)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0xa1;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-  // REPORT_ID (Keyboard)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x85;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = KEYBOARD_REPORT_ID;
-
-  // USAGE_PAGE (Keyboard/Keypad)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x07;
+  if (keyboardReportId != 0) {
+    // Modifier byte, reserved byte and a 6 key array, see keyboard_report_t
+    hid.usagePage(0x01).usage(0x06);
+    hid.collection(HID_COLLECTION_APPLICATION);
+    hid.reportId(keyboardReportId);
 
-  // USAGE_MINIMUM (Keyboard LeftControl)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x19;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0xe0;
+    hid.usagePage(0x07).usageMinimum(0xE0).usageMaximum(0xE7);
+    hid.logicalMinimum(0).logicalMaximum(1);
+    hid.reportSize(1).reportCount(8).input(HID_DATA_VAR_ABS);
 
-  // USAGE_MAXIMUM (Keyboard Right GUI)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x29;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0xe7;
+    hid.reportCount(1).reportSize(8).input(HID_CONST_VAR_ABS);
 
-  // LOGICAL_MINIMUM (0)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x15;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
+    hid.reportCount(6).reportSize(8);
+    hid.logicalMinimum(0).logicalMaximum(0x65);
+    hid.usagePage(0x07).usageMinimum(0x00).usageMaximum(0x65);
+    hid.input(HID_DATA_ARRAY_ABS);
 
-  // LOGICAL_MAXIMUM (1)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x25;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-  // REPORT_SIZE (1)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-  // REPORT_COUNT (8)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x08;
-
-  // INPUT (Data,Var,Abs)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
-
-  // REPORT_COUNT (1) - Reserved byte
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-  // REPORT_SIZE (8)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x08;
+    hid.endCollection();
+  }
 
-  // INPUT (Const,Var,Abs) - Reserved byte
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x03;
+  // ============ N-KEY ROLLOVER KEYBOARD DESCRIPTOR ============
+  if (keyboardNkroReportId != 0) {
+    // Modifier byte and one bit per usage, see keyboard_nkro_report_t
+    hid.usagePage(0x01).usage(0x06);
+    hid.collection(HID_COLLECTION_APPLICATION);
+    hid.reportId(keyboardNkroReportId);
 
-  // REPORT_COUNT (6) - Key array
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x06;
+    hid.usagePage(0x07).usageMinimum(0xE0).usageMaximum(0xE7);
+    hid.logicalMinimum(0).logicalMaximum(1);
+    hid.reportSize(1).reportCount(8).input(HID_DATA_VAR_ABS);
 
-  // REPORT_SIZE (8)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x08;
+    hid.usageMinimum(0x00).usageMaximum(0x7F);
+    hid.reportCount(128).input(HID_DATA_VAR_ABS);
 
-  // LOGICAL_MINIMUM (0)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x15;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
+    hid.endCollection();
+  }
 
-  // LOGICAL_MAXIMUM (101)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x25;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x65;
+  // =================== MOUSE DESCRIPTOR ===================
+  if (mouseReportId != 0) {
+    // Based on ESP32-NimBLE-Mouse: buttons(1 byte) + X(1) + Y(1) + wheel(1) +
+    // hWheel(1) = 5 bytes, see mouse_report_t
+    hid.usagePage(0x01).usage(0x02);
+    hid.collection(HID_COLLECTION_APPLICATION);
+    hid.usage(0x01); // Pointer
+    hid.collection(HID_COLLECTION_PHYSICAL);
+    hid.reportId(mouseReportId);
+
+    // 5 buttons + 3 bit padding
+    hid.usagePage(0x09).usageMinimum(1).usageMaximum(5);
+    hid.logicalMinimum(0).logicalMaximum(1);
+    hid.reportSize(1).reportCount(5).input(HID_DATA_VAR_ABS);
+    hid.reportSize(3).reportCount(1).input(HID_CONST_VAR_ABS);
+
+    // X and Y
+    hid.usagePage(0x01).usage(0x30).usage(0x31);
+    hid.logicalMinimum(-127).logicalMaximum(127);
+    hid.reportSize(8).reportCount(2).input(HID_DATA_VAR_REL);
+
+    // Vertical wheel
+    hid.usage(0x38);
+    hid.logicalMinimum(-127).logicalMaximum(127);
+    hid.reportSize(8).reportCount(1).input(HID_DATA_VAR_REL);
+
+    // Horizontal wheel (AC Pan)
+    hid.usagePage(0x0C).usage(0x238);
+    hid.logicalMinimum(-127).logicalMaximum(127);
+    hid.reportSize(8).reportCount(1).input(HID_DATA_VAR_REL);
+
+    hid.endCollection();
+    hid.endCollection();
+  }
+}
+
+uint8_t *BleController::packInt16(uint8_t *report, int16_t value) {
+  memcpy(report, &value, sizeof(value));
+  return report + sizeof(value);
+}
+
+// Packs controllerReports[index]; a static layout only has the one report
+void BleController::packReport(uint8_t index, uint8_t *report) {
+  if (reportPacker != nullptr) {
+    reportPacker(this, report);
+    return;
+  }
 
-  // USAGE_PAGE (Keyboard/Keypad)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x07;
+  // The layout covers every report bit except padding exactly once, and
+  // padding is never written, so no clearing needed
+  for (uint8_t i = 0; i < reportFieldCount; i++) {
+    const report_field_t &field = reportLayout[i];
+    if (field.report != index) {
+      continue;
+    }
 
-  // USAGE_MINIMUM (Reserved)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x19;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
+    if (field.width > 0) {
+      memcpy(report + field.bitOffset / 8, field.source, field.width);
+    } else {
+      packBits(report, field.bitOffset, field.bits,
+               *(const int16_t *)field.source >> field.shift);
+    }
+  }
+}
 
-  // USAGE_MAXIMUM (Keyboard Application)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x29;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x65;
+// Writes the low bits bits of value at bitOffset, LSB first as HID expects,
+// leaving the neighbouring bits of the first and last byte as they are
+void BleController::packBits(uint8_t *report, uint16_t bitOffset,
+                             uint8_t bits, uint16_t value) {
+  uint8_t *bytes = report + bitOffset / 8;
+  uint8_t shift = bitOffset % 8;
+  uint32_t mask = ((1UL << bits) - 1) << shift;
+  uint32_t shifted = ((uint32_t)value << shift) & mask;
 
-  // INPUT (Data,Array,Abs)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
+  for (uint8_t i = 0; i * 8 < shift + bits; i++) {
+    bytes[i] = (bytes[i] & ~(mask >> (8 * i))) | (shifted >> (8 * i));
+  }
+}
 
-  // END_COLLECTION (Application) - End keyboard collection
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0xc0;
+// With the scheduler running, the scheduler task is the only one that sends
+// controller reports. Setters only wake it early for button and hat edges.
+void BleController::requestReport(bool urgent) {
+  if (updateDepth > 0) {
+    deferredReport |= DEFERRED_REPORT_AUTO;
+    if (urgent) {
+      deferredReport |= DEFERRED_REPORT_URGENT;
+    }
+    return;
+  }
 
-  // =================== MOUSE DESCRIPTOR ===================
-  // Based on ESP32-NimBLE-Mouse reference implementation
-  // Report format: buttons(1 byte) + X(1) + Y(1) + wheel(1) + hWheel(1) = 5
-  // bytes
-
-  // USAGE_PAGE (Generic Desktop)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-  // USAGE (Mouse)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
-
-  // COLLECTION (Application)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0xa1;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-  // USAGE (Pointer)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-  // COLLECTION (Physical)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0xa1;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-
-  // REPORT_ID (Mouse)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x85;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = MOUSE_REPORT_ID;
-
-  // ---- Buttons (5 buttons + 3 bit padding = 1 byte) ----
-  // USAGE_PAGE (Button)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-
-  // USAGE_MINIMUM (Button 1)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x19;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-  // USAGE_MAXIMUM (Button 5)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x29;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-
-  // LOGICAL_MINIMUM (0)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x15;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x00;
-
-  // LOGICAL_MAXIMUM (1)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x25;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-  // REPORT_SIZE (1)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
-
-  // REPORT_COUNT (5) - 5 button bits
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-
-  // INPUT (Data,Var,Abs) - 5 button bits
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
-
-  // REPORT_SIZE (3) - 3 bit padding
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x03;
-
-  // REPORT_COUNT (1)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+  uint8_t request = DEFERRED_REPORT_AUTO;
+  if (urgent) {
+    request |= DEFERRED_REPORT_URGENT;
+  }
 
-  // INPUT (Const,Var,Abs) - Padding
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x03;
+  if (pipelineTask != nullptr) {
+    pushDelta(STATE_DELTA_REPORT, nullptr, request, 0);
+  } else {
+    dispatchReport(request);
+  }
+}
 
-  // ---- X/Y (2 bytes) ----
-  // USAGE_PAGE (Generic Desktop)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+// Sends or schedules a report for DEFERRED_REPORT_* request bits. Called on the
+// setter's task, or by the pipeline task once the changes before the request
+// have been applied.
+//
+// Extra controllers use their owner's scheduler, which sends every
+// controller's reports in the same tick.
+void BleController::dispatchReport(uint8_t request) {
+  TaskHandle_t scheduler =
+      owner != nullptr ? owner->reportSchedulerTask : reportSchedulerTask;
 
-  // USAGE (X)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x30;
+  if (scheduler != nullptr) {
+    if (request & (DEFERRED_REPORT_URGENT | DEFERRED_REPORT_SEND)) {
+      xTaskNotifyGive(scheduler);
+    }
+  } else if ((request & DEFERRED_REPORT_SEND) || configuration.getAutoReport()) {
+    sendControllerReport();
+  }
+}
 
-  // USAGE (Y)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x31;
+void BleController::sendReport(void) {
+  if (updateDepth > 0) {
+    deferredReport |= DEFERRED_REPORT_SEND;
+    return;
+  }
 
-  // LOGICAL_MINIMUM (-127)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x15;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
+  if (pipelineTask != nullptr) {
+    pushDelta(STATE_DELTA_REPORT, nullptr, DEFERRED_REPORT_SEND, 0);
+  } else {
+    dispatchReport(DEFERRED_REPORT_SEND);
+  }
+}
 
-  // LOGICAL_MAXIMUM (127)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x25;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x7f;
+void BleController::sendControllerReport() { runControllerSender(true); }
 
-  // REPORT_SIZE (8)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x08;
+// Only one task at a time packs and notifies controller reports: the report
+// buffers and the send queues are not locked. A task that finds another one
+// sending leaves its request to that task, which goes round once more before
+// it lets go, so no change is lost and no setter waits. send is false to only
+// retry the queued reports.
+void BleController::runControllerSender(bool send) {
+  if (senderRequests.fetch_add(1) != 0) {
+    return;
+  }
 
-  // REPORT_COUNT (2) - X and Y only
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
+  uint32_t requests = 1;
+  do {
+    if (send) {
+      sendChangedControllerReports();
+    } else {
+      syncControllerQueues();
+      flushControllerQueues(0);
+    }
+    // Whatever was asked for meanwhile, a send covers it
+    send = true;
+    requests = senderRequests.fetch_sub(requests) - requests;
+  } while (requests != 0);
+}
 
-  // INPUT (Data,Var,Rel) - Relative movement
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x06;
+void BleController::sendChangedControllerReports() {
+  if (!this->isConnected()) {
+    return;
+  }
 
-  // ---- Vertical Wheel (1 byte) ----
-  // USAGE (Wheel)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x09;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x38;
+  // A new connection has not seen any report yet
+  bool firstReport = lastSentConnection != connectionStatus->connectionCount;
+  syncControllerQueues();
 
-  // LOGICAL_MINIMUM (-127)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x15;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
+  // Cleared before packing, so a setter running concurrently is never lost
+  uint32_t dirty = dirtyFields.exchange(0);
 
-  // LOGICAL_MAXIMUM (127)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x25;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x7f;
+  // Only reports with changed fields are packed and sent
+  uint8_t stale = 0;
+  for (uint8_t i = 0; i < controllerReportCount; i++) {
+    controller_report_t &report = controllerReports[i];
+    if (firstReport) {
+      report.lastSentValid = false;
+    }
+    if (report.size > 0 &&
+        (!report.lastSentValid || (dirty & report.dirtyMask) != 0)) {
+      stale |= 1 << i;
+    }
+  }
 
-  // REPORT_SIZE (8)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x08;
+  if (stale == 0) {
+    suppressedReportCount++;
+    flushControllerQueues(0);
+    return;
+  }
 
-  // REPORT_COUNT (1) - Wheel only
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+  // Retry until no setter ran while the reports were being packed
+  uint32_t version;
+  do {
+    version = beginStateRead();
+    for (uint8_t i = 0; i < controllerReportCount; i++) {
+      if (stale & (1 << i)) {
+        packReport(i, controllerReports[i].pending);
+      }
+    }
+  } while (!endStateRead(version));
 
-  // INPUT (Data,Var,Rel) - Relative movement
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x06;
+  uint8_t sent = 0;
+  for (uint8_t i = 0; i < controllerReportCount; i++) {
+    controller_report_t &report = controllerReports[i];
 
-  // ---- Horizontal Wheel (1 byte) ----
-  // USAGE_PAGE (Consumer Devices)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x05;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x0c;
+    // A value can be changed and changed back between two reports
+    if ((stale & (1 << i)) == 0 ||
+        (report.lastSentValid &&
+         memcmp(report.pending, report.lastSent, report.size) == 0)) {
+      continue;
+    }
 
-  // USAGE (AC Pan)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x0a;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x38;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x02;
+#if BLE_CONTROLLER_DEBUG == 1
+    dumpHIDReport(report.pending, report.size);
+#endif
 
-  // LOGICAL_MINIMUM (-127)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x15;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
+    report.queue.send(report.pending, report.size);
 
-  // LOGICAL_MAXIMUM (127)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x25;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x7f;
+    uint8_t *sentReport = report.pending;
+    report.pending = report.lastSent;
+    report.lastSent = sentReport;
+    report.lastSentValid = true;
+    sent |= 1 << i;
+  }
 
-  // REPORT_SIZE (8)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x75;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x08;
+  if (sent == 0) {
+    suppressedReportCount++;
+    flushControllerQueues(0);
+    return;
+  }
 
-  // REPORT_COUNT (1)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x95;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x01;
+  // Reports that were not resent may still have older ones queued
+  flushControllerQueues(sent);
 
-  // INPUT (Data,Var,Rel)
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x81;
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0x06;
+#if BLE_CONTROLLER_STATS == 1
+  recordControllerReport(firstReport);
+#endif
 
-  // END_COLLECTION (Physical) - End mouse pointer collection
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0xc0;
+  lastSentConnection = connectionStatus->connectionCount;
+}
 
-  // END_COLLECTION (Application) - End mouse collection
-  tempHidReportDescriptor[hidReportDescriptorSize++] = 0xc0;
+// Retries the queued controller reports, except those in the skip bitmask
+void BleController::flushControllerQueues(uint8_t skip) {
+  for (uint8_t i = 0; i < controllerReportCount; i++) {
+    if ((skip & (1 << i)) == 0) {
+      controllerReports[i].queue.flush();
+    }
+  }
+}
 
-  // Set task priority from 5 to 1 in order to get ESP32-C3 working
-  xTaskCreate(this->taskServer, "server", 20000, (void *)this, 1, NULL);
+uint32_t BleController::getSuppressedReportCount() {
+  return suppressedReportCount;
 }
 
-void BleController::end(void) {}
+uint32_t BleController::getPipelineDroppedCount() {
+  return pipelineDroppedCount;
+}
 
-void BleController::setAxes(int16_t x, int16_t y, int16_t z, int16_t rX,
-                            int16_t rY, int16_t rZ, int16_t slider1,
-                            int16_t slider2) {
-  if (x == -32768) {
-    x = -32767;
-  }
-  if (y == -32768) {
-    y = -32767;
-  }
-  if (z == -32768) {
-    z = -32767;
+// Reports queued for a previous connection are stale
+void BleController::syncReportQueues() {
+  if (reportQueueConnection != connectionStatus->connectionCount) {
+    keyboardQueue.clear();
+    mouseQueue.clear();
+    keyboardNkroQueue.clear();
+    reportQueueConnection = connectionStatus->connectionCount;
   }
-  if (rZ == -32768) {
-    rZ = -32767;
-  }
-  if (rX == -32768) {
-    rX = -32767;
-  }
-  if (rY == -32768) {
-    rY = -32767;
-  }
-  if (slider1 == -32768) {
-    slider1 = -32767;
-  }
-  if (slider2 == -32768) {
-    slider2 = -32767;
-  }
-
-  _x = x;
-  _y = y;
-  _z = z;
-  _rZ = rZ;
-  _rX = rX;
-  _rY = rY;
-  _slider1 = slider1;
-  _slider2 = slider2;
 
-  if (configuration.getAutoReport()) {
-    sendReport();
+  // Reports longer than the MTU allows wait in their queue, then are
+  // dropped, see BleReportQueue
+  if (reportQueueMtu != connectionStatus->mtu) {
+    uint16_t limit = connectionStatus->mtu - 3;
+    keyboardQueue.setPayloadLimit(limit);
+    mouseQueue.setPayloadLimit(limit);
+    keyboardNkroQueue.setPayloadLimit(limit);
+    reportQueueMtu = connectionStatus->mtu;
   }
 }
 
-void BleController::setHIDAxes(int16_t x, int16_t y, int16_t z, int16_t rZ,
-                               int16_t rX, int16_t rY, int16_t slider1,
-                               int16_t slider2) {
-  if (x == -32768) {
-    x = -32767;
-  }
-  if (y == -32768) {
-    y = -32767;
-  }
-  if (z == -32768) {
-    z = -32767;
-  }
-  if (rZ == -32768) {
-    rZ = -32767;
-  }
-  if (rX == -32768) {
-    rX = -32767;
-  }
-  if (rY == -32768) {
-    rY = -32767;
-  }
-  if (slider1 == -32768) {
-    slider1 = -32767;
-  }
-  if (slider2 == -32768) {
-    slider2 = -32767;
+// The same for the controller report queues, on the sending task only, see
+// runControllerSender()
+void BleController::syncControllerQueues() {
+  if (controllerQueueConnection != connectionStatus->connectionCount) {
+    for (uint8_t i = 0; i < controllerReportCount; i++) {
+      controllerReports[i].queue.clear();
+    }
+    controllerQueueConnection = connectionStatus->connectionCount;
   }
 
-  _x = x;
-  _y = y;
-  _z = z;
-  _rZ = rZ;
-  _rX = rX;
-  _rY = rY;
-  _slider1 = slider1;
-  _slider2 = slider2;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
+  if (controllerQueueMtu != connectionStatus->mtu) {
+    for (uint8_t i = 0; i < controllerReportCount; i++) {
+      controllerReports[i].queue.setPayloadLimit(connectionStatus->mtu - 3);
+    }
+    controllerQueueMtu = connectionStatus->mtu;
   }
 }
 
-void BleController::setSimulationControls(int16_t rudder, int16_t throttle,
-                                          int16_t accelerator, int16_t brake,
-                                          int16_t steering) {
-  if (rudder == -32768) {
-    rudder = -32767;
-  }
-  if (throttle == -32768) {
-    throttle = -32767;
+BleReportQueue *BleController::getReportQueue(uint8_t reportId) {
+  for (uint8_t i = 0; i < controllerReportCount; i++) {
+    if (controllerReports[i].reportId == reportId) {
+      return &controllerReports[i].queue;
+    }
   }
-  if (accelerator == -32768) {
-    accelerator = -32767;
+
+  if (reportId == 0) {
+    return nullptr;
+  } else if (reportId == keyboardReportId) {
+    return &keyboardQueue;
+  } else if (reportId == mouseReportId) {
+    return &mouseQueue;
+  } else if (reportId == keyboardNkroReportId) {
+    return &keyboardNkroQueue;
   }
-  if (brake == -32768) {
-    brake = -32767;
+  return nullptr;
+}
+
+#if BLE_CONTROLLER_STATS == 1
+// The first report of a connection carries state set while disconnected, so
+// it starts a new interval series and has no meaningful latency
+void BleController::recordControllerReport(bool firstReport) {
+  uint32_t now = micros();
+
+  if (firstReport) {
+    lastReportAtValid = false;
   }
-  if (steering == -32768) {
-    steering = -32767;
+
+  uint16_t pendingCount = 0;
+  for (uint8_t i = 0; i < controllerReportCount; i++) {
+    pendingCount += controllerReports[i].queue.getPendingCount();
   }
 
-  _rudder = rudder;
-  _throttle = throttle;
-  _accelerator = accelerator;
-  _brake = brake;
-  _steering = steering;
+  // Reports still queued are not on air yet, they only count as failures
+  if (!firstReport && pendingCount == 0) {
+    uint32_t latency = now - changedAt;
+    if (latencySamples == 0 || latency < latencyMin) {
+      latencyMin = latency;
+    }
+    if (latency > latencyMax) {
+      latencyMax = latency;
+    }
+    latencyTotal += latency;
+    latencySamples++;
+  }
 
-  if (configuration.getAutoReport()) {
-    sendReport();
+  if (lastReportAtValid) {
+    uint32_t interval = (now - lastReportAt) / 1000;
+    uint8_t bucket = 0;
+    while (interval >= 2 && bucket < STATS_INTERVAL_BUCKETS - 1) {
+      interval >>= 1;
+      bucket++;
+    }
+    intervalHistogram[bucket]++;
   }
+  lastReportAt = now;
+  lastReportAtValid = true;
 }
+#endif
 
-void BleController::setHats(signed char hat1, signed char hat2,
-                            signed char hat3, signed char hat4) {
-  _hat1 = hat1;
-  _hat2 = hat2;
-  _hat3 = hat3;
-  _hat4 = hat4;
+ble_controller_stats_t BleController::getStats() {
+  ble_controller_stats_t stats;
+  memset(&stats, 0, sizeof(stats));
+
+  stats.controllerReportCount = controllerReportCount;
+  for (uint8_t i = 0; i < controllerReportCount; i++) {
+    BleReportQueue &queue = controllerReports[i].queue;
+    stats.controllerReportIds[i] = controllerReports[i].reportId;
+    stats.controllerReportsSent[i] = queue.getSentCount();
+    stats.controllerReports += queue.getSentCount();
+    stats.notifyFailures += queue.getRetryCount();
+    stats.droppedReports += queue.getDroppedCount();
+    stats.bytesSent += queue.getBytesSent();
+  }
+  stats.keyboardReports =
+      keyboardQueue.getSentCount() + keyboardNkroQueue.getSentCount();
+  stats.mouseReports = mouseQueue.getSentCount();
+  stats.notifyFailures += keyboardQueue.getRetryCount() +
+                          mouseQueue.getRetryCount() +
+                          keyboardNkroQueue.getRetryCount();
+  stats.droppedReports += keyboardQueue.getDroppedCount() +
+                          mouseQueue.getDroppedCount() +
+                          keyboardNkroQueue.getDroppedCount();
+  stats.suppressedReports = suppressedReportCount;
+  stats.bytesSent += keyboardQueue.getBytesSent() + mouseQueue.getBytesSent() +
+                     keyboardNkroQueue.getBytesSent();
+
+#if BLE_CONTROLLER_STATS == 1
+  if (latencySamples > 0) {
+    stats.latencyMin = latencyMin;
+    stats.latencyAvg = latencyTotal / latencySamples;
+    stats.latencyMax = latencyMax;
+  }
+  memcpy(stats.intervalHistogram, intervalHistogram,
+         sizeof(stats.intervalHistogram));
+#endif
 
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  return stats;
 }
 
-void BleController::setSliders(int16_t slider1, int16_t slider2) {
-  if (slider1 == -32768) {
-    slider1 = -32767;
-  }
-  if (slider2 == -32768) {
-    slider2 = -32767;
+void BleController::resetStats() {
+  for (uint8_t i = 0; i < controllerReportCount; i++) {
+    controllerReports[i].queue.resetCounters();
   }
+  keyboardQueue.resetCounters();
+  mouseQueue.resetCounters();
+  keyboardNkroQueue.resetCounters();
+  suppressedReportCount = 0;
 
-  _slider1 = slider1;
-  _slider2 = slider2;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+#if BLE_CONTROLLER_STATS == 1
+  lastReportAtValid = false;
+  latencySamples = 0;
+  latencyTotal = 0;
+  latencyMin = 0;
+  latencyMax = 0;
+  memset(intervalHistogram, 0, sizeof(intervalHistogram));
+#endif
 }
 
-void BleController::sendReport(void) {
-  if (this->isConnected()) {
-    uint8_t currentReportIndex = 0;
+// One line of text, so the statistics can be read with any NUS terminal app
+// Appends to a NUS stats line and returns its new length. A line too long for
+// its buffer is cut short instead of being written past the end.
+static size_t appendStats(char *line, size_t size, size_t length,
+                          const char *format, ...) {
+  if (length + 1 >= size) {
+    return length;
+  }
 
-    uint8_t m[hidReportSize];
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(line + length, size - length, format, args);
+  va_end(args);
 
-    memset(&m, 0, sizeof(m));
-    memcpy(&m, &_buttons, sizeof(_buttons));
+  if (written < 0) {
+    return length;
+  }
+  return length + written < size - 1 ? length + written : size - 1;
+}
 
-    currentReportIndex += numOfButtonBytes;
+void BleController::sendStatsOverNUS() {
+  if (!nus) {
+    return;
+  }
 
-    if (configuration.getTotalSpecialButtonCount() > 0) {
-      m[currentReportIndex++] = _specialButtons;
-    }
+  // Fits every counter at 10 digits and all the controller report IDs
+  ble_controller_stats_t stats = getStats();
+  char line[192 + STATS_INTERVAL_BUCKETS * 11 + MAX_CONTROLLER_REPORTS * 15];
+  size_t length = appendStats(
+      line, sizeof(line), 0,
+      "reports=%lu/%lu/%lu fail=%lu drop=%lu skip=%lu bytes=%lu "
+      "latency=%lu/%lu/%lu hist=",
+      (unsigned long)stats.controllerReports,
+      (unsigned long)stats.keyboardReports, (unsigned long)stats.mouseReports,
+      (unsigned long)stats.notifyFailures, (unsigned long)stats.droppedReports,
+      (unsigned long)stats.suppressedReports, (unsigned long)stats.bytesSent,
+      (unsigned long)stats.latencyMin, (unsigned long)stats.latencyAvg,
+      (unsigned long)stats.latencyMax);
 
-    if (configuration.getIncludeXAxis()) {
-      m[currentReportIndex++] = _x;
-      m[currentReportIndex++] = (_x >> 8);
-    }
-    if (configuration.getIncludeYAxis()) {
-      m[currentReportIndex++] = _y;
-      m[currentReportIndex++] = (_y >> 8);
-    }
-    if (configuration.getIncludeZAxis()) {
-      m[currentReportIndex++] = _z;
-      m[currentReportIndex++] = (_z >> 8);
-    }
-    if (configuration.getIncludeRzAxis()) {
-      m[currentReportIndex++] = _rZ;
-      m[currentReportIndex++] = (_rZ >> 8);
-    }
-    if (configuration.getIncludeRxAxis()) {
-      m[currentReportIndex++] = _rX;
-      m[currentReportIndex++] = (_rX >> 8);
-    }
-    if (configuration.getIncludeRyAxis()) {
-      m[currentReportIndex++] = _rY;
-      m[currentReportIndex++] = (_rY >> 8);
-    }
+  for (uint8_t i = 0; i < STATS_INTERVAL_BUCKETS; i++) {
+    length = appendStats(line, sizeof(line), length, i == 0 ? "%lu" : ",%lu",
+                         (unsigned long)stats.intervalHistogram[i]);
+  }
+  for (uint8_t i = 0; i < stats.controllerReportCount; i++) {
+    length = appendStats(line, sizeof(line), length,
+                         i == 0 ? " ids=%u:%lu" : ",%u:%lu",
+                         stats.controllerReportIds[i],
+                         (unsigned long)stats.controllerReportsSent[i]);
+  }
+  length = appendStats(line, sizeof(line), length, "\n");
 
-    if (configuration.getIncludeSlider1()) {
-      m[currentReportIndex++] = _slider1;
-      m[currentReportIndex++] = (_slider1 >> 8);
-    }
-    if (configuration.getIncludeSlider2()) {
-      m[currentReportIndex++] = _slider2;
-      m[currentReportIndex++] = (_slider2 >> 8);
-    }
+  nus->sendData((const uint8_t *)line, length);
+}
 
-    if (configuration.getIncludeRudder()) {
-      m[currentReportIndex++] = _rudder;
-      m[currentReportIndex++] = (_rudder >> 8);
-    }
-    if (configuration.getIncludeThrottle()) {
-      m[currentReportIndex++] = _throttle;
-      m[currentReportIndex++] = (_throttle >> 8);
-    }
-    if (configuration.getIncludeAccelerator()) {
-      m[currentReportIndex++] = _accelerator;
-      m[currentReportIndex++] = (_accelerator >> 8);
-    }
-    if (configuration.getIncludeBrake()) {
-      m[currentReportIndex++] = _brake;
-      m[currentReportIndex++] = (_brake >> 8);
-    }
-    if (configuration.getIncludeSteering()) {
-      m[currentReportIndex++] = _steering;
-      m[currentReportIndex++] = (_steering >> 8);
-    }
+// Retries reports held back by congestion. With the scheduler running, the
+// controller queues belong to the scheduler task and are retried every tick.
+void BleController::flushReports() {
+  if (!this->isConnected()) {
+    return;
+  }
 
-    if (configuration.getIncludeGyroscope()) {
-      m[currentReportIndex++] = _gX;
-      m[currentReportIndex++] = (_gX >> 8);
-      m[currentReportIndex++] = _gY;
-      m[currentReportIndex++] = (_gY >> 8);
-      m[currentReportIndex++] = _gZ;
-      m[currentReportIndex++] = (_gZ >> 8);
+  syncReportQueues();
+  if (reportSchedulerTask == nullptr) {
+    for (uint8_t i = 0; i < getControllerCount(); i++) {
+      controller(i).runControllerSender(false);
     }
+  }
+  keyboardQueue.flush();
+  mouseQueue.flush();
+  keyboardNkroQueue.flush();
+}
 
-    if (configuration.getIncludeAccelerometer()) {
-      m[currentReportIndex++] = _aX;
-      m[currentReportIndex++] = (_aX >> 8);
-      m[currentReportIndex++] = _aY;
-      m[currentReportIndex++] = (_aY >> 8);
-      m[currentReportIndex++] = _aZ;
-      m[currentReportIndex++] = (_aZ >> 8);
-    }
+// Updates may be nested; only the outermost commit() sends
+void BleController::beginUpdate() { updateDepth++; }
 
-    if (configuration.getHatSwitchCount() > 0) {
-      signed char hats[4];
+void BleController::commit() {
+  if (updateDepth == 0 || --updateDepth > 0) {
+    return;
+  }
 
-      hats[0] = _hat1;
-      hats[1] = _hat2;
-      hats[2] = _hat3;
-      hats[3] = _hat4;
+  uint8_t deferred = deferredReport.exchange(0);
 
-      for (int currentHatIndex = configuration.getHatSwitchCount() - 1;
-           currentHatIndex >= 0; currentHatIndex--) {
-        m[currentReportIndex++] = hats[currentHatIndex];
-      }
+  if (deferred & DEFERRED_REPORT_SEND) {
+    sendReport();
+  } else if (deferred & DEFERRED_REPORT_AUTO) {
+    // The scheduler skips ticks while an update is open, so catch up now
+    requestReport((deferred & DEFERRED_REPORT_URGENT) ||
+                  scheduledReportDeferred.exchange(false));
+  }
+}
+
+void BleController::setAllAxes(const int16_t axes[POSSIBLEAXES]) {
+  beginStateWrite();
+  updateValue(_x, axes[X_AXIS], DIRTY_X);
+  updateValue(_y, axes[Y_AXIS], DIRTY_Y);
+  updateValue(_z, axes[Z_AXIS], DIRTY_Z);
+  updateValue(_rX, axes[RX_AXIS], DIRTY_RX);
+  updateValue(_rY, axes[RY_AXIS], DIRTY_RY);
+  updateValue(_rZ, axes[RZ_AXIS], DIRTY_RZ);
+  updateValue(_slider1, axes[SLIDER1], DIRTY_SLIDER1);
+  updateValue(_slider2, axes[SLIDER2], DIRTY_SLIDER2);
+  endStateWrite();
+
+  requestReport(false);
+}
+
+void BleController::setAllSimulationControls(
+    const int16_t simulationControls[POSSIBLESIMULATIONCONTROLS]) {
+  beginStateWrite();
+  updateValue(_rudder, simulationControls[RUDDER], DIRTY_RUDDER);
+  updateValue(_throttle, simulationControls[THROTTLE], DIRTY_THROTTLE);
+  updateValue(_accelerator, simulationControls[ACCELERATOR],
+              DIRTY_ACCELERATOR);
+  updateValue(_brake, simulationControls[BRAKE], DIRTY_BRAKE);
+  updateValue(_steering, simulationControls[STEERING], DIRTY_STEERING);
+  endStateWrite();
+
+  requestReport(false);
+}
+
+void BleController::setAllHats(const signed char hats[4]) {
+  beginStateWrite();
+  updateHat(_hat1, hats[0], DIRTY_HAT1);
+  updateHat(_hat2, hats[1], DIRTY_HAT2);
+  updateHat(_hat3, hats[2], DIRTY_HAT3);
+  updateHat(_hat4, hats[3], DIRTY_HAT4);
+  endStateWrite();
+
+  requestReport(true);
+}
+
+// buttons[0] bit 0 is BUTTON_1, buttons[15] bit 7 is BUTTON_128
+void BleController::setButtons(const uint8_t buttons[16]) {
+  beginStateWrite();
+  if (pipelineTask != nullptr) {
+    for (uint8_t i = 0; i < sizeof(_buttons); i++) {
+      pushDelta(STATE_DELTA_SET_BYTE, &_buttons[i], buttons[i], DIRTY_BUTTONS);
     }
-
-#if BLE_CONTROLLER_DEBUG == 1
-    dumpHIDReport(m, sizeof(m));
-#endif
-
-    this->inputController->setValue(m, sizeof(m));
-    this->inputController->notify();
+  } else if (memcmp(_buttons, buttons, sizeof(_buttons)) != 0) {
+    memcpy(_buttons, buttons, sizeof(_buttons));
+    markDirty(DIRTY_BUTTONS);
   }
+  endStateWrite();
+
+  requestReport(true);
 }
 
 void BleController::press(uint8_t b) {
+  beginStateWrite();
   uint8_t index = (b - 1) / 8;
   uint8_t bit = (b - 1) % 8;
   uint8_t bitmask = (1 << bit);
 
-  uint8_t result = _buttons[index] | bitmask;
+  setStateBits(_buttons[index], bitmask, DIRTY_BUTTONS);
+  endStateWrite();
 
-  if (result != _buttons[index]) {
-    _buttons[index] = result;
-  }
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(true);
 }
 
 void BleController::release(uint8_t b) {
+  beginStateWrite();
   uint8_t index = (b - 1) / 8;
   uint8_t bit = (b - 1) % 8;
   uint8_t bitmask = (1 << bit);
 
-  uint64_t result = _buttons[index] & ~bitmask;
-
-  if (result != _buttons[index]) {
-    _buttons[index] = result;
-  }
+  clearStateBits(_buttons[index], bitmask, DIRTY_BUTTONS);
+  endStateWrite();
 
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(true);
 }
 
 uint8_t BleController::specialButtonBitPosition(uint8_t b) {
@@ -1307,35 +1559,27 @@ uint8_t BleController::specialButtonBitPosition(uint8_t b) {
 }
 
 void BleController::pressSpecialButton(uint8_t b) {
+  beginStateWrite();
   uint8_t button = specialButtonBitPosition(b);
   uint8_t bit = button % 8;
   uint8_t bitmask = (1 << bit);
 
-  uint64_t result = _specialButtons | bitmask;
-
-  if (result != _specialButtons) {
-    _specialButtons = result;
-  }
+  setStateBits(_specialButtons, bitmask, DIRTY_SPECIAL_BUTTONS);
+  endStateWrite();
 
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(true);
 }
 
 void BleController::releaseSpecialButton(uint8_t b) {
+  beginStateWrite();
   uint8_t button = specialButtonBitPosition(b);
   uint8_t bit = button % 8;
   uint8_t bitmask = (1 << bit);
 
-  uint64_t result = _specialButtons & ~bitmask;
+  clearStateBits(_specialButtons, bitmask, DIRTY_SPECIAL_BUTTONS);
+  endStateWrite();
 
-  if (result != _specialButtons) {
-    _specialButtons = result;
-  }
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(true);
 }
 
 void BleController::pressStart() { pressSpecialButton(START_BUTTON); }
@@ -1379,299 +1623,207 @@ void BleController::releaseVolumeMute() {
 }
 
 void BleController::setLeftThumb(int16_t x, int16_t y) {
-  if (x == -32768) {
-    x = -32767;
-  }
-  if (y == -32768) {
-    y = -32767;
-  }
+  beginStateWrite();
+  updateValue(_x, x, DIRTY_X);
+  updateValue(_y, y, DIRTY_Y);
+  endStateWrite();
 
-  _x = x;
-  _y = y;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setRightThumb(int16_t z, int16_t rZ) {
-  if (z == -32768) {
-    z = -32767;
-  }
-  if (rZ == -32768) {
-    rZ = -32767;
-  }
-
-  _z = z;
-  _rZ = rZ;
+  beginStateWrite();
+  updateValue(_z, z, DIRTY_Z);
+  updateValue(_rZ, rZ, DIRTY_RZ);
+  endStateWrite();
 
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setRightThumbAndroid(int16_t z, int16_t rX) {
-  if (z == -32768) {
-    z = -32767;
-  }
-  if (rX == -32768) {
-    rX = -32767;
-  }
-
-  _z = z;
-  _rX = rX;
+  beginStateWrite();
+  updateValue(_z, z, DIRTY_Z);
+  updateValue(_rX, rX, DIRTY_RX);
+  endStateWrite();
 
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setLeftTrigger(int16_t rX) {
-  if (rX == -32768) {
-    rX = -32767;
-  }
-
-  _rX = rX;
+  beginStateWrite();
+  updateValue(_rX, rX, DIRTY_RX);
+  endStateWrite();
 
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setRightTrigger(int16_t rY) {
-  if (rY == -32768) {
-    rY = -32767;
-  }
+  beginStateWrite();
+  updateValue(_rY, rY, DIRTY_RY);
+  endStateWrite();
 
-  _rY = rY;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setTriggers(int16_t rX, int16_t rY) {
-  if (rX == -32768) {
-    rX = -32767;
-  }
-  if (rY == -32768) {
-    rY = -32767;
-  }
-
-  _rX = rX;
-  _rY = rY;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  beginStateWrite();
+  updateValue(_rX, rX, DIRTY_RX);
+  updateValue(_rY, rY, DIRTY_RY);
+  endStateWrite();
+
+  requestReport(false);
 }
 
 void BleController::setHat(signed char hat) {
-  _hat1 = hat;
+  beginStateWrite();
+  updateHat(_hat1, hat, DIRTY_HAT1);
+  endStateWrite();
 
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(true);
 }
 
 void BleController::setHat1(signed char hat1) {
-  _hat1 = hat1;
+  beginStateWrite();
+  updateHat(_hat1, hat1, DIRTY_HAT1);
+  endStateWrite();
 
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(true);
 }
 
 void BleController::setHat2(signed char hat2) {
-  _hat2 = hat2;
+  beginStateWrite();
+  updateHat(_hat2, hat2, DIRTY_HAT2);
+  endStateWrite();
 
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(true);
 }
 
 void BleController::setHat3(signed char hat3) {
-  _hat3 = hat3;
+  beginStateWrite();
+  updateHat(_hat3, hat3, DIRTY_HAT3);
+  endStateWrite();
 
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(true);
 }
 
 void BleController::setHat4(signed char hat4) {
-  _hat4 = hat4;
+  beginStateWrite();
+  updateHat(_hat4, hat4, DIRTY_HAT4);
+  endStateWrite();
 
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(true);
 }
 
 void BleController::setX(int16_t x) {
-  if (x == -32768) {
-    x = -32767;
-  }
+  beginStateWrite();
+  updateValue(_x, x, DIRTY_X);
+  endStateWrite();
 
-  _x = x;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setY(int16_t y) {
-  if (y == -32768) {
-    y = -32767;
-  }
+  beginStateWrite();
+  updateValue(_y, y, DIRTY_Y);
+  endStateWrite();
 
-  _y = y;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setZ(int16_t z) {
-  if (z == -32768) {
-    z = -32767;
-  }
+  beginStateWrite();
+  updateValue(_z, z, DIRTY_Z);
+  endStateWrite();
 
-  _z = z;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setRZ(int16_t rZ) {
-  if (rZ == -32768) {
-    rZ = -32767;
-  }
+  beginStateWrite();
+  updateValue(_rZ, rZ, DIRTY_RZ);
+  endStateWrite();
 
-  _rZ = rZ;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setRX(int16_t rX) {
-  if (rX == -32768) {
-    rX = -32767;
-  }
+  beginStateWrite();
+  updateValue(_rX, rX, DIRTY_RX);
+  endStateWrite();
 
-  _rX = rX;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setRY(int16_t rY) {
-  if (rY == -32768) {
-    rY = -32767;
-  }
+  beginStateWrite();
+  updateValue(_rY, rY, DIRTY_RY);
+  endStateWrite();
 
-  _rY = rY;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setSlider(int16_t slider) {
-  if (slider == -32768) {
-    slider = -32767;
-  }
+  beginStateWrite();
+  updateValue(_slider1, slider, DIRTY_SLIDER1);
+  endStateWrite();
 
-  _slider1 = slider;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setSlider1(int16_t slider1) {
-  if (slider1 == -32768) {
-    slider1 = -32767;
-  }
+  beginStateWrite();
+  updateValue(_slider1, slider1, DIRTY_SLIDER1);
+  endStateWrite();
 
-  _slider1 = slider1;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setSlider2(int16_t slider2) {
-  if (slider2 == -32768) {
-    slider2 = -32767;
-  }
+  beginStateWrite();
+  updateValue(_slider2, slider2, DIRTY_SLIDER2);
+  endStateWrite();
 
-  _slider2 = slider2;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setRudder(int16_t rudder) {
-  if (rudder == -32768) {
-    rudder = -32767;
-  }
+  beginStateWrite();
+  updateValue(_rudder, rudder, DIRTY_RUDDER);
+  endStateWrite();
 
-  _rudder = rudder;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setThrottle(int16_t throttle) {
-  if (throttle == -32768) {
-    throttle = -32767;
-  }
+  beginStateWrite();
+  updateValue(_throttle, throttle, DIRTY_THROTTLE);
+  endStateWrite();
 
-  _throttle = throttle;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setAccelerator(int16_t accelerator) {
-  if (accelerator == -32768) {
-    accelerator = -32767;
-  }
+  beginStateWrite();
+  updateValue(_accelerator, accelerator, DIRTY_ACCELERATOR);
+  endStateWrite();
 
-  _accelerator = accelerator;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setBrake(int16_t brake) {
-  if (brake == -32768) {
-    brake = -32767;
-  }
+  beginStateWrite();
+  updateValue(_brake, brake, DIRTY_BRAKE);
+  endStateWrite();
 
-  _brake = brake;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setSteering(int16_t steering) {
-  if (steering == -32768) {
-    steering = -32767;
-  }
+  beginStateWrite();
+  updateValue(_steering, steering, DIRTY_STEERING);
+  endStateWrite();
 
-  _steering = steering;
-
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 bool BleController::isPressed(uint8_t b) {
@@ -1695,9 +1847,7 @@ void BleController::setBatteryLevel(uint8_t level) {
     this->hid->setBatteryLevel(this->batteryLevel,
                                this->isConnected() ? true : false);
 
-    if (configuration.getAutoReport()) {
-      sendReport();
-    }
+    requestReport(false);
   }
 }
 
@@ -1859,73 +2009,37 @@ void BleController::setTXPowerLevel(int8_t level) {
 }
 
 void BleController::setGyroscope(int16_t gX, int16_t gY, int16_t gZ) {
-  if (gX == -32768) {
-    gX = -32767;
-  }
-
-  if (gY == -32768) {
-    gY = -32767;
-  }
-
-  if (gY == -32768) {
-    gY = -32767;
-  }
-
-  _gX = gX;
-  _gY = gY;
-  _gZ = gZ;
+  beginStateWrite();
+  updateValue(_gX, gX, DIRTY_GX);
+  updateValue(_gY, gY, DIRTY_GY);
+  updateValue(_gZ, gZ, DIRTY_GZ);
+  endStateWrite();
 
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setAccelerometer(int16_t aX, int16_t aY, int16_t aZ) {
-  _aX = aX;
-  _aY = aY;
-  _aZ = aZ;
+  beginStateWrite();
+  updateValue(_aX, aX, DIRTY_AX);
+  updateValue(_aY, aY, DIRTY_AY);
+  updateValue(_aZ, aZ, DIRTY_AZ);
+  endStateWrite();
 
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setMotionControls(int16_t gX, int16_t gY, int16_t gZ,
                                       int16_t aX, int16_t aY, int16_t aZ) {
-  if (gX == -32768) {
-    gX = -32767;
-  }
-
-  if (gY == -32768) {
-    gY = -32767;
-  }
-
-  if (gZ == -32768) {
-    gZ = -32767;
-  }
-
-  if (aX == -32768) {
-    aX = -32767;
-  }
-
-  if (aY == -32768) {
-    aY = -32767;
-  }
-
-  if (aZ == -32768) {
-    aZ = -32767;
-  }
-
-  _gX = gX;
-  _gY = gY;
-  _gZ = gZ;
-  _aX = aX;
-  _aY = aY;
-  _aZ = aZ;
+  beginStateWrite();
+  updateValue(_gX, gX, DIRTY_GX);
+  updateValue(_gY, gY, DIRTY_GY);
+  updateValue(_gZ, gZ, DIRTY_GZ);
+  updateValue(_aX, aX, DIRTY_AX);
+  updateValue(_aY, aY, DIRTY_AY);
+  updateValue(_aZ, aZ, DIRTY_AZ);
+  endStateWrite();
 
-  if (configuration.getAutoReport()) {
-    sendReport();
-  }
+  requestReport(false);
 }
 
 void BleController::setPowerStateAll(uint8_t batteryPowerInformation,
@@ -2081,6 +2195,12 @@ void BleController::taskServer(void *pvParameter) {
       pvParameter; // static_cast<BleController *>(pvParameter);
 
   NimBLEDevice::init(BleControllerInstance->deviceName);
+
+  // Ask for an MTU that fits the longest input report in one notification
+  uint16_t mtu = BleControllerInstance->connectionStatus->largestReportSize + 3;
+  if (mtu > NimBLEDevice::getMTU()) {
+    NimBLEDevice::setMTU(mtu);
+  }
   NimBLEDevice::setPower(
       BleControllerInstance->configuration
           .getTXPowerLevel()); // Set transmit power for advertising (Range: -12
@@ -2092,18 +2212,49 @@ void BleController::taskServer(void *pvParameter) {
 
   BleControllerInstance->hid = new NimBLEHIDDevice(pServer);
 
+  // One input characteristic per controller report ID in the report map
+  for (uint8_t i = 0; i < BleControllerInstance->getControllerCount(); i++) {
+    BleController &controller = BleControllerInstance->controller(i);
+    for (uint8_t j = 0; j < controller.controllerReportCount; j++) {
+      controller_report_t &report = controller.controllerReports[j];
+      report.queue.setCharacteristic(
+          BleControllerInstance->hid->getInputReport(report.reportId));
+    }
+  }
   BleControllerInstance->inputController =
       BleControllerInstance->hid->getInputReport(
-          BleControllerInstance->configuration
-              .getHidReportId()); // <-- input REPORTID from report map
+          BleControllerInstance->configuration.getHidReportId());
   BleControllerInstance->connectionStatus->inputController =
       BleControllerInstance->inputController;
 
-  // Initialize keyboard and mouse input characteristics
-  BleControllerInstance->inputKeyboard =
-      BleControllerInstance->hid->getInputReport(KEYBOARD_REPORT_ID);
-  BleControllerInstance->inputMouse =
-      BleControllerInstance->hid->getInputReport(MOUSE_REPORT_ID);
+  // Initialize keyboard and mouse input characteristics. Collections left out
+  // of the report map get none, and their queues drop reports.
+  BleControllerInstance->inputKeyboard = nullptr;
+  if (BleControllerInstance->keyboardReportId != 0) {
+    BleControllerInstance->inputKeyboard =
+        BleControllerInstance->hid->getInputReport(
+            BleControllerInstance->keyboardReportId);
+  }
+  BleControllerInstance->inputMouse = nullptr;
+  if (BleControllerInstance->mouseReportId != 0) {
+    BleControllerInstance->inputMouse =
+        BleControllerInstance->hid->getInputReport(
+            BleControllerInstance->mouseReportId);
+  }
+
+  BleControllerInstance->inputKeyboardNkro = nullptr;
+  if (BleControllerInstance->keyboardNkroReportId != 0) {
+    BleControllerInstance->inputKeyboardNkro =
+        BleControllerInstance->hid->getInputReport(
+            BleControllerInstance->keyboardNkroReportId);
+  }
+
+  BleControllerInstance->keyboardQueue.setCharacteristic(
+      BleControllerInstance->inputKeyboard);
+  BleControllerInstance->mouseQueue.setCharacteristic(
+      BleControllerInstance->inputMouse);
+  BleControllerInstance->keyboardNkroQueue.setCharacteristic(
+      BleControllerInstance->inputKeyboardNkro);
 
   if (BleControllerInstance->enableOutputReport) {
     BleControllerInstance->outputController =
@@ -2117,6 +2268,14 @@ void BleController::taskServer(void *pvParameter) {
         BleControllerInstance->outputReceiver);
   }
 
+  for (uint8_t i = 0; i < BleControllerInstance->featureReportCount; i++) {
+    const feature_report_t &report = BleControllerInstance->featureReports[i];
+    BleControllerInstance->hid->getFeatureReport(report.reportId)
+        ->setCallbacks(new BleFeatureReceiver(report.reportId, report.size,
+                                              report.readOnly,
+                                              report.callbacks));
+  }
+
   BleControllerInstance->hid->setManufacturer(
       BleControllerInstance->deviceManufacturer);
 
@@ -2173,20 +2332,14 @@ void BleController::taskServer(void *pvParameter) {
   NimBLEDevice::setSecurityAuth(true, false,
                                 false); // enable bonding, no MITM, no SC
 
-  uint8_t *customHidReportDescriptor =
-      new uint8_t[BleControllerInstance->hidReportDescriptorSize];
-  memcpy(customHidReportDescriptor,
-         BleControllerInstance->tempHidReportDescriptor,
-         BleControllerInstance->hidReportDescriptorSize);
-
 #if BLE_CONTROLLER_DEBUG == 1
   // Print HidReportDescriptor to Serial
-  dumpHidReportDescriptor(BleControllerInstance->tempHidReportDescriptor,
+  dumpHidReportDescriptor(BleControllerInstance->hidReportMap,
                           BleControllerInstance->hidReportDescriptorSize);
 #endif
 
   BleControllerInstance->hid->setReportMap(
-      (uint8_t *)customHidReportDescriptor,
+      (uint8_t *)BleControllerInstance->hidReportMap,
       BleControllerInstance->hidReportDescriptorSize);
   BleControllerInstance->hid->startServices();
 
@@ -2212,6 +2365,150 @@ void BleController::taskServer(void *pvParameter) {
   vTaskDelay(portMAX_DELAY); // delay(portMAX_DELAY);
 }
 
+// Report period in milliseconds: the configured interval, or one connection
+// interval (1.25 ms units, rounded up) when none is configured
+uint16_t BleController::getReportPeriod() {
+  uint16_t period = configuration.getReportInterval();
+
+  if (period == 0) {
+    uint16_t connectionInterval = connectionStatus->connectionInterval;
+    if (connectionInterval == 0) {
+      return REPORT_SCHEDULER_DEFAULT_INTERVAL_MS;
+    }
+    period = (connectionInterval * 5 + 3) / 4;
+  }
+
+  return period;
+}
+
+// Sends at most one coalesced controller report per period. An urgent request
+// (button or hat edge, or an explicit sendReport) wakes the task early.
+void BleController::taskReportScheduler(void *pvParameter) {
+  BleController *BleControllerInstance = (BleController *)pvParameter;
+  TickType_t lastReport = xTaskGetTickCount();
+
+  for (;;) {
+    TickType_t period = pdMS_TO_TICKS(BleControllerInstance->getReportPeriod());
+    if (period == 0) {
+      period = 1;
+    }
+
+    TickType_t elapsed = xTaskGetTickCount() - lastReport;
+    if (elapsed < period) {
+      ulTaskNotifyTake(pdTRUE, period - elapsed);
+    }
+
+    lastReport = xTaskGetTickCount();
+
+    // Every controller's reports go out back to back, so they share a
+    // connection event
+    for (uint8_t i = 0; i < BleControllerInstance->getControllerCount(); i++) {
+      BleController &controller = BleControllerInstance->controller(i);
+
+      // Never sample a half-applied batch update; commit() wakes us instead
+      if (controller.updateDepth > 0) {
+        controller.scheduledReportDeferred = true;
+        continue;
+      }
+
+      controller.sendControllerReport();
+    }
+  }
+}
+
+// Runs on the input task. A full ring means the pipeline task is behind, so
+// wait for it for a while rather than lose a change.
+void BleController::pushDelta(uint8_t op, void *target, int16_t value,
+                              uint32_t dirtyBit) {
+  state_delta_t delta;
+  delta.target = target;
+  delta.dirtyBit = dirtyBit;
+  delta.value = value;
+  delta.op = op;
+
+  unsigned long start = millis();
+  while (!pipelineRing.push(delta)) {
+    if (millis() - start >= PIPELINE_PUSH_TIMEOUT_MS) {
+      pipelineDroppedCount++;
+      return;
+    }
+    xTaskNotifyGive(pipelineTask);
+    vTaskDelay(1);
+  }
+
+  if (op == STATE_DELTA_REPORT) {
+    xTaskNotifyGive(pipelineTask);
+  }
+}
+
+void BleController::applyDelta(const state_delta_t &delta) {
+  if (delta.op == STATE_DELTA_SET) {
+    int16_t *field = (int16_t *)delta.target;
+    if (*field != delta.value) {
+      *field = delta.value;
+      markDirty(delta.dirtyBit);
+    }
+    return;
+  }
+
+  uint8_t *field = (uint8_t *)delta.target;
+  uint8_t value = *field;
+  if (delta.op == STATE_DELTA_SET_BYTE) {
+    value = delta.value;
+  } else if (delta.op == STATE_DELTA_OR) {
+    value |= delta.value;
+  } else if (delta.op == STATE_DELTA_AND) {
+    value &= delta.value;
+  }
+
+  if (*field != value) {
+    *field = value;
+    markDirty(delta.dirtyBit);
+  }
+}
+
+// Applies the deltas in order and sends the reports asked for along the way.
+// The changes of one setter call (or one beginUpdate()/commit() batch) end with
+// its report request and are applied under a single state write, so neither
+// this task nor the report scheduler ever packs half of them.
+void BleController::taskPipeline(void *pvParameter) {
+  BleController *BleControllerInstance = (BleController *)pvParameter;
+  BleSpscRing<state_delta_t> &ring = BleControllerInstance->pipelineRing;
+  state_delta_t delta;
+  uint8_t pendingReport = 0;
+  bool writing = false;
+
+  for (;;) {
+    if (!ring.pop(delta)) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+
+    if (delta.op != STATE_DELTA_REPORT) {
+      if (!writing) {
+        BleControllerInstance->beginStateWrite();
+        writing = true;
+      }
+      BleControllerInstance->applyDelta(delta);
+      continue;
+    }
+
+    if (writing) {
+      BleControllerInstance->endStateWrite();
+      writing = false;
+    }
+
+    // Auto reports are merged while more changes are waiting; button and hat
+    // edges and explicit sendReport() calls go out where they happened
+    pendingReport |= delta.value;
+    if ((pendingReport & (DEFERRED_REPORT_URGENT | DEFERRED_REPORT_SEND)) ||
+        ring.empty()) {
+      BleControllerInstance->dispatchReport(pendingReport);
+      pendingReport = 0;
+    }
+  }
+}
+
 // ===================== KEYBOARD METHODS =====================
 // Completely rewritten for reliable operation
 // Based on ESP32-NimBLE-Keyboard reference implementation
@@ -2219,38 +2516,53 @@ void BleController::taskServer(void *pvParameter) {
 // Internal helper: send a raw keyboard HID report
 // Report format: 8 bytes (NO report ID - NimBLE adds it internally)
 // [modifiers, reserved, key1, key2, key3, key4, key5, key6]
+// The keys are written into the keyboard report, so it keeps matching what
+// the host was last told.
 void BleController::sendRawKeyboard(uint8_t modifiers, uint8_t key1,
                                     uint8_t key2, uint8_t key3, uint8_t key4,
                                     uint8_t key5, uint8_t key6) {
   if (!this->isConnected())
     return;
 
-  // 8 bytes: modifiers + reserved + 6 keys (NO report ID!)
-  uint8_t report[8];
-  report[0] = modifiers;
-  report[1] = 0x00; // Reserved
-  report[2] = key1;
-  report[3] = key2;
-  report[4] = key3;
-  report[5] = key4;
-  report[6] = key5;
-  report[7] = key6;
+  _keyboardReport.modifiers = modifiers;
+  _keyboardReport.reserved = 0x00;
+  _keyboardReport.keys[0] = key1;
+  _keyboardReport.keys[1] = key2;
+  _keyboardReport.keys[2] = key3;
+  _keyboardReport.keys[3] = key4;
+  _keyboardReport.keys[4] = key5;
+  _keyboardReport.keys[5] = key6;
 
-  this->inputKeyboard->setValue(report, sizeof(report));
-  this->inputKeyboard->notify();
+  sendKeyboardReport();
 }
 
+// Keys are BleKeyboardKeys.h codes or HID usages, see keyToHID(). Modifier
+// codes go into the modifier byte and take none of the 6 key slots. The
+// N-key rollover report has a bit for every usage, so it never drops a key.
 void BleController::keyboardPress(uint8_t key) {
   if (!this->isConnected())
     return;
 
+  uint16_t hidKey = keyToHID(key);
+  uint8_t usage = LAYOUT_USAGE(hidKey);
+  if (keyboardNkroReportId != 0) {
+    _keyboardNkroReport.modifiers |= LAYOUT_MODIFIERS(hidKey);
+    if (usage != 0) {
+      _keyboardNkroReport.keys[usage >> 3] |= (uint8_t)(1 << (usage & 7));
+    }
+    sendKeyboardNkroReport();
+    return;
+  }
+
+  _keyboardReport.modifiers |= LAYOUT_MODIFIERS(hidKey);
+
   // Add key to the report if not already present
-  for (int i = 0; i < 6; i++) {
-    if (_keyboardReport.keys[i] == key) {
+  for (int i = 0; usage != 0 && i < 6; i++) {
+    if (_keyboardReport.keys[i] == usage) {
       return; // Key already pressed
     }
     if (_keyboardReport.keys[i] == 0) {
-      _keyboardReport.keys[i] = key;
+      _keyboardReport.keys[i] = usage;
       break;
     }
   }
@@ -2261,9 +2573,22 @@ void BleController::keyboardRelease(uint8_t key) {
   if (!this->isConnected())
     return;
 
+  uint16_t hidKey = keyToHID(key);
+  uint8_t usage = LAYOUT_USAGE(hidKey);
+  if (keyboardNkroReportId != 0) {
+    _keyboardNkroReport.modifiers &= ~LAYOUT_MODIFIERS(hidKey);
+    if (usage != 0) {
+      _keyboardNkroReport.keys[usage >> 3] &= (uint8_t)~(1 << (usage & 7));
+    }
+    sendKeyboardNkroReport();
+    return;
+  }
+
+  _keyboardReport.modifiers &= ~LAYOUT_MODIFIERS(hidKey);
+
   // Remove key from the report
-  for (int i = 0; i < 6; i++) {
-    if (_keyboardReport.keys[i] == key) {
+  for (int i = 0; usage != 0 && i < 6; i++) {
+    if (_keyboardReport.keys[i] == usage) {
       _keyboardReport.keys[i] = 0;
       // Shift remaining keys down
       for (int j = i; j < 5; j++) {
@@ -2281,76 +2606,269 @@ void BleController::keyboardReleaseAll() {
     return;
 
   // Zero out everything and send
+  if (keyboardNkroReportId != 0) {
+    memset(&_keyboardNkroReport, 0, sizeof(_keyboardNkroReport));
+    sendKeyboardNkroReport();
+    return;
+  }
   memset(&_keyboardReport, 0, sizeof(_keyboardReport));
-  sendRawKeyboard(0, 0, 0, 0, 0, 0, 0);
+  sendKeyboardReport();
 }
 
-// Type a single HID key code (press and release)
-void BleController::keyboardWrite(uint8_t key) {
-  if (!this->isConnected())
-    return;
+// Creates the typing queue and task the first time something is typed, so
+// sketches that never type pay for neither
+bool BleController::startTyping() {
+  if (typingTask != nullptr) {
+    return true;
+  }
+  if (keyboardReportId == 0 || configuration.getTypingQueueDepth() == 0) {
+    return false;
+  }
 
-  // Press
-  sendRawKeyboard(0, key, 0, 0, 0, 0, 0);
-  delay(15);
-  // Release
-  sendRawKeyboard(0, 0, 0, 0, 0, 0, 0);
-  delay(15);
+  typingRing.begin(configuration.getTypingQueueDepth());
+  xTaskCreate(this->taskTyping, "typing", 4096, (void *)this, 1, &typingTask);
+  return typingTask != nullptr;
 }
 
-// Type a single character with proper shift handling
-void BleController::typeChar(char c) {
-  if (!this->isConnected())
-    return;
+// Queues all of the keys or none, so a character is never cut in half. They
+// are counted before the push, so isTyping() never misses a key the typing
+// task has just taken out of the ring.
+bool BleController::queueKeys(const typing_key_t *keys, uint8_t count) {
+  // Only the typing task empties the ring, so the free space cannot shrink
+  if (typingRing.capacity() - typingRing.size() < count) {
+    return false;
+  }
 
-  uint8_t hidKey = asciiToHID(c);
-  if (hidKey == 0)
-    return;
+  typingPending += count;
+  for (uint8_t i = 0; i < count; i++) {
+    typingRing.push(keys[i]);
+  }
+  return true;
+}
 
-  uint8_t modifier = needsShift(c) ? KEY_MOD_LSHIFT : 0;
+// Queues the keys that type a character on the configured layout. Characters
+// the layout has no keys for count as typed.
+bool BleController::queueCharacter(uint32_t codepoint) {
+  uint16_t layoutKeys[LAYOUT_MAX_KEYS];
+  uint8_t count = keyboardLayoutKeys(configuration.getKeyboardLayout(),
+                                     codepoint, layoutKeys);
 
-  // Press key with modifier
-  sendRawKeyboard(modifier, hidKey, 0, 0, 0, 0, 0);
-  delay(15);
-  // Release everything
-  sendRawKeyboard(0, 0, 0, 0, 0, 0, 0);
-  delay(15);
+  typing_key_t keys[LAYOUT_MAX_KEYS];
+  for (uint8_t i = 0; i < count; i++) {
+    keys[i].modifiers = LAYOUT_MODIFIERS(layoutKeys[i]);
+    keys[i].usage = LAYOUT_USAGE(layoutKeys[i]);
+    keys[i].dead = (layoutKeys[i] & LAYOUT_DEAD) != 0;
+  }
+  return queueKeys(keys, count);
 }
 
-void BleController::keyboardWrite(const char *str) {
-  if (!this->isConnected())
-    return;
+// Queue a single key (press and release), translated like keyboardPress()
+size_t BleController::keyboardWrite(uint8_t key) {
+  if (!this->isConnected() || !startTyping())
+    return 0;
+
+  uint16_t hidKey = keyToHID(key);
+  typing_key_t typingKey;
+  typingKey.modifiers = LAYOUT_MODIFIERS(hidKey);
+  typingKey.usage = LAYOUT_USAGE(hidKey);
+  typingKey.dead = false;
+  if (!queueKeys(&typingKey, 1))
+    return 0;
+
+  xTaskNotifyGive(typingTask);
+  return 1;
+}
+
+// Queue a single ASCII character on the configured layout
+bool BleController::typeChar(char c) {
+  if (!this->isConnected() || !startTyping())
+    return false;
+
+  if (!queueCharacter((uint8_t)c < 0x80 ? (uint8_t)c : 0xFFFD))
+    return false;
+
+  xTaskNotifyGive(typingTask);
+  return true;
+}
+
+size_t BleController::keyboardWrite(const char *str) {
+  if (!this->isConnected() || !startTyping())
+    return 0;
+
+  size_t count = 0;
+  while (str[count] != '\0') {
+    uint32_t codepoint;
+    uint8_t length = decodeUtf8(str + count, &codepoint);
+    if (!queueCharacter(codepoint))
+      break;
+    count += length;
+  }
+
+  if (count > 0) {
+    xTaskNotifyGive(typingTask);
+  }
+  return count;
+}
+
+size_t BleController::keyboardPrint(const char *str) {
+  return keyboardWrite(str);
+}
+
+size_t BleController::keyboardPrint(String str) {
+  return keyboardWrite(str.c_str());
+}
 
-  for (int i = 0; str[i] != '\0'; i++) {
-    typeChar(str[i]);
+bool BleController::isTyping() { return typingPending > 0; }
+
+size_t BleController::getTypingQueueCount() { return typingPending; }
+
+size_t BleController::getTypingQueueCapacity() {
+  return typingRing.capacity();
+}
+
+void BleController::setTypingCompleteCallback(void (*callback)()) {
+  typingCompleteCallback = callback;
+}
+
+// Milliseconds between two typing reports: the configured typing delay, or
+// one connection interval (1.25 ms units, rounded up) when it is 0
+uint16_t BleController::getTypingPeriod() {
+  uint16_t period = configuration.getTypingDelay();
+
+  if (period == 0) {
+    uint16_t connectionInterval = connectionStatus->connectionInterval;
+    if (connectionInterval == 0) {
+      return REPORT_SCHEDULER_DEFAULT_INTERVAL_MS;
+    }
+    period = (connectionInterval * 5 + 3) / 4;
   }
+
+  return period;
 }
 
-void BleController::keyboardPrint(const char *str) { keyboardWrite(str); }
+// Releases the keys the typing task holds; they count as typed from here
+void BleController::releaseTypedKeys(uint8_t count) {
+  memset(&_keyboardReport, 0, sizeof(_keyboardReport));
+  sendKeyboardReport();
+  vTaskDelay(pdMS_TO_TICKS(getTypingPeriod()));
+
+  typingPending -= count;
+  if (typingPending == 0 && typingCompleteCallback != nullptr) {
+    typingCompleteCallback();
+  }
+}
+
+// Presses the queued keys in order, one new key per report and one report per
+// typing period. Without rollover each key is released before the next one
+// goes down, two reports per key. With setTypingRollover() keys stay held
+// while the following ones go down, so most keys take a single report: when
+// all 6 slots are full the oldest key goes up in the report that presses the
+// new one. Every report presses exactly one new key, which keeps the order
+// unambiguous for the host. Held keys are all released first when a key
+// repeats, the modifiers change or the last key was a dead key, and when the
+// queue runs empty.
+//
+// The task owns the keyboard report while typing. Keys queued while
+// disconnected (or left when the connection drops) are discarded.
+void BleController::taskTyping(void *pvParameter) {
+  BleController *BleControllerInstance = (BleController *)pvParameter;
+  BleSpscRing<typing_key_t> &ring = BleControllerInstance->typingRing;
+  keyboard_report_t &report = BleControllerInstance->_keyboardReport;
+  typing_key_t key;
+  uint8_t held = 0;
+  bool heldDead = false;
+
+  for (;;) {
+    if (!ring.pop(key)) {
+      if (held > 0) {
+        BleControllerInstance->releaseTypedKeys(held);
+        held = 0;
+      } else {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      }
+      continue;
+    }
+
+    if (!BleControllerInstance->isConnected()) {
+      memset(&report, 0, sizeof(report));
+      BleControllerInstance->typingPending -= held + 1;
+      held = 0;
+      if (BleControllerInstance->typingPending == 0 &&
+          BleControllerInstance->typingCompleteCallback != nullptr) {
+        BleControllerInstance->typingCompleteCallback();
+      }
+      continue;
+    }
+
+    bool rollover = BleControllerInstance->configuration.getTypingRollover();
+    bool repeated = false;
+    for (uint8_t i = 0; i < held; i++) {
+      repeated = repeated || report.keys[i] == key.usage;
+    }
+    if (held > 0 && (!rollover || repeated || heldDead ||
+                     report.modifiers != key.modifiers)) {
+      BleControllerInstance->releaseTypedKeys(held);
+      held = 0;
+    }
+
+    if (held == sizeof(report.keys)) {
+      memmove(report.keys, report.keys + 1, sizeof(report.keys) - 1);
+      held--;
+      BleControllerInstance->typingPending--;
+    }
 
-void BleController::keyboardPrint(String str) { keyboardWrite(str.c_str()); }
+    report.modifiers = key.modifiers;
+    report.keys[held++] = key.usage;
+    heldDead = key.dead;
+    BleControllerInstance->sendKeyboardReport();
+    vTaskDelay(pdMS_TO_TICKS(BleControllerInstance->getTypingPeriod()));
+  }
+}
 
 void BleController::setKeyboardModifiers(uint8_t modifiers) {
+  if (keyboardNkroReportId != 0) {
+    _keyboardNkroReport.modifiers = modifiers;
+    sendKeyboardNkroReport();
+    return;
+  }
   _keyboardReport.modifiers = modifiers;
   sendKeyboardReport();
 }
 
+// Every key and button edge must reach the host, so while the link is
+// congested a keyboard or mouse report waits for room in its queue instead of
+// being dropped
+void BleController::sendEdgeReport(BleReportQueue &queue,
+                                   const uint8_t *report, size_t length) {
+  syncReportQueues();
+  while (this->isConnected() && !queue.hasRoomFor(report, length) &&
+         !queue.flush()) {
+    vTaskDelay(1);
+  }
+  queue.send(report, length);
+}
+
 void BleController::sendKeyboardReport() {
   if (!this->isConnected())
     return;
 
-  sendRawKeyboard(_keyboardReport.modifiers, _keyboardReport.keys[0],
-                  _keyboardReport.keys[1], _keyboardReport.keys[2],
-                  _keyboardReport.keys[3], _keyboardReport.keys[4],
-                  _keyboardReport.keys[5]);
+  sendEdgeReport(keyboardQueue, (const uint8_t *)&_keyboardReport,
+                 sizeof(_keyboardReport));
+}
+
+void BleController::sendKeyboardNkroReport() {
+  if (!this->isConnected())
+    return;
+
+  sendEdgeReport(keyboardNkroQueue, (const uint8_t *)&_keyboardNkroReport,
+                 sizeof(_keyboardNkroReport));
 }
 
 void BleController::rawKeyboardAction(uint8_t msg[], char msgSize) {
   if (!this->isConnected())
     return;
 
-  this->inputKeyboard->setValue(msg, msgSize);
-  this->inputKeyboard->notify();
+  sendEdgeReport(keyboardQueue, msg, msgSize);
 }
 
 // ===================== MOUSE METHODS =====================
@@ -2363,17 +2881,13 @@ void BleController::sendRawMouse(uint8_t buttons, int8_t x, int8_t y,
   if (!this->isConnected())
     return;
 
-  // 5 bytes only - NO Report ID (NimBLE adds it internally)
-  // Format: [buttons, x, y, wheel, hWheel]
-  uint8_t m[5];
-  m[0] = buttons;
-  m[1] = x;
-  m[2] = y;
-  m[3] = wheel;
-  m[4] = 0; // Horizontal wheel (not used)
+  _mouseReport.buttons = buttons;
+  _mouseReport.x = x;
+  _mouseReport.y = y;
+  _mouseReport.wheel = wheel;
+  _mouseReport.hWheel = 0; // Horizontal wheel (not used)
 
-  this->inputMouse->setValue(m, 5);
-  this->inputMouse->notify();
+  sendMouseReport();
 }
 
 void BleController::mouseClick(uint8_t button) {
@@ -2430,185 +2944,60 @@ void BleController::mouseScroll(int8_t scroll) {
   sendRawMouse(_mouseReport.buttons, 0, 0, scroll);
 }
 
+// 5 bytes only - NO Report ID (NimBLE adds it internally)
+// Format: [buttons, x, y, wheel, hWheel]
 void BleController::sendMouseReport() {
   if (!this->isConnected())
     return;
 
-  sendRawMouse(_mouseReport.buttons, _mouseReport.x, _mouseReport.y,
-               _mouseReport.wheel);
+  sendEdgeReport(mouseQueue, (const uint8_t *)&_mouseReport,
+                 sizeof(_mouseReport));
+
+  // Movement is relative, so it must not be sent twice
+  _mouseReport.x = 0;
+  _mouseReport.y = 0;
+  _mouseReport.wheel = 0;
+  _mouseReport.hWheel = 0;
 }
 
 void BleController::rawMouseAction(uint8_t msg[], char msgSize) {
   if (!this->isConnected())
     return;
 
-  this->inputMouse->setValue(msg, msgSize);
-  this->inputMouse->notify();
+  sendEdgeReport(mouseQueue, msg, msgSize);
 
 #if BLE_CONTROLLER_DEBUG == 1
   dumpHIDReport(msg, msgSize);
 #endif
 }
 
-// ASCII to HID scan code conversion for printable characters
-// For shifted characters (!@#$ etc), returns the base key HID code
-// The needsShift() function determines if SHIFT modifier is needed
+// ASCII to HID scan code conversion on the US layout. For shifted characters
+// (!@#$ etc) it returns the base key HID code; needsShift() tells whether
+// SHIFT is needed.
 uint8_t asciiToHID(char ascii) {
-  // Lowercase letters a-z
-  if (ascii >= 'a' && ascii <= 'z') {
-    return ascii - 'a' + 0x04; // a-z -> 0x04-0x1D
-  }
-  // Uppercase letters A-Z (same HID code as lowercase, shift handled by
-  // modifier)
-  if (ascii >= 'A' && ascii <= 'Z') {
-    return ascii - 'A' + 0x04;
-  }
-  // Numbers 1-9
-  if (ascii >= '1' && ascii <= '9') {
-    return ascii - '1' + 0x1E; // 1-9 -> 0x1E-0x26
-  }
-
-  switch (ascii) {
-  // Number row - base keys
-  case '0':
-    return 0x27;
-  case '1':
-    return 0x1E;
-  case '2':
-    return 0x1F;
-  case '3':
-    return 0x20;
-  case '4':
-    return 0x21;
-  case '5':
-    return 0x22;
-  case '6':
-    return 0x23;
-  case '7':
-    return 0x24;
-  case '8':
-    return 0x25;
-  case '9':
-    return 0x26;
-
-  // Shifted number row symbols - return base key HID code
-  case '!':
-    return 0x1E; // Shift+1
-  case '@':
-    return 0x1F; // Shift+2
-  case '#':
-    return 0x20; // Shift+3
-  case '$':
-    return 0x21; // Shift+4
-  case '%':
-    return 0x22; // Shift+5
-  case '^':
-    return 0x23; // Shift+6
-  case '&':
-    return 0x24; // Shift+7
-  case '*':
-    return 0x25; // Shift+8
-  case '(':
-    return 0x26; // Shift+9
-  case ')':
-    return 0x27; // Shift+0
-
-  // Punctuation keys - base
-  case '-':
-    return 0x2D; // Minus
-  case '=':
-    return 0x2E; // Equal
-  case '[':
-    return 0x2F; // Left bracket
-  case ']':
-    return 0x30; // Right bracket
-  case '\\':
-    return 0x31; // Backslash
-  case ';':
-    return 0x33; // Semicolon
-  case '\'':
-    return 0x34; // Apostrophe
-  case '`':
-    return 0x35; // Grave accent
-  case ',':
-    return 0x36; // Comma
-  case '.':
-    return 0x37; // Period
-  case '/':
-    return 0x38; // Slash
-
-  // Shifted punctuation - return base key HID code
-  case '_':
-    return 0x2D; // Shift+Minus
-  case '+':
-    return 0x2E; // Shift+Equal
-  case '{':
-    return 0x2F; // Shift+[
-  case '}':
-    return 0x30; // Shift+]
-  case '|':
-    return 0x31; // Shift+Backslash
-  case ':':
-    return 0x33; // Shift+Semicolon
-  case '"':
-    return 0x34; // Shift+Apostrophe
-  case '~':
-    return 0x35; // Shift+Grave
-  case '<':
-    return 0x36; // Shift+Comma
-  case '>':
-    return 0x37; // Shift+Period
-  case '?':
-    return 0x38; // Shift+Slash
-
-  // Special keys - use raw USB HID codes
-  case ' ':
-    return 0x2C; // Space
-  case '\n':
-    return 0x28; // Enter (USB HID code)
-  case '\r':
-    return 0x28; // Enter
-  case '\t':
-    return 0x2B; // Tab (USB HID code)
-  case '\b':
-    return 0x2A; // Backspace (USB HID code)
-
-  default:
-    return 0x00; // No key / unknown
-  }
-}
-
-// Check if character needs shift modifier
-bool needsShift(char ascii) {
-  // Uppercase letters
-  if (ascii >= 'A' && ascii <= 'Z')
-    return true;
+  if ((uint8_t)ascii >= 0x80) {
+    return 0;
+  }
+  return LAYOUT_USAGE(keyboardLayoutUS.ascii[(uint8_t)ascii]);
+}
 
-  // Shifted symbols
-  switch (ascii) {
-  case '!':
-  case '@':
-  case '#':
-  case '$':
-  case '%':
-  case '^':
-  case '&':
-  case '*':
-  case '(':
-  case ')':
-  case '_':
-  case '+':
-  case '{':
-  case '}':
-  case '|':
-  case ':':
-  case '"':
-  case '~':
-  case '<':
-  case '>':
-  case '?':
-    return true;
-  default:
+bool needsShift(char ascii) {
+  if ((uint8_t)ascii >= 0x80) {
     return false;
   }
-}
\ No newline at end of file
+  return (LAYOUT_MODIFIERS(keyboardLayoutUS.ascii[(uint8_t)ascii]) &
+          KEY_MOD_LSHIFT) != 0;
+}
+
+// BleKeyboardKeys.h codes follow the Arduino Keyboard library: the 8
+// modifiers from 0x80 in the order of the modifier byte's bits, then HID
+// usage + 0x88. Both are a fixed offset, so no table is needed.
+uint16_t keyToHID(uint8_t key) {
+  if (key < KEY_LEFT_CTRL) {
+    return LAYOUT_KEY(key, 0);
+  }
+  if (key <= KEY_RIGHT_GUI) {
+    return LAYOUT_KEY(0, 1 << (key - KEY_LEFT_CTRL));
+  }
+  return LAYOUT_KEY(key - 0x88, 0);
+}
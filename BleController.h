@@ -7,20 +7,36 @@
 
 #include "BleConnectionStatus.h"
 #include "BleControllerConfiguration.h"
+#include "BleFeatureReport.h"
+#include "BleHidDescriptorBuilder.h"
 #include "BleNUS.h"
 #include "BleOutputReceiver.h"
+#include "BleReportIdAllocator.h"
+#include "BleReportQueue.h"
+#include "BleSpscRing.h"
+#include "BleStaticLayout.h"
 #include "NimBLECharacteristic.h"
 #include "NimBLEHIDDevice.h"
+#include <atomic>
 
 // Debug enabled, disabled by default
 #ifndef BLE_CONTROLLER_DEBUG
 #define BLE_CONTROLLER_DEBUG 0
 #endif
 
-// Report IDs for multi-functional HID device
+// Latency and report interval statistics, enabled by default
+#ifndef BLE_CONTROLLER_STATS
+#define BLE_CONTROLLER_STATS 1
+#endif
+
+// Report IDs for multi-functional HID device. The keyboard, mouse and N-key
+// rollover keyboard get the next free ID if a controller report already uses
+// theirs, see getKeyboardReportId(), getMouseReportId() and
+// getKeyboardNkroReportId().
 #define CONTROLLER_REPORT_ID 0x01
 #define KEYBOARD_REPORT_ID 0x02
 #define MOUSE_REPORT_ID 0x03
+#define KEYBOARD_NKRO_REPORT_ID 0x04
 
 // Keyboard modifier keys
 #define KEY_MOD_LCTRL 0x01
@@ -39,14 +55,159 @@
 #define MOUSE_BACK 0x08
 #define MOUSE_FORWARD 0x10
 
-// Keyboard report structure (8 bytes)
+// Keyboard report structure (8 bytes). The library's copy is notified as is,
+// so the layout must match the report descriptor byte for byte.
 typedef struct {
   uint8_t modifiers; // Modifier keys (Ctrl, Shift, Alt, etc.)
   uint8_t reserved;  // Reserved byte
   uint8_t keys[6];   // Up to 6 simultaneous key presses
 } keyboard_report_t;
 
-// Mouse report structure (5 bytes - matching ESP32-NimBLE-Mouse)
+// N-key rollover keyboard report (17 bytes): the modifier byte, then one bit
+// per usage 0x00-0x7F, so usage u is bit u % 8 of keys[u / 8]
+typedef struct {
+  uint8_t modifiers;
+  uint8_t keys[16];
+} keyboard_nkro_report_t;
+
+// A key queued for the typing engine: pressed together with its modifiers,
+// then released
+typedef struct {
+  uint8_t modifiers;
+  uint8_t usage;
+  bool dead; // Dead key, released before the next key goes down
+} typing_key_t;
+
+// Dirty bits, one per controller state member
+#define DIRTY_BUTTONS (1UL << 0)
+#define DIRTY_SPECIAL_BUTTONS (1UL << 1)
+#define DIRTY_X (1UL << 2)
+#define DIRTY_Y (1UL << 3)
+#define DIRTY_Z (1UL << 4)
+#define DIRTY_RX (1UL << 5)
+#define DIRTY_RY (1UL << 6)
+#define DIRTY_RZ (1UL << 7)
+#define DIRTY_SLIDER1 (1UL << 8)
+#define DIRTY_SLIDER2 (1UL << 9)
+#define DIRTY_RUDDER (1UL << 10)
+#define DIRTY_THROTTLE (1UL << 11)
+#define DIRTY_ACCELERATOR (1UL << 12)
+#define DIRTY_BRAKE (1UL << 13)
+#define DIRTY_STEERING (1UL << 14)
+#define DIRTY_HAT1 (1UL << 15)
+#define DIRTY_HAT2 (1UL << 16)
+#define DIRTY_HAT3 (1UL << 17)
+#define DIRTY_HAT4 (1UL << 18)
+#define DIRTY_GX (1UL << 19)
+#define DIRTY_GY (1UL << 20)
+#define DIRTY_GZ (1UL << 21)
+#define DIRTY_AX (1UL << 22)
+#define DIRTY_AY (1UL << 23)
+#define DIRTY_AZ (1UL << 24)
+
+// One run of bytes in the controller input report, copied straight from the
+// controller state. ESP32 is little-endian, so int16_t members are already in
+// HID wire order and the low byte of a hat is its report value.
+//
+// Fields narrower than their state member (see setAxesBits() and
+// setHatBits()) have a width of 0 and are bit-packed instead: the int16_t at
+// source is shifted right by shift and written as bits bits at bitOffset.
+typedef struct {
+  const uint8_t *source; // First state byte to copy
+  uint8_t report;        // Index into controllerReports
+  uint16_t bitOffset;    // Bit offset within the report, a multiple of 8
+                         // for copied fields
+  uint8_t width;         // Number of bytes to copy, 0 for a packed field
+  uint8_t bits;          // Packed field size
+  uint8_t shift;         // Packed field scaling from the 16 bit state value
+  uint32_t dirtyMask;    // DIRTY_* bits of the state members in this run
+} report_field_t;
+
+// Buttons + special buttons + axes + simulation controls + motion + hats
+#define MAX_REPORT_FIELDS                                                      \
+  (2 + POSSIBLEAXES + POSSIBLESIMULATIONCONTROLS + 6 + 4)
+
+// The controller report plus one per field group with its own report ID
+#define MAX_CONTROLLER_REPORTS (1 + FIELD_GROUPS)
+
+// One controller input report ID. Each is only sent when one of its fields
+// changed, so a button edge does not resend unchanged motion data.
+typedef struct {
+  uint8_t reportId;
+  uint16_t size;          // Bytes, without the report ID
+  uint32_t dirtyMask;     // DIRTY_* bits of the fields in this report
+  uint8_t *pending;       // Next report is packed here...
+  uint8_t *lastSent;      // ...and swapped with this one after the notify
+  bool lastSentValid;
+  BleReportQueue queue;
+} controller_report_t;
+
+// Feature reports an application can register with addFeatureReport()
+#define MAX_FEATURE_REPORTS 4
+// Largest GATT attribute value, a feature report is read and written whole
+#define MAX_FEATURE_REPORT_SIZE 512
+
+typedef struct {
+  uint8_t reportId;
+  uint16_t size; // Bytes, without the report ID
+  bool readOnly;
+  BleFeatureReportCallbacks *callbacks;
+} feature_report_t;
+
+// Report period used by the scheduler while no connection interval is known
+#define REPORT_SCHEDULER_DEFAULT_INTERVAL_MS 10
+
+// Reports held back by an open beginUpdate()
+#define DEFERRED_REPORT_AUTO 0x01   // A setter asked for an auto report
+#define DEFERRED_REPORT_URGENT 0x02 // ... and it was a button or hat edge
+#define DEFERRED_REPORT_SEND 0x04   // sendReport() was called explicitly
+
+// State changes passed from the input task to the pipeline task
+#define STATE_DELTA_SET 0      // Store value in an int16_t member
+#define STATE_DELTA_SET_BYTE 1 // Store value in a uint8_t member
+#define STATE_DELTA_OR 2       // Set the value bits in a uint8_t member
+#define STATE_DELTA_AND 3      // Keep only the value bits of a uint8_t member
+#define STATE_DELTA_REPORT 4   // Report request, value holds DEFERRED_REPORT_*
+
+// How long the input task waits for ring space before a state change is
+// given up, see getPipelineDroppedCount()
+#define PIPELINE_PUSH_TIMEOUT_MS 100
+
+typedef struct {
+  void *target;      // Controller state member, unused for reports
+  uint32_t dirtyBit; // DIRTY_* bit of the member
+  int16_t value;
+  uint8_t op; // STATE_DELTA_*
+} state_delta_t;
+
+// Inter-report interval histogram: bucket 0 counts intervals below 2 ms,
+// bucket i those in [2^i, 2^(i+1)) ms and the last one everything longer
+#define STATS_INTERVAL_BUCKETS 8
+
+// Snapshot returned by getStats(). Latencies are in microseconds, from the
+// first state change to the notify of the controller report carrying it.
+typedef struct {
+  uint32_t controllerReports; // Reports notified, all controller report IDs
+  // Reports notified per controller report ID, in the order of the report map
+  uint8_t controllerReportCount;
+  uint8_t controllerReportIds[MAX_CONTROLLER_REPORTS];
+  uint32_t controllerReportsSent[MAX_CONTROLLER_REPORTS];
+  uint32_t keyboardReports;
+  uint32_t mouseReports;
+  uint32_t notifyFailures; // notify() calls that failed and were queued
+  // Reports given up by a full queue, or longer than the MTU allows after
+  // waiting REPORT_QUEUE_MTU_WAIT_MS for it to be raised
+  uint32_t droppedReports;
+  uint32_t suppressedReports;
+  uint32_t bytesSent; // Report payload, without ATT/L2CAP headers
+  uint32_t latencyMin;
+  uint32_t latencyAvg;
+  uint32_t latencyMax;
+  uint32_t intervalHistogram[STATS_INTERVAL_BUCKETS];
+} ble_controller_stats_t;
+
+// Mouse report structure (5 bytes - matching ESP32-NimBLE-Mouse). Notified as
+// is, like the keyboard report.
 typedef struct {
   uint8_t buttons; // Mouse button states (5 buttons)
   int8_t x;        // X axis movement
@@ -59,11 +220,10 @@ class BleController {
 private:
   std::string deviceManufacturer;
   std::string deviceName;
-  uint8_t tempHidReportDescriptor[300]; // Increased size for multi-device
-                                        // descriptor
-  int hidReportDescriptorSize;
-  uint8_t hidReportSize;
-  uint8_t numOfButtonBytes;
+  uint8_t *hidReportDescriptor; // Sized to fit in begin()
+  const uint8_t *hidReportMap;  // hidReportDescriptor or a static layout's
+  uint16_t hidReportDescriptorSize;
+  uint16_t numOfButtonBytes;
   bool enableOutputReport;
   uint16_t outputReportLength;
   uint8_t _buttons[16]; // 8 bits x 16 bytes = 128 bits --> 128 button max
@@ -99,6 +259,7 @@ private:
 
   // Keyboard and mouse support
   keyboard_report_t _keyboardReport;
+  keyboard_nkro_report_t _keyboardNkroReport;
   mouse_report_t _mouseReport;
 
   BleConnectionStatus *connectionStatus;
@@ -109,13 +270,155 @@ private:
   NimBLEHIDDevice *hid;
   NimBLECharacteristic *inputController;
   NimBLECharacteristic *inputKeyboard;
+  NimBLECharacteristic *inputKeyboardNkro;
   NimBLECharacteristic *inputMouse;
   NimBLECharacteristic *outputController;
   NimBLECharacteristic *pCharacteristic_Power_State;
 
+  // Controller input reports, the first one is always configuration's
+  // hidReportId. Laid out from the configuration in begin().
+  controller_report_t controllerReports[MAX_CONTROLLER_REPORTS];
+  uint8_t controllerReportCount;
+  uint8_t currentControllerReport; // Only while building the descriptor
+
+  // Further controllers in the same device, see controller(). They share
+  // this controller's connection and have no server or tasks of their own.
+  BleController *extraControllers[POSSIBLECONTROLLERS - 1];
+  uint8_t extraControllerCount;
+  BleController *owner; // Set on extra controllers
+
+  // Vendor defined feature reports in the first controller's collection
+  feature_report_t featureReports[MAX_FEATURE_REPORTS];
+  uint8_t featureReportCount;
+
+  // Allocated in begin(), 0 when the collection is not included
+  uint8_t keyboardReportId;
+  uint8_t mouseReportId;
+  uint8_t keyboardNkroReportId;
+
+  // Send queues for the keyboard and mouse input reports; these and the
+  // controller report queues are emptied when a new connection starts
+  BleReportQueue keyboardQueue;
+  BleReportQueue mouseQueue;
+  BleReportQueue keyboardNkroQueue;
+  uint16_t reportQueueConnection;
+  uint16_t reportQueueMtu; // MTU the queues' payload limit was set for
+  uint16_t controllerQueueConnection; // The same for the controller queues
+  uint16_t controllerQueueMtu;
+
   uint8_t *outputBackupBuffer;
 
+  // Controller report layout, compiled from the configuration in begin()
+  report_field_t reportLayout[MAX_REPORT_FIELDS];
+  uint8_t reportFieldCount;
+  uint32_t reportDirtyMask;
+
+  // Packs the controller report instead of reportLayout when set by
+  // beginStatic()
+  void (*reportPacker)(BleController *controller, uint8_t *report);
+
+  // Pending and last sent buffers of every controller report, allocated once
+  // in begin()
+  uint8_t *reportBuffer;
+
+  // Duplicate report suppression
+  std::atomic<uint32_t> dirtyFields;
+  uint16_t lastSentConnection;
+  uint32_t suppressedReportCount;
+
+  // Seqlock guarding the controller state against torn reports
+  std::atomic<uint32_t> stateWriters;
+  std::atomic<uint32_t> stateVersion;
+
+  // Report requests since the sending task started, see
+  // runControllerSender()
+  std::atomic<uint32_t> senderRequests;
+
+#if BLE_CONTROLLER_STATS == 1
+  // Controller report timing, see getStats()
+  uint32_t changedAt;    // micros() of the oldest unsent state change
+  uint32_t lastReportAt; // micros() of the previous controller report
+  bool lastReportAtValid;
+  uint32_t latencySamples;
+  uint64_t latencyTotal;
+  uint32_t latencyMin;
+  uint32_t latencyMax;
+  uint32_t intervalHistogram[STATS_INTERVAL_BUCKETS];
+  void recordControllerReport(bool firstReport);
+#endif
+
+  // Fixed-rate report scheduler, only created when enabled in the
+  // configuration
+  TaskHandle_t reportSchedulerTask;
+
+  // Batch updates: reports requested between beginUpdate() and commit() are
+  // held back and sent once when the outermost commit() runs
+  std::atomic<uint8_t> updateDepth;
+  std::atomic<uint8_t> deferredReport; // DEFERRED_REPORT_* bits
+  std::atomic<bool> scheduledReportDeferred;
+
+  // Optional input pipeline: setters only push state deltas, which the
+  // pipeline task (pinned to the NimBLE core) applies before sending reports
+  TaskHandle_t pipelineTask;
+  BleSpscRing<state_delta_t> pipelineRing;
+  uint32_t pipelineDroppedCount;
+
+  // Typing engine: keyboardWrite() and keyboardPrint() queue keys, which the
+  // typing task (created on first use) presses and releases at the configured
+  // pace. typingPending counts queued keys plus the ones still held down.
+  TaskHandle_t typingTask;
+  BleSpscRing<typing_key_t> typingRing;
+  std::atomic<uint32_t> typingPending;
+  void (*typingCompleteCallback)();
+
   static void taskServer(void *pvParameter);
+  static void taskReportScheduler(void *pvParameter);
+  static void taskPipeline(void *pvParameter);
+  static void taskTyping(void *pvParameter);
+  bool startTyping();
+  bool queueKeys(const typing_key_t *keys, uint8_t count);
+  bool queueCharacter(uint32_t codepoint);
+  uint16_t getTypingPeriod();
+  void releaseTypedKeys(uint8_t count);
+  void sendEdgeReport(BleReportQueue &queue, const uint8_t *report,
+                      size_t length);
+  void sendKeyboardNkroReport();
+  void pushDelta(uint8_t op, void *target, int16_t value, uint32_t dirtyBit);
+  void applyDelta(const state_delta_t &delta);
+  void dispatchReport(uint8_t request);
+  uint16_t getReportPeriod();
+  void requestReport(bool urgent);
+  void sendControllerReport();
+  void runControllerSender(bool send);
+  void sendChangedControllerReports();
+  void syncReportQueues();
+  void syncControllerQueues();
+  void flushControllerQueues(uint8_t skip);
+  void markDirty(uint32_t dirtyBits);
+  void beginStateWrite();
+  void endStateWrite();
+  uint32_t beginStateRead();
+  bool endStateRead(uint32_t version);
+  void updateValue(int16_t &field, int16_t value, uint32_t dirtyBit);
+  void updateHat(int16_t &hat, signed char value, uint32_t dirtyBit);
+  void setStateBits(uint8_t &field, uint8_t bitmask, uint32_t dirtyBit);
+  void clearStateBits(uint8_t &field, uint8_t bitmask, uint32_t dirtyBit);
+  void addReportField(const void *source, uint8_t width, uint32_t dirtyBit);
+  void addValueField(const int16_t *source, uint16_t bitOffset, uint8_t bits,
+                     uint8_t shift, uint32_t dirtyBit);
+  static void packBits(uint8_t *report, uint16_t bitOffset, uint8_t bits,
+                       uint16_t value);
+  void selectControllerReport(BleHidDescriptorBuilder &hid, uint8_t reportId);
+  void buildControllerDescriptor(BleHidDescriptorBuilder &hid);
+  void buildHidDescriptor(BleHidDescriptorBuilder &hid);
+  void allocateReportIds();
+  void beginControllerReports();
+  void checkReportSizes();
+  void beginServer();
+  template <typename Layout>
+  static void packStaticReport(BleController *controller, uint8_t *report);
+  static uint8_t *packInt16(uint8_t *report, int16_t value);
+  void packReport(uint8_t index, uint8_t *report);
   uint8_t specialButtonBitPosition(uint8_t specialButton);
 
 public:
@@ -129,7 +432,28 @@ public:
                 uint8_t batteryLevel = 100, bool delayAdvertising = false);
   void
   begin(BleControllerConfiguration *config = new BleControllerConfiguration());
+  // Starts with a BleControllerLayout fixed at compile time. Layout fields in
+  // config are replaced by the layout's; everything else is used as is.
+  template <typename Layout>
+  void beginStatic(BleControllerConfiguration *config = nullptr);
   void end(void);
+  // Controller index of setControllerCount(), 0 is this one. Only the
+  // controller state functions apply to the others.
+  BleController &controller(uint8_t index);
+  uint8_t getControllerCount();
+  uint8_t getKeyboardReportId();
+  uint8_t getMouseReportId();
+  uint8_t getKeyboardNkroReportId(); // 0 unless setKeyboardNkro(true)
+  // Adds a vendor defined feature report the host can read (GET_REPORT) and,
+  // unless readOnly, write (SET_REPORT). Call before begin(); reports are not
+  // part of a beginStatic() layout. The report ID may be one of the
+  // controller's own, otherwise keyboard, mouse and extra controllers move
+  // out of its way. Returns false if the registry is full, the ID is 0 or
+  // already has a feature report, or size is 0 or above
+  // MAX_FEATURE_REPORT_SIZE.
+  bool addFeatureReport(uint8_t reportId, uint16_t size,
+                        BleFeatureReportCallbacks *callbacks,
+                        bool readOnly = false);
   void setAxes(int16_t x = 0, int16_t y = 0, int16_t z = 0, int16_t rX = 0,
                int16_t rY = 0, int16_t rZ = 0, int16_t slider1 = 0,
                int16_t slider2 = 0);
@@ -187,7 +511,21 @@ public:
   void setSimulationControls(int16_t rudder = 0, int16_t throttle = 0,
                              int16_t accelerator = 0, int16_t brake = 0,
                              int16_t steering = 0);
+  void setAllAxes(const int16_t axes[POSSIBLEAXES]);
+  void setAllSimulationControls(
+      const int16_t simulationControls[POSSIBLESIMULATIONCONTROLS]);
+  void setAllHats(const signed char hats[4]);
+  void setButtons(const uint8_t buttons[16]);
+  void beginUpdate();
+  void commit();
   void sendReport();
+  uint32_t getSuppressedReportCount();
+  uint32_t getPipelineDroppedCount();
+  BleReportQueue *getReportQueue(uint8_t reportId);
+  void flushReports();
+  ble_controller_stats_t getStats();
+  void resetStats();
+  void sendStatsOverNUS();
   bool isPressed(uint8_t b = BUTTON_1); // check BUTTON_1 by default
   bool isConnected(void);
   void resetButtons();
@@ -223,17 +561,31 @@ public:
                                                    size_t length));
   BleNUS *getNUS();
 
-  // Keyboard methods
+  // Keyboard methods. With setKeyboardNkro(true), keyboardPress(),
+  // keyboardRelease(), keyboardReleaseAll() and setKeyboardModifiers() use the
+  // N-key rollover report, so any number of keys can be held; typing and
+  // sendRawKeyboard() keep using the 6 key report.
   void keyboardPress(uint8_t key);
   void keyboardRelease(uint8_t key);
   void keyboardReleaseAll();
-  void keyboardWrite(uint8_t key);
-  void keyboardWrite(const char *str);
-  void keyboardPrint(const char *str);
-  void keyboardPrint(String str);
+  // keyboardWrite(), keyboardPrint() and typeChar() queue their keys and
+  // return at once; the typing task types them in order. Text is UTF-8 and
+  // typed for the configured keyboard layout (setKeyboardLayout). They return
+  // how many keys or bytes of text were queued, which is fewer than asked for
+  // when the queue (setTypingQueueDepth) is full; a character is never split.
+  // Other keyboard functions should not be used while isTyping().
+  size_t keyboardWrite(uint8_t key);
+  size_t keyboardWrite(const char *str);
+  size_t keyboardPrint(const char *str);
+  size_t keyboardPrint(String str);
+  bool typeChar(char c); // Queue a single ASCII character
+  bool isTyping();
+  size_t getTypingQueueCount(); // Keys not completely typed yet
+  size_t getTypingQueueCapacity();
+  // Called on the typing task each time the last queued key is released
+  void setTypingCompleteCallback(void (*callback)());
   void setKeyboardModifiers(uint8_t modifiers);
   void sendKeyboardReport();
-  void typeChar(char c); // Type a single character with proper shift
   void sendRawKeyboard(uint8_t modifiers, uint8_t key1, uint8_t key2 = 0,
                        uint8_t key3 = 0, uint8_t key4 = 0, uint8_t key5 = 0,
                        uint8_t key6 = 0);
@@ -252,9 +604,177 @@ protected:
   virtual void onStarted(NimBLEServer *pServer) {};
 };
 
+// Holds a batch update open for its lifetime:
+//
+//   {
+//     BleControllerUpdate update(bleController);
+//     bleController.press(BUTTON_1);
+//     bleController.setLeftThumb(x, y);
+//   } // one report with both changes is sent here
+class BleControllerUpdate {
+public:
+  explicit BleControllerUpdate(BleController &controller)
+      : controller(controller) {
+    controller.beginUpdate();
+  }
+  ~BleControllerUpdate() { controller.commit(); }
+
+private:
+  BleControllerUpdate(const BleControllerUpdate &);
+  BleControllerUpdate &operator=(const BleControllerUpdate &);
+
+  BleController &controller;
+};
+
+template <typename Layout>
+void BleController::beginStatic(BleControllerConfiguration *config) {
+  if (config != nullptr) {
+    configuration = *config;
+  }
+
+  // Keep the configuration getters in line with the layout
+  configuration.setControllerType(Layout::controllerType);
+  configuration.setHidReportId(Layout::reportId);
+  configuration.setButtonCount(Layout::buttonCount);
+  configuration.setHatSwitchCount(Layout::hatCount);
+  configuration.setWhichAxes(
+      Layout::axes & LAYOUT_AXIS_X, Layout::axes & LAYOUT_AXIS_Y,
+      Layout::axes & LAYOUT_AXIS_Z, Layout::axes & LAYOUT_AXIS_RX,
+      Layout::axes & LAYOUT_AXIS_RY, Layout::axes & LAYOUT_AXIS_RZ,
+      Layout::axes & LAYOUT_AXIS_SLIDER1, Layout::axes & LAYOUT_AXIS_SLIDER2);
+  configuration.setWhichSpecialButtons(false, false, false, false, false,
+                                       false, false, false);
+  configuration.setWhichSimulationControls(false, false, false, false, false);
+  for (uint8_t group = 0; group < FIELD_GROUPS; group++) {
+    configuration.setFieldGroupReportId(group, 0);
+  }
+  configuration.setControllerCount(1);
+  configuration.setIncludeKeyboard(false);
+  configuration.setIncludeMouse(false);
+  extraControllerCount = 0;
+  keyboardReportId = 0;
+  mouseReportId = 0;
+  keyboardNkroReportId = 0;
+  configuration.setIncludeGyroscope(Layout::motion & LAYOUT_MOTION_GYROSCOPE);
+  configuration.setIncludeAccelerometer(Layout::motion &
+                                        LAYOUT_MOTION_ACCELEROMETER);
+  configuration.setAxesMin(Layout::axesMin);
+  configuration.setAxesMax(Layout::axesMax);
+  configuration.setMotionMin(Layout::motionMin);
+  configuration.setMotionMax(Layout::motionMax);
+  configuration.setAxesBits(16);
+  configuration.setSimulationBits(16);
+  configuration.setMotionBits(16);
+  configuration.setHatBits(8);
+  configuration.setEnableOutputReport(false);
+  featureReportCount = 0;
+
+  hidReportMap = Layout::Descriptor::data;
+  hidReportDescriptorSize = Layout::Descriptor::size;
+  numOfButtonBytes = Layout::buttonBytes;
+  reportFieldCount = 0;
+  reportPacker = &packStaticReport<Layout>;
+
+  reportDirtyMask =
+      (Layout::buttonCount > 0 ? DIRTY_BUTTONS : 0) |
+      (Layout::axes & LAYOUT_AXIS_X ? DIRTY_X : 0) |
+      (Layout::axes & LAYOUT_AXIS_Y ? DIRTY_Y : 0) |
+      (Layout::axes & LAYOUT_AXIS_Z ? DIRTY_Z : 0) |
+      (Layout::axes & LAYOUT_AXIS_RX ? DIRTY_RX : 0) |
+      (Layout::axes & LAYOUT_AXIS_RY ? DIRTY_RY : 0) |
+      (Layout::axes & LAYOUT_AXIS_RZ ? DIRTY_RZ : 0) |
+      (Layout::axes & LAYOUT_AXIS_SLIDER1 ? DIRTY_SLIDER1 : 0) |
+      (Layout::axes & LAYOUT_AXIS_SLIDER2 ? DIRTY_SLIDER2 : 0) |
+      (Layout::motion & LAYOUT_MOTION_GYROSCOPE
+           ? DIRTY_GX | DIRTY_GY | DIRTY_GZ
+           : 0) |
+      (Layout::motion & LAYOUT_MOTION_ACCELEROMETER
+           ? DIRTY_AX | DIRTY_AY | DIRTY_AZ
+           : 0) |
+      (Layout::hatCount > 0 ? DIRTY_HAT1 : 0) |
+      (Layout::hatCount > 1 ? DIRTY_HAT2 : 0) |
+      (Layout::hatCount > 2 ? DIRTY_HAT3 : 0) |
+      (Layout::hatCount > 3 ? DIRTY_HAT4 : 0);
+
+  controllerReportCount = 1;
+  controllerReports[0].reportId = Layout::reportId;
+  controllerReports[0].size = Layout::reportSize;
+  controllerReports[0].dirtyMask = reportDirtyMask;
+
+  beginServer();
+}
+
+// Every condition is a compile-time constant, so this reduces to the copies
+// the layout needs at fixed offsets
+template <typename Layout>
+void BleController::packStaticReport(BleController *controller,
+                                     uint8_t *report) {
+  if (Layout::buttonBytes > 0) {
+    memcpy(report, controller->_buttons, Layout::buttonBytes);
+    report += Layout::buttonBytes;
+  }
+
+  if (Layout::axes & LAYOUT_AXIS_X) {
+    report = packInt16(report, controller->_x);
+  }
+  if (Layout::axes & LAYOUT_AXIS_Y) {
+    report = packInt16(report, controller->_y);
+  }
+  if (Layout::axes & LAYOUT_AXIS_Z) {
+    report = packInt16(report, controller->_z);
+  }
+  if (Layout::axes & LAYOUT_AXIS_RZ) {
+    report = packInt16(report, controller->_rZ);
+  }
+  if (Layout::axes & LAYOUT_AXIS_RX) {
+    report = packInt16(report, controller->_rX);
+  }
+  if (Layout::axes & LAYOUT_AXIS_RY) {
+    report = packInt16(report, controller->_rY);
+  }
+  if (Layout::axes & LAYOUT_AXIS_SLIDER1) {
+    report = packInt16(report, controller->_slider1);
+  }
+  if (Layout::axes & LAYOUT_AXIS_SLIDER2) {
+    report = packInt16(report, controller->_slider2);
+  }
+
+  if (Layout::motion & LAYOUT_MOTION_GYROSCOPE) {
+    report = packInt16(report, controller->_gX);
+    report = packInt16(report, controller->_gY);
+    report = packInt16(report, controller->_gZ);
+  }
+  if (Layout::motion & LAYOUT_MOTION_ACCELEROMETER) {
+    report = packInt16(report, controller->_aX);
+    report = packInt16(report, controller->_aY);
+    report = packInt16(report, controller->_aZ);
+  }
+
+  // Hats are reported last to first
+  if (Layout::hatCount > 3) {
+    *report++ = (uint8_t)controller->_hat4;
+  }
+  if (Layout::hatCount > 2) {
+    *report++ = (uint8_t)controller->_hat3;
+  }
+  if (Layout::hatCount > 1) {
+    *report++ = (uint8_t)controller->_hat2;
+  }
+  if (Layout::hatCount > 0) {
+    *report++ = (uint8_t)controller->_hat1;
+  }
+}
+
+// US layout usage and shift state of an ASCII character, see
+// keyboardLayoutKeys() for other layouts
 uint8_t asciiToHID(char ascii);
 bool needsShift(char ascii);
 
+// Usage and modifier bits of a key as a LAYOUT_KEY(). BleKeyboardKeys.h codes
+// (0x80 and up) are translated: KEY_LEFT_CTRL to KEY_RIGHT_GUI become modifier
+// bits with usage 0, the others their HID usage. Lower values are HID usages.
+uint16_t keyToHID(uint8_t key);
+
 #endif // CONFIG_BT_NIMBLE_ROLE_PERIPHERAL
 #endif // CONFIG_BT_ENABLED
 #endif // ESP32_BLE_CONTROLLER_H
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "BleControllerConfiguration.h"
 
 BleControllerConfiguration::BleControllerConfiguration() : _controllerType(CONTROLLER_TYPE_CONTROLLER),
+                                                     _controllerCount(1),
                                                      _autoReport(true),
                                                      _hidReportId(3),
                                                      _buttonCount(16),
@@ -10,6 +11,9 @@ BleControllerConfiguration::BleControllerConfiguration() : _controllerType(CONTR
                                                      _whichSimulationControls{false, false, false, false, false},
                                                      _includeGyroscope(false),
                                                      _includeAccelerometer(false),
+                                                     _includeKeyboard(false),
+                                                     _includeMouse(false),
+                                                     _fieldGroupReportIds{0, 0, 0, 0, 0},
                                                      _vid(0xe502),
                                                      _pid(0xbbab),
                                                      _guidVersion(0x0110),
@@ -19,6 +23,10 @@ BleControllerConfiguration::BleControllerConfiguration() : _controllerType(CONTR
                                                      _simulationMax(0x7FFF),
                                                      _motionMin(0x0000),
                                                      _motionMax(0x7FFF),
+                                                     _axesBits(16),
+                                                     _simulationBits(16),
+                                                     _motionBits(16),
+                                                     _hatBits(8),
                                                      _modelNumber("1.0.0"),
                                                      _softwareRevision("1.0.0"),
                                                      _serialNumber("0123456789"),
@@ -27,7 +35,18 @@ BleControllerConfiguration::BleControllerConfiguration() : _controllerType(CONTR
                                                      _enableOutputReport(false),
                                                      _enableNordicUARTService(false),
                                                      _outputReportLength(64),
-                                                     _transmitPowerLevel(9)
+                                                     _transmitPowerLevel(9),
+                                                     _enableReportScheduler(false),
+                                                     _reportInterval(0),
+                                                     _reportQueueDepth(8),
+                                                     _enablePipeline(false),
+                                                     _pipelineCore(PIPELINE_DEFAULT_CORE),
+                                                     _pipelineDepth(64),
+                                                     _typingDelay(15),
+                                                     _typingQueueDepth(128),
+                                                     _typingRollover(false),
+                                                     _keyboardLayout(&keyboardLayoutUS),
+                                                     _keyboardNkro(false)
 {
 }
 
@@ -95,7 +114,12 @@ int16_t BleControllerConfiguration::getSimulationMin(){ return _simulationMin; }
 int16_t BleControllerConfiguration::getSimulationMax(){ return _simulationMax; }
 int16_t BleControllerConfiguration::getMotionMin(){ return _motionMin; }
 int16_t BleControllerConfiguration::getMotionMax(){ return _motionMax; }
+uint8_t BleControllerConfiguration::getAxesBits(){ return _axesBits; }	// Report bits per axis: 8, 10, 12 or 16
+uint8_t BleControllerConfiguration::getSimulationBits(){ return _simulationBits; }	// Report bits per simulation control: 8, 10, 12 or 16
+uint8_t BleControllerConfiguration::getMotionBits(){ return _motionBits; }	// Report bits per gyroscope/accelerometer value: 8, 10, 12 or 16
+uint8_t BleControllerConfiguration::getHatBits(){ return _hatBits; }	// Report bits per hat switch: 4 or 8
 uint8_t BleControllerConfiguration::getControllerType() { return _controllerType; }
+uint8_t BleControllerConfiguration::getControllerCount() { return _controllerCount; }	// Controller collections in the device, see BleController::controller()
 uint8_t BleControllerConfiguration::getHidReportId() { return _hidReportId; }
 uint16_t BleControllerConfiguration::getButtonCount() { return _buttonCount; }
 uint8_t BleControllerConfiguration::getHatSwitchCount() { return _hatSwitchCount; }
@@ -124,8 +148,11 @@ bool BleControllerConfiguration::getIncludeAccelerator() { return _whichSimulati
 bool BleControllerConfiguration::getIncludeBrake() { return _whichSimulationControls[BRAKE]; }
 bool BleControllerConfiguration::getIncludeSteering() { return _whichSimulationControls[STEERING]; }
 const bool *BleControllerConfiguration::getWhichSimulationControls() const { return _whichSimulationControls; }
+uint8_t BleControllerConfiguration::getFieldGroupReportId(uint8_t group) { return group < FIELD_GROUPS && _fieldGroupReportIds[group] != 0 ? _fieldGroupReportIds[group] : _hidReportId; }	// Groups without their own report ID are sent in the controller report
 bool BleControllerConfiguration::getIncludeGyroscope() { return _includeGyroscope; }
 bool BleControllerConfiguration::getIncludeAccelerometer() { return _includeAccelerometer; }
+bool BleControllerConfiguration::getIncludeKeyboard() { return _includeKeyboard; }
+bool BleControllerConfiguration::getIncludeMouse() { return _includeMouse; }
 const char *BleControllerConfiguration::getModelNumber(){ return _modelNumber; }
 const char *BleControllerConfiguration::getSoftwareRevision(){ return _softwareRevision; }
 const char *BleControllerConfiguration::getSerialNumber(){ return _serialNumber; }
@@ -135,6 +162,17 @@ bool BleControllerConfiguration::getEnableOutputReport(){ return _enableOutputRe
 bool BleControllerConfiguration::getEnableNordicUARTService(){ return _enableNordicUARTService; }
 uint16_t BleControllerConfiguration::getOutputReportLength(){ return _outputReportLength; }
 int8_t BleControllerConfiguration::getTXPowerLevel(){ return _transmitPowerLevel; }	// Returns the power level that was set as the server started
+bool BleControllerConfiguration::getEnableReportScheduler(){ return _enableReportScheduler; }
+uint16_t BleControllerConfiguration::getReportInterval(){ return _reportInterval; }	// Milliseconds between scheduled reports, 0 follows the connection interval
+uint8_t BleControllerConfiguration::getReportQueueDepth(){ return _reportQueueDepth; }	// Reports held per input report while the link is congested
+bool BleControllerConfiguration::getEnablePipeline(){ return _enablePipeline; }
+uint8_t BleControllerConfiguration::getPipelineCore(){ return _pipelineCore; }	// Core the report packing task is pinned to
+uint16_t BleControllerConfiguration::getPipelineDepth(){ return _pipelineDepth; }	// State changes buffered between the input task and the report task
+uint8_t BleControllerConfiguration::getTypingDelay(){ return _typingDelay; }	// Milliseconds between typing reports, 0 for one connection interval
+uint16_t BleControllerConfiguration::getTypingQueueDepth(){ return _typingQueueDepth; }	// Keys keyboardWrite() can queue ahead of the typing task
+bool BleControllerConfiguration::getTypingRollover(){ return _typingRollover; }	// Hold up to 6 typed keys at once instead of releasing each one
+const keyboard_layout_t *BleControllerConfiguration::getKeyboardLayout(){ return _keyboardLayout; }	// Host keyboard layout text is typed for
+bool BleControllerConfiguration::getKeyboardNkro(){ return _keyboardNkro; }	// Add an N-key rollover report that keyboardPress() uses instead of the 6 key one
 
 void BleControllerConfiguration::setWhichSpecialButtons(bool start, bool select, bool menu, bool home, bool back, bool volumeInc, bool volumeDec, bool volumeMute)
 {
@@ -170,6 +208,13 @@ void BleControllerConfiguration::setWhichSimulationControls(bool rudder, bool th
 }
 
 void BleControllerConfiguration::setControllerType(uint8_t value) { _controllerType = value; }
+void BleControllerConfiguration::setControllerCount(uint8_t value)
+{
+    if (value >= 1 && value <= POSSIBLECONTROLLERS)
+    {
+        _controllerCount = value;
+    }
+}
 void BleControllerConfiguration::setHidReportId(uint8_t value) { _hidReportId = value; }
 void BleControllerConfiguration::setButtonCount(uint16_t value) { _buttonCount = value; }
 void BleControllerConfiguration::setHatSwitchCount(uint8_t value) { _hatSwitchCount = value; }
@@ -197,6 +242,15 @@ void BleControllerConfiguration::setIncludeBrake(bool value) { _whichSimulationC
 void BleControllerConfiguration::setIncludeSteering(bool value) { _whichSimulationControls[STEERING] = value; }
 void BleControllerConfiguration::setIncludeGyroscope(bool value) { _includeGyroscope = value; }
 void BleControllerConfiguration::setIncludeAccelerometer(bool value) { _includeAccelerometer = value; }
+void BleControllerConfiguration::setIncludeKeyboard(bool value) { _includeKeyboard = value; }
+void BleControllerConfiguration::setIncludeMouse(bool value) { _includeMouse = value; }
+void BleControllerConfiguration::setFieldGroupReportId(uint8_t group, uint8_t reportId)
+{
+    if (group < FIELD_GROUPS)
+    {
+        _fieldGroupReportIds[group] = reportId;
+    }
+}
 void BleControllerConfiguration::setVid(uint16_t value) { _vid = value; }
 void BleControllerConfiguration::setPid(uint16_t value) { _pid = value; }
 void BleControllerConfiguration::setGuidVersion(uint16_t value) { _guidVersion = value; }
@@ -206,6 +260,10 @@ void BleControllerConfiguration::setSimulationMin(int16_t value) { _simulationMi
 void BleControllerConfiguration::setSimulationMax(int16_t value) { _simulationMax = value; }
 void BleControllerConfiguration::setMotionMin(int16_t value) { _motionMin = value; }
 void BleControllerConfiguration::setMotionMax(int16_t value) { _motionMax = value; }
+void BleControllerConfiguration::setAxesBits(uint8_t value) { _axesBits = value; }
+void BleControllerConfiguration::setSimulationBits(uint8_t value) { _simulationBits = value; }
+void BleControllerConfiguration::setMotionBits(uint8_t value) { _motionBits = value; }
+void BleControllerConfiguration::setHatBits(uint8_t value) { _hatBits = value; }
 void BleControllerConfiguration::setModelNumber(const char *value) { _modelNumber = value; }
 void BleControllerConfiguration::setSoftwareRevision(const char *value) { _softwareRevision = value; }
 void BleControllerConfiguration::setSerialNumber(const char *value) { _serialNumber = value; }
@@ -215,3 +273,14 @@ void BleControllerConfiguration::setEnableOutputReport(bool value) { _enableOutp
 void BleControllerConfiguration::setEnableNordicUARTService(bool value) { _enableNordicUARTService = value; }
 void BleControllerConfiguration::setOutputReportLength(uint16_t value) { _outputReportLength = value; }
 void BleControllerConfiguration::setTXPowerLevel(int8_t value) { _transmitPowerLevel = value; }
+void BleControllerConfiguration::setEnableReportScheduler(bool value) { _enableReportScheduler = value; }
+void BleControllerConfiguration::setReportInterval(uint16_t value) { _reportInterval = value; }
+void BleControllerConfiguration::setReportQueueDepth(uint8_t value) { _reportQueueDepth = value; }
+void BleControllerConfiguration::setEnablePipeline(bool value) { _enablePipeline = value; }
+void BleControllerConfiguration::setPipelineCore(uint8_t value) { _pipelineCore = value; }
+void BleControllerConfiguration::setPipelineDepth(uint16_t value) { _pipelineDepth = value; }
+void BleControllerConfiguration::setTypingDelay(uint8_t value) { _typingDelay = value; }
+void BleControllerConfiguration::setTypingQueueDepth(uint16_t value) { _typingQueueDepth = value; }
+void BleControllerConfiguration::setTypingRollover(bool value) { _typingRollover = value; }
+void BleControllerConfiguration::setKeyboardLayout(const keyboard_layout_t *layout) { _keyboardLayout = layout; }
+void BleControllerConfiguration::setKeyboardNkro(bool value) { _keyboardNkro = value; }
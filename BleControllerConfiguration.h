@@ -4,8 +4,26 @@
 #define POSSIBLESPECIALBUTTONS 8
 #define POSSIBLEAXES 8
 #define POSSIBLESIMULATIONCONTROLS 5
+#define POSSIBLECONTROLLERS 4
+
+// Groups of controller fields that can be sent in their own input report,
+// see setFieldGroupReportId()
+#define FIELD_GROUP_BUTTONS 0    // Buttons and special buttons
+#define FIELD_GROUP_AXES 1
+#define FIELD_GROUP_SIMULATION 2
+#define FIELD_GROUP_MOTION 3     // Gyroscope and accelerometer
+#define FIELD_GROUP_HATS 4
+#define FIELD_GROUPS 5
 
 #include <Arduino.h>
+#include "BleKeyboardLayout.h"
+
+// Reports are packed on the core running the NimBLE host by default
+#if defined(CONFIG_BT_NIMBLE_PINNED_TO_CORE)
+#define PIPELINE_DEFAULT_CORE CONFIG_BT_NIMBLE_PINNED_TO_CORE
+#else
+#define PIPELINE_DEFAULT_CORE 0
+#endif
 
 #define CONTROLLER_TYPE_JOYSTICK 0x04
 #define CONTROLLER_TYPE_CONTROLLER 0x05
@@ -214,6 +232,7 @@ class BleControllerConfiguration
 {
 private:
     uint8_t _controllerType;
+    uint8_t _controllerCount;
     bool _autoReport;
     uint8_t _hidReportId;
     uint16_t _buttonCount;
@@ -223,6 +242,9 @@ private:
     bool _whichSimulationControls[POSSIBLESIMULATIONCONTROLS];
     bool _includeGyroscope;
     bool _includeAccelerometer;
+    bool _includeKeyboard;
+    bool _includeMouse;
+    uint8_t _fieldGroupReportIds[FIELD_GROUPS];
     uint16_t _vid;
     uint16_t _pid;
     uint16_t _guidVersion;
@@ -232,6 +254,10 @@ private:
     int16_t _simulationMax;
     int16_t _motionMin;
     int16_t _motionMax;
+    uint8_t _axesBits;
+    uint8_t _simulationBits;
+    uint8_t _motionBits;
+    uint8_t _hatBits;
     const char *_modelNumber;
     const char *_softwareRevision;
     const char *_serialNumber;
@@ -241,6 +267,17 @@ private:
     bool _enableNordicUARTService;
     uint16_t _outputReportLength;
     int8_t _transmitPowerLevel;
+    bool _enableReportScheduler;
+    uint16_t _reportInterval;
+    uint8_t _reportQueueDepth;
+    bool _enablePipeline;
+    uint8_t _pipelineCore;
+    uint16_t _pipelineDepth;
+    uint8_t _typingDelay;
+    uint16_t _typingQueueDepth;
+    bool _typingRollover;
+    const keyboard_layout_t *_keyboardLayout;
+    bool _keyboardNkro;
  
 
 public:
@@ -248,6 +285,7 @@ public:
 
     bool getAutoReport();
     uint8_t getControllerType();
+    uint8_t getControllerCount();
     uint8_t getHidReportId();
     uint16_t getButtonCount();
     uint8_t getTotalSpecialButtonCount();
@@ -280,7 +318,10 @@ public:
     bool getIncludeBrake();
     bool getIncludeSteering();
     const bool *getWhichSimulationControls() const;
+    uint8_t getFieldGroupReportId(uint8_t group);
     bool getIncludeAccelerometer();
+    bool getIncludeKeyboard();
+    bool getIncludeMouse();
     bool getIncludeGyroscope();
     uint16_t getVid();
     uint16_t getPid();
@@ -291,6 +332,10 @@ public:
     int16_t getSimulationMax();
     int16_t getMotionMin();
     int16_t getMotionMax();
+    uint8_t getAxesBits();
+    uint8_t getSimulationBits();
+    uint8_t getMotionBits();
+    uint8_t getHatBits();
     const char *getModelNumber();
     const char *getSoftwareRevision();
     const char *getSerialNumber();
@@ -300,8 +345,20 @@ public:
     bool getEnableNordicUARTService();
     uint16_t getOutputReportLength();
     int8_t getTXPowerLevel();
+    bool getEnableReportScheduler();
+    uint16_t getReportInterval();
+    uint8_t getReportQueueDepth();
+    bool getEnablePipeline();
+    uint8_t getPipelineCore();
+    uint16_t getPipelineDepth();
+    uint8_t getTypingDelay();
+    uint16_t getTypingQueueDepth();
+    bool getTypingRollover();
+    const keyboard_layout_t *getKeyboardLayout();
+    bool getKeyboardNkro();
 
     void setControllerType(uint8_t controllerType);
+    void setControllerCount(uint8_t value);
     void setAutoReport(bool value);
     void setHidReportId(uint8_t value);
     void setButtonCount(uint16_t value);
@@ -332,6 +389,9 @@ public:
     void setWhichSimulationControls(bool rudder, bool throttle, bool accelerator, bool brake, bool steering);
     void setIncludeGyroscope(bool value);
     void setIncludeAccelerometer(bool value);
+    void setIncludeKeyboard(bool value);
+    void setIncludeMouse(bool value);
+    void setFieldGroupReportId(uint8_t group, uint8_t reportId);
     void setVid(uint16_t value);
     void setPid(uint16_t value);
     void setGuidVersion(uint16_t value);
@@ -341,6 +401,10 @@ public:
     void setSimulationMax(int16_t value);
     void setMotionMin(int16_t value);
     void setMotionMax(int16_t value);
+    void setAxesBits(uint8_t value);
+    void setSimulationBits(uint8_t value);
+    void setMotionBits(uint8_t value);
+    void setHatBits(uint8_t value);
     void setModelNumber(const char *value);
     void setSoftwareRevision(const char *value);
     void setSerialNumber(const char *value);
@@ -350,6 +414,17 @@ public:
     void setEnableNordicUARTService(bool value);
     void setOutputReportLength(uint16_t value);
     void setTXPowerLevel(int8_t value);
+    void setEnableReportScheduler(bool value);
+    void setReportInterval(uint16_t value);
+    void setReportQueueDepth(uint8_t value);
+    void setEnablePipeline(bool value);
+    void setPipelineCore(uint8_t value);
+    void setPipelineDepth(uint16_t value);
+    void setTypingDelay(uint8_t value);
+    void setTypingQueueDepth(uint16_t value);
+    void setTypingRollover(bool value);
+    void setKeyboardLayout(const keyboard_layout_t *layout);
+    void setKeyboardNkro(bool value);
 };
 
 #endif
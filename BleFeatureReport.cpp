@@ -0,0 +1,48 @@
+#include "BleFeatureReport.h"
+#include <algorithm>
+#include <string.h>
+
+BleFeatureReceiver::BleFeatureReceiver(uint8_t reportId, uint16_t size, bool readOnly, BleFeatureReportCallbacks *callbacks)
+{
+    this->reportId = reportId;
+    this->size = size;
+    this->readOnly = readOnly;
+    this->callbacks = callbacks;
+    reportBuffer = new uint8_t[size];
+}
+
+BleFeatureReceiver::~BleFeatureReceiver()
+{
+    // Release memory
+    if (reportBuffer)
+    {
+        delete[] reportBuffer;
+    }
+}
+
+void BleFeatureReceiver::onRead(NimBLECharacteristic *pCharacteristic, NimBLEConnInfo& connInfo)
+{
+    // The value is refreshed on every read, so the host always gets the
+    // current configuration or statistics
+    memset(reportBuffer, 0, size);
+    if (callbacks)
+    {
+        callbacks->onGetFeatureReport(reportId, reportBuffer, size);
+    }
+    pCharacteristic->setValue(reportBuffer, size);
+}
+
+void BleFeatureReceiver::onWrite(NimBLECharacteristic *pCharacteristic, NimBLEConnInfo& connInfo)
+{
+    if (readOnly || !callbacks)
+    {
+        return;
+    }
+
+    // Retrieve data sent from the host, anything past the report is ignored
+    std::string value = pCharacteristic->getValue();
+    uint16_t length = std::min(value.length(), (size_t)size);
+    memcpy(reportBuffer, value.data(), length);
+
+    callbacks->onSetFeatureReport(reportId, reportBuffer, length);
+}
@@ -0,0 +1,44 @@
+#ifndef BLE_FEATURE_REPORT_H
+#define BLE_FEATURE_REPORT_H
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+
+#include "nimconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+
+#include <NimBLEServer.h>
+#include "NimBLECharacteristic.h"
+#include "NimBLEConnInfo.h"
+
+// Application side of a feature report registered with
+// BleController::addFeatureReport(). Both functions run on the NimBLE host
+// task, so keep them short and guard anything shared with the main loop.
+class BleFeatureReportCallbacks
+{
+public:
+    virtual ~BleFeatureReportCallbacks() {}
+    // GET_REPORT: fill report with size bytes, it starts out zeroed
+    virtual void onGetFeatureReport(uint8_t reportId, uint8_t *report, uint16_t size) {}
+    // SET_REPORT: length is at most the registered size. Never called for
+    // read-only reports.
+    virtual void onSetFeatureReport(uint8_t reportId, const uint8_t *report, uint16_t length) {}
+};
+
+// Connects one feature report characteristic to its BleFeatureReportCallbacks
+class BleFeatureReceiver : public NimBLECharacteristicCallbacks
+{
+public:
+    BleFeatureReceiver(uint8_t reportId, uint16_t size, bool readOnly, BleFeatureReportCallbacks *callbacks);
+    ~BleFeatureReceiver();
+    void onRead(NimBLECharacteristic *pCharacteristic, NimBLEConnInfo& connInfo) override;
+    void onWrite(NimBLECharacteristic *pCharacteristic, NimBLEConnInfo& connInfo) override;
+    uint8_t reportId;
+    uint16_t size;
+    bool readOnly;
+    BleFeatureReportCallbacks *callbacks;
+    uint8_t *reportBuffer;
+};
+
+#endif // CONFIG_BT_NIMBLE_ROLE_PERIPHERAL
+#endif // CONFIG_BT_ENABLED
+#endif // BLE_FEATURE_REPORT_H
@@ -0,0 +1,242 @@
+#include "BleHidDescriptorBuilder.h"
+#include <string.h>
+
+// Item prefixes with the size bits cleared (HID 1.11, 6.2.2)
+#define HID_ITEM_INPUT 0x80
+#define HID_ITEM_OUTPUT 0x90
+#define HID_ITEM_COLLECTION 0xA0
+#define HID_ITEM_FEATURE 0xB0
+#define HID_ITEM_END_COLLECTION 0xC0
+#define HID_ITEM_USAGE_PAGE 0x04
+#define HID_ITEM_LOGICAL_MINIMUM 0x14
+#define HID_ITEM_LOGICAL_MAXIMUM 0x24
+#define HID_ITEM_PHYSICAL_MINIMUM 0x34
+#define HID_ITEM_PHYSICAL_MAXIMUM 0x44
+#define HID_ITEM_UNIT 0x64
+#define HID_ITEM_REPORT_SIZE 0x74
+#define HID_ITEM_REPORT_ID 0x84
+#define HID_ITEM_REPORT_COUNT 0x94
+#define HID_ITEM_USAGE 0x08
+#define HID_ITEM_USAGE_MINIMUM 0x18
+#define HID_ITEM_USAGE_MAXIMUM 0x28
+
+BleHidDescriptorBuilder::BleHidDescriptorBuilder(uint8_t *buffer,
+                                                 size_t capacity)
+    : buffer(buffer), capacity(capacity), size(0), overflow(false),
+      collectionDepth(0), currentReportSize(0), currentReportCount(0),
+      currentReportId(0), reportCountUsed(0) {
+  memset(reports, 0, sizeof(reports));
+}
+
+void BleHidDescriptorBuilder::writeByte(uint8_t value) {
+  if (buffer != nullptr) {
+    if (size >= capacity) {
+      overflow = true;
+      return;
+    }
+    buffer[size] = value;
+  }
+  size++;
+}
+
+// size is the number of data bytes: 0, 1, 2 or 4
+void BleHidDescriptorBuilder::item(uint8_t prefix, uint32_t data,
+                                   uint8_t size) {
+  uint8_t sizeCode = size == 4 ? 3 : size;
+  writeByte(prefix | sizeCode);
+  for (uint8_t i = 0; i < size; i++) {
+    writeByte((data >> (8 * i)) & 0xFF);
+  }
+}
+
+// With size 0 the smallest encoding that keeps the sign is used
+void BleHidDescriptorBuilder::signedItem(uint8_t prefix, int32_t value,
+                                         uint8_t size) {
+  if (size == 0) {
+    if (value >= -128 && value <= 127) {
+      size = 1;
+    } else if (value >= -32768 && value <= 32767) {
+      size = 2;
+    } else {
+      size = 4;
+    }
+  }
+  item(prefix, (uint32_t)value, size);
+}
+
+void BleHidDescriptorBuilder::unsignedItem(uint8_t prefix, uint32_t value) {
+  if (value <= 0xFF) {
+    item(prefix, value, 1);
+  } else if (value <= 0xFFFF) {
+    item(prefix, value, 2);
+  } else {
+    item(prefix, value, 4);
+  }
+}
+
+BleHidDescriptorBuilder::report_bits_t *
+BleHidDescriptorBuilder::findReport(uint8_t reportId, bool create) {
+  for (uint8_t i = 0; i < reportCountUsed; i++) {
+    if (reports[i].reportId == reportId) {
+      return &reports[i];
+    }
+  }
+
+  if (!create) {
+    return nullptr;
+  }
+
+  if (reportCountUsed == HID_DESCRIPTOR_MAX_REPORT_IDS) {
+    overflow = true;
+    return nullptr;
+  }
+
+  report_bits_t *report = &reports[reportCountUsed++];
+  report->reportId = reportId;
+  return report;
+}
+
+void BleHidDescriptorBuilder::mainItem(uint8_t prefix, uint8_t type,
+                                       uint8_t flags) {
+  item(prefix, flags, 1);
+
+  report_bits_t *report = findReport(currentReportId, true);
+  if (report != nullptr) {
+    report->bits[type] += (uint32_t)currentReportSize * currentReportCount;
+  }
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::usagePage(uint16_t usagePage) {
+  unsignedItem(HID_ITEM_USAGE_PAGE, usagePage);
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::logicalMinimum(int32_t value,
+                                                                 uint8_t size) {
+  signedItem(HID_ITEM_LOGICAL_MINIMUM, value, size);
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::logicalMaximum(int32_t value,
+                                                                 uint8_t size) {
+  signedItem(HID_ITEM_LOGICAL_MAXIMUM, value, size);
+  return *this;
+}
+
+BleHidDescriptorBuilder &
+BleHidDescriptorBuilder::physicalMinimum(int32_t value, uint8_t size) {
+  signedItem(HID_ITEM_PHYSICAL_MINIMUM, value, size);
+  return *this;
+}
+
+BleHidDescriptorBuilder &
+BleHidDescriptorBuilder::physicalMaximum(int32_t value, uint8_t size) {
+  signedItem(HID_ITEM_PHYSICAL_MAXIMUM, value, size);
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::unit(uint32_t unit) {
+  unsignedItem(HID_ITEM_UNIT, unit);
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::reportSize(uint8_t bits) {
+  item(HID_ITEM_REPORT_SIZE, bits, 1);
+  currentReportSize = bits;
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::reportId(uint8_t reportId) {
+  item(HID_ITEM_REPORT_ID, reportId, 1);
+  currentReportId = reportId;
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::reportCount(uint16_t count) {
+  unsignedItem(HID_ITEM_REPORT_COUNT, count);
+  currentReportCount = count;
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::usage(uint16_t usage) {
+  unsignedItem(HID_ITEM_USAGE, usage);
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::usageMinimum(uint16_t usage) {
+  unsignedItem(HID_ITEM_USAGE_MINIMUM, usage);
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::usageMaximum(uint16_t usage) {
+  unsignedItem(HID_ITEM_USAGE_MAXIMUM, usage);
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::input(uint8_t flags) {
+  mainItem(HID_ITEM_INPUT, HID_REPORT_INPUT, flags);
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::output(uint8_t flags) {
+  mainItem(HID_ITEM_OUTPUT, HID_REPORT_OUTPUT, flags);
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::feature(uint8_t flags) {
+  mainItem(HID_ITEM_FEATURE, HID_REPORT_FEATURE, flags);
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::collection(uint8_t type) {
+  item(HID_ITEM_COLLECTION, type, 1);
+  collectionDepth++;
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::endCollection() {
+  item(HID_ITEM_END_COLLECTION, 0, 0);
+  if (collectionDepth == 0) {
+    overflow = true;
+  } else {
+    collectionDepth--;
+  }
+  return *this;
+}
+
+BleHidDescriptorBuilder &BleHidDescriptorBuilder::padToByte() {
+  uint8_t paddingBits = 8 - getReportBits(HID_REPORT_INPUT) % 8;
+  if (paddingBits < 8) {
+    reportSize(1);
+    reportCount(paddingBits);
+    input(HID_CONST_VAR_ABS);
+  }
+  return *this;
+}
+
+size_t BleHidDescriptorBuilder::getSize() { return size; }
+
+const uint8_t *BleHidDescriptorBuilder::getData() { return buffer; }
+
+bool BleHidDescriptorBuilder::isValid() {
+  return !overflow && collectionDepth == 0;
+}
+
+uint16_t BleHidDescriptorBuilder::getReportSize(uint8_t reportId,
+                                                uint8_t type) {
+  report_bits_t *report = findReport(reportId, false);
+  if (report == nullptr || type > HID_REPORT_FEATURE) {
+    return 0;
+  }
+  return (report->bits[type] + 7) / 8;
+}
+
+uint8_t BleHidDescriptorBuilder::getReportId() { return currentReportId; }
+
+uint32_t BleHidDescriptorBuilder::getReportBits(uint8_t type) {
+  report_bits_t *report = findReport(currentReportId, false);
+  if (report == nullptr || type > HID_REPORT_FEATURE) {
+    return 0;
+  }
+  return report->bits[type];
+}
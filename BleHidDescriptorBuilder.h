@@ -0,0 +1,104 @@
+#ifndef ESP32_BLE_HID_DESCRIPTOR_BUILDER_H
+#define ESP32_BLE_HID_DESCRIPTOR_BUILDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Collection types
+#define HID_COLLECTION_PHYSICAL 0x00
+#define HID_COLLECTION_APPLICATION 0x01
+#define HID_COLLECTION_LOGICAL 0x02
+
+// Main item flags used by the library's reports
+#define HID_DATA_ARRAY_ABS 0x00     // Data,Array,Abs
+#define HID_DATA_VAR_ABS 0x02       // Data,Var,Abs
+#define HID_CONST_VAR_ABS 0x03      // Const,Var,Abs (padding)
+#define HID_DATA_VAR_REL 0x06       // Data,Var,Rel
+#define HID_DATA_VAR_ABS_NULL 0x42  // Data,Var,Abs,Null State
+
+// Report types, for getReportSize()
+#define HID_REPORT_INPUT 0
+#define HID_REPORT_OUTPUT 1
+#define HID_REPORT_FEATURE 2
+
+// Report IDs a single descriptor can describe
+#define HID_DESCRIPTOR_MAX_REPORT_IDS 16
+
+// Writes HID report descriptor items and keeps track of how many bits each
+// report ID has, so report sizes always match the descriptor they come from.
+//
+// Without a buffer the builder only measures: run the same build code once
+// to get getSize(), allocate exactly that, then run it again into the
+// buffer. Items that do not fit are dropped and the builder becomes invalid
+// instead of writing past the end.
+class BleHidDescriptorBuilder {
+public:
+  BleHidDescriptorBuilder(uint8_t *buffer = nullptr, size_t capacity = 0);
+
+  // Global items
+  BleHidDescriptorBuilder &usagePage(uint16_t usagePage);
+  BleHidDescriptorBuilder &logicalMinimum(int32_t value, uint8_t size = 0);
+  BleHidDescriptorBuilder &logicalMaximum(int32_t value, uint8_t size = 0);
+  BleHidDescriptorBuilder &physicalMinimum(int32_t value, uint8_t size = 0);
+  BleHidDescriptorBuilder &physicalMaximum(int32_t value, uint8_t size = 0);
+  BleHidDescriptorBuilder &unit(uint32_t unit);
+  BleHidDescriptorBuilder &reportSize(uint8_t bits);
+  BleHidDescriptorBuilder &reportId(uint8_t reportId);
+  BleHidDescriptorBuilder &reportCount(uint16_t count);
+
+  // Local items
+  BleHidDescriptorBuilder &usage(uint16_t usage);
+  BleHidDescriptorBuilder &usageMinimum(uint16_t usage);
+  BleHidDescriptorBuilder &usageMaximum(uint16_t usage);
+
+  // Main items
+  BleHidDescriptorBuilder &input(uint8_t flags);
+  BleHidDescriptorBuilder &output(uint8_t flags);
+  BleHidDescriptorBuilder &feature(uint8_t flags);
+  BleHidDescriptorBuilder &collection(uint8_t type);
+  BleHidDescriptorBuilder &endCollection();
+
+  // Constant input bits up to the next byte boundary of the current report
+  BleHidDescriptorBuilder &padToByte();
+
+  size_t getSize();
+  const uint8_t *getData();
+  // False after an overflow, too many report IDs or unbalanced collections
+  bool isValid();
+
+  // Bytes in a report of the given HID_REPORT_* type, without the report ID
+  uint16_t getReportSize(uint8_t reportId, uint8_t type = HID_REPORT_INPUT);
+  // Bits described so far for the current report ID
+  uint32_t getReportBits(uint8_t type = HID_REPORT_INPUT);
+  // Last Report ID item written, 0 before the first one
+  uint8_t getReportId();
+
+private:
+  typedef struct {
+    uint8_t reportId;
+    uint32_t bits[3]; // Indexed by HID_REPORT_*
+  } report_bits_t;
+
+  uint8_t *buffer;
+  size_t capacity;
+  size_t size;
+  bool overflow;
+  uint8_t collectionDepth;
+
+  // Global state the main items depend on
+  uint8_t currentReportSize;
+  uint16_t currentReportCount;
+  uint8_t currentReportId;
+
+  report_bits_t reports[HID_DESCRIPTOR_MAX_REPORT_IDS];
+  uint8_t reportCountUsed;
+
+  void writeByte(uint8_t value);
+  void item(uint8_t prefix, uint32_t data, uint8_t size);
+  void signedItem(uint8_t prefix, int32_t value, uint8_t size);
+  void unsignedItem(uint8_t prefix, uint32_t value);
+  void mainItem(uint8_t prefix, uint8_t type, uint8_t flags);
+  report_bits_t *findReport(uint8_t reportId, bool create);
+};
+
+#endif // ESP32_BLE_HID_DESCRIPTOR_BUILDER_H
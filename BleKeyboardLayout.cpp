@@ -0,0 +1,428 @@
+#include "BleKeyboardLayout.h"
+
+// Shorthands for the tables: a key alone, with Left Shift, with AltGr (Right
+// Alt) and a dead key
+#define K(usage) LAYOUT_KEY(usage, 0x00)
+#define S(usage) LAYOUT_KEY(usage, 0x02)
+#define A(usage) LAYOUT_KEY(usage, 0x40)
+#define D(key) ((uint16_t)((key) | LAYOUT_DEAD))
+
+// US (ANSI)
+static const uint16_t usAscii[128] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    // 0x08: \b \t \n \r
+    K(0x2A), K(0x2B), K(0x28), 0, 0, K(0x28), 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    // 0x20: space ! " # $ % & '
+    K(0x2C), S(0x1E), S(0x34), S(0x20), S(0x21), S(0x22), S(0x24), K(0x34),
+    // 0x28: ( ) * + , - . /
+    S(0x26), S(0x27), S(0x25), S(0x2E), K(0x36), K(0x2D), K(0x37), K(0x38),
+    // 0x30: 0 1 2 3 4 5 6 7
+    K(0x27), K(0x1E), K(0x1F), K(0x20), K(0x21), K(0x22), K(0x23), K(0x24),
+    // 0x38: 8 9 : ; < = > ?
+    K(0x25), K(0x26), S(0x33), K(0x33), S(0x36), K(0x2E), S(0x37), S(0x38),
+    // 0x40: @ A B C D E F G
+    S(0x1F), S(0x04), S(0x05), S(0x06), S(0x07), S(0x08), S(0x09), S(0x0A),
+    // 0x48: H I J K L M N O
+    S(0x0B), S(0x0C), S(0x0D), S(0x0E), S(0x0F), S(0x10), S(0x11), S(0x12),
+    // 0x50: P Q R S T U V W
+    S(0x13), S(0x14), S(0x15), S(0x16), S(0x17), S(0x18), S(0x19), S(0x1A),
+    // 0x58: X Y Z [ \ ] ^ _
+    S(0x1B), S(0x1C), S(0x1D), K(0x2F), K(0x31), K(0x30), S(0x23), S(0x2D),
+    // 0x60: ` a b c d e f g
+    K(0x35), K(0x04), K(0x05), K(0x06), K(0x07), K(0x08), K(0x09), K(0x0A),
+    // 0x68: h i j k l m n o
+    K(0x0B), K(0x0C), K(0x0D), K(0x0E), K(0x0F), K(0x10), K(0x11), K(0x12),
+    // 0x70: p q r s t u v w
+    K(0x13), K(0x14), K(0x15), K(0x16), K(0x17), K(0x18), K(0x19), K(0x1A),
+    // 0x78: x y z { | } ~
+    K(0x1B), K(0x1C), K(0x1D), S(0x2F), S(0x31), S(0x30), S(0x35), 0,
+};
+
+const keyboard_layout_t keyboardLayoutUS = {
+    "US", usAscii, nullptr, 0,
+    {0, 0, 0, 0, 0}};
+
+// United Kingdom (ISO): " and @ swapped, # and ~ on the key left of Enter
+static const uint16_t ukAscii[128] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    // 0x08: \b \t \n \r
+    K(0x2A), K(0x2B), K(0x28), 0, 0, K(0x28), 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    // 0x20: space ! " # $ % & '
+    K(0x2C), S(0x1E), S(0x1F), K(0x32), S(0x21), S(0x22), S(0x24), K(0x34),
+    // 0x28: ( ) * + , - . /
+    S(0x26), S(0x27), S(0x25), S(0x2E), K(0x36), K(0x2D), K(0x37), K(0x38),
+    // 0x30: 0 1 2 3 4 5 6 7
+    K(0x27), K(0x1E), K(0x1F), K(0x20), K(0x21), K(0x22), K(0x23), K(0x24),
+    // 0x38: 8 9 : ; < = > ?
+    K(0x25), K(0x26), S(0x33), K(0x33), S(0x36), K(0x2E), S(0x37), S(0x38),
+    // 0x40: @ A B C D E F G
+    S(0x34), S(0x04), S(0x05), S(0x06), S(0x07), S(0x08), S(0x09), S(0x0A),
+    // 0x48: H I J K L M N O
+    S(0x0B), S(0x0C), S(0x0D), S(0x0E), S(0x0F), S(0x10), S(0x11), S(0x12),
+    // 0x50: P Q R S T U V W
+    S(0x13), S(0x14), S(0x15), S(0x16), S(0x17), S(0x18), S(0x19), S(0x1A),
+    // 0x58: X Y Z [ \ ] ^ _
+    S(0x1B), S(0x1C), S(0x1D), K(0x2F), K(0x64), K(0x30), S(0x23), S(0x2D),
+    // 0x60: ` a b c d e f g
+    K(0x35), K(0x04), K(0x05), K(0x06), K(0x07), K(0x08), K(0x09), K(0x0A),
+    // 0x68: h i j k l m n o
+    K(0x0B), K(0x0C), K(0x0D), K(0x0E), K(0x0F), K(0x10), K(0x11), K(0x12),
+    // 0x70: p q r s t u v w
+    K(0x13), K(0x14), K(0x15), K(0x16), K(0x17), K(0x18), K(0x19), K(0x1A),
+    // 0x78: x y z { | } ~
+    K(0x1B), K(0x1C), K(0x1D), S(0x2F), S(0x64), S(0x30), S(0x32), 0,
+};
+
+static const keyboard_layout_key_t ukKeys[] = {
+    {0x00A3, S(0x20)}, // £
+    {0x00A6, A(0x35)}, // ¦
+    {0x00AC, S(0x35)}, // ¬
+    {0x20AC, A(0x21)}, // €
+};
+
+const keyboard_layout_t keyboardLayoutUK = {
+    "UK", ukAscii, ukKeys, sizeof(ukKeys) / sizeof(ukKeys[0]),
+    {0, 0, 0, 0, 0}};
+
+// German (QWERTZ, ISO). ^, ` and ´ are dead keys.
+static const uint16_t deAscii[128] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    // 0x08: \b \t \n \r
+    K(0x2A), K(0x2B), K(0x28), 0, 0, K(0x28), 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    // 0x20: space ! " # $ % & '
+    K(0x2C), S(0x1E), S(0x1F), K(0x32), S(0x21), S(0x22), S(0x23), S(0x32),
+    // 0x28: ( ) * + , - . /
+    S(0x25), S(0x26), S(0x30), K(0x30), K(0x36), K(0x38), K(0x37), S(0x24),
+    // 0x30: 0 1 2 3 4 5 6 7
+    K(0x27), K(0x1E), K(0x1F), K(0x20), K(0x21), K(0x22), K(0x23), K(0x24),
+    // 0x38: 8 9 : ; < = > ?
+    K(0x25), K(0x26), S(0x37), S(0x36), K(0x64), S(0x27), S(0x64), S(0x2D),
+    // 0x40: @ A B C D E F G
+    A(0x14), S(0x04), S(0x05), S(0x06), S(0x07), S(0x08), S(0x09), S(0x0A),
+    // 0x48: H I J K L M N O
+    S(0x0B), S(0x0C), S(0x0D), S(0x0E), S(0x0F), S(0x10), S(0x11), S(0x12),
+    // 0x50: P Q R S T U V W
+    S(0x13), S(0x14), S(0x15), S(0x16), S(0x17), S(0x18), S(0x19), S(0x1A),
+    // 0x58: X Y Z [ \ ] ^ _
+    S(0x1B), S(0x1D), S(0x1C), A(0x25), A(0x2D), A(0x26), D(K(0x35)), S(0x38),
+    // 0x60: ` a b c d e f g
+    D(S(0x2E)), K(0x04), K(0x05), K(0x06), K(0x07), K(0x08), K(0x09), K(0x0A),
+    // 0x68: h i j k l m n o
+    K(0x0B), K(0x0C), K(0x0D), K(0x0E), K(0x0F), K(0x10), K(0x11), K(0x12),
+    // 0x70: p q r s t u v w
+    K(0x13), K(0x14), K(0x15), K(0x16), K(0x17), K(0x18), K(0x19), K(0x1A),
+    // 0x78: x y z { | } ~
+    K(0x1B), K(0x1D), K(0x1C), A(0x24), A(0x64), A(0x27), A(0x30), 0,
+};
+
+static const keyboard_layout_key_t deKeys[] = {
+    {0x00A7, S(0x20)}, // §
+    {0x00B0, S(0x35)}, // °
+    {0x00B2, A(0x1F)}, // ²
+    {0x00B3, A(0x20)}, // ³
+    {0x00B4, D(K(0x2E))}, // ´
+    {0x00B5, A(0x10)}, // µ
+    {0x00C4, S(0x34)}, // Ä
+    {0x00D6, S(0x33)}, // Ö
+    {0x00DC, S(0x2F)}, // Ü
+    {0x00DF, K(0x2D)}, // ß
+    {0x00E4, K(0x34)}, // ä
+    {0x00F6, K(0x33)}, // ö
+    {0x00FC, K(0x2F)}, // ü
+    {0x20AC, A(0x08)}, // €
+};
+
+const keyboard_layout_t keyboardLayoutDE = {
+    "DE", deAscii, deKeys, sizeof(deKeys) / sizeof(deKeys[0]),
+    {D(S(0x2E)), D(K(0x2E)), D(K(0x35)), 0, 0}};
+
+// French (AZERTY, ISO). ~, `, ^ (key right of P) and ¨ are dead keys; AltGr+9
+// types a plain ^.
+static const uint16_t frAscii[128] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    // 0x08: \b \t \n \r
+    K(0x2A), K(0x2B), K(0x28), 0, 0, K(0x28), 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    // 0x20: space ! " # $ % & '
+    K(0x2C), K(0x38), K(0x20), A(0x20), K(0x30), S(0x34), K(0x1E), K(0x21),
+    // 0x28: ( ) * + , - . /
+    K(0x22), K(0x2D), K(0x32), S(0x2E), K(0x10), K(0x23), S(0x36), S(0x37),
+    // 0x30: 0 1 2 3 4 5 6 7
+    S(0x27), S(0x1E), S(0x1F), S(0x20), S(0x21), S(0x22), S(0x23), S(0x24),
+    // 0x38: 8 9 : ; < = > ?
+    S(0x25), S(0x26), K(0x37), K(0x36), K(0x64), K(0x2E), S(0x64), S(0x10),
+    // 0x40: @ A B C D E F G
+    A(0x27), S(0x14), S(0x05), S(0x06), S(0x07), S(0x08), S(0x09), S(0x0A),
+    // 0x48: H I J K L M N O
+    S(0x0B), S(0x0C), S(0x0D), S(0x0E), S(0x0F), S(0x33), S(0x11), S(0x12),
+    // 0x50: P Q R S T U V W
+    S(0x13), S(0x04), S(0x15), S(0x16), S(0x17), S(0x18), S(0x19), S(0x1D),
+    // 0x58: X Y Z [ \ ] ^ _
+    S(0x1B), S(0x1C), S(0x1A), A(0x22), A(0x25), A(0x2D), A(0x26), K(0x25),
+    // 0x60: ` a b c d e f g
+    D(A(0x24)), K(0x14), K(0x05), K(0x06), K(0x07), K(0x08), K(0x09), K(0x0A),
+    // 0x68: h i j k l m n o
+    K(0x0B), K(0x0C), K(0x0D), K(0x0E), K(0x0F), K(0x33), K(0x11), K(0x12),
+    // 0x70: p q r s t u v w
+    K(0x13), K(0x04), K(0x15), K(0x16), K(0x17), K(0x18), K(0x19), K(0x1D),
+    // 0x78: x y z { | } ~
+    K(0x1B), K(0x1C), K(0x1A), A(0x21), A(0x23), A(0x2E), D(A(0x1F)), 0,
+};
+
+static const keyboard_layout_key_t frKeys[] = {
+    {0x00A3, S(0x30)}, // £
+    {0x00A4, A(0x30)}, // ¤
+    {0x00A7, S(0x38)}, // §
+    {0x00A8, D(S(0x2F))}, // ¨
+    {0x00B0, S(0x2D)}, // °
+    {0x00B2, K(0x35)}, // ²
+    {0x00B5, S(0x32)}, // µ
+    {0x00E0, K(0x27)}, // à
+    {0x00E7, K(0x26)}, // ç
+    {0x00E8, K(0x24)}, // è
+    {0x00E9, K(0x1F)}, // é
+    {0x00F9, K(0x34)}, // ù
+    {0x20AC, A(0x08)}, // €
+};
+
+const keyboard_layout_t keyboardLayoutFR = {
+    "FR", frAscii, frKeys, sizeof(frKeys) / sizeof(frKeys[0]),
+    {D(A(0x24)), 0, D(K(0x2F)), D(A(0x1F)), D(S(0x2F))}};
+
+// Swedish/Finnish (ISO). ´, `, ¨, ^ and ~ are dead keys.
+static const uint16_t nordicAscii[128] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    // 0x08: \b \t \n \r
+    K(0x2A), K(0x2B), K(0x28), 0, 0, K(0x28), 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    // 0x20: space ! " # $ % & '
+    K(0x2C), S(0x1E), S(0x1F), S(0x20), A(0x21), S(0x22), S(0x23), K(0x32),
+    // 0x28: ( ) * + , - . /
+    S(0x25), S(0x26), S(0x32), K(0x2D), K(0x36), K(0x38), K(0x37), S(0x24),
+    // 0x30: 0 1 2 3 4 5 6 7
+    K(0x27), K(0x1E), K(0x1F), K(0x20), K(0x21), K(0x22), K(0x23), K(0x24),
+    // 0x38: 8 9 : ; < = > ?
+    K(0x25), K(0x26), S(0x37), S(0x36), K(0x64), S(0x27), S(0x64), S(0x2D),
+    // 0x40: @ A B C D E F G
+    A(0x1F), S(0x04), S(0x05), S(0x06), S(0x07), S(0x08), S(0x09), S(0x0A),
+    // 0x48: H I J K L M N O
+    S(0x0B), S(0x0C), S(0x0D), S(0x0E), S(0x0F), S(0x10), S(0x11), S(0x12),
+    // 0x50: P Q R S T U V W
+    S(0x13), S(0x14), S(0x15), S(0x16), S(0x17), S(0x18), S(0x19), S(0x1A),
+    // 0x58: X Y Z [ \ ] ^ _
+    S(0x1B), S(0x1C), S(0x1D), A(0x25), A(0x2D), A(0x26), D(S(0x30)), S(0x38),
+    // 0x60: ` a b c d e f g
+    D(S(0x2E)), K(0x04), K(0x05), K(0x06), K(0x07), K(0x08), K(0x09), K(0x0A),
+    // 0x68: h i j k l m n o
+    K(0x0B), K(0x0C), K(0x0D), K(0x0E), K(0x0F), K(0x10), K(0x11), K(0x12),
+    // 0x70: p q r s t u v w
+    K(0x13), K(0x14), K(0x15), K(0x16), K(0x17), K(0x18), K(0x19), K(0x1A),
+    // 0x78: x y z { | } ~
+    K(0x1B), K(0x1C), K(0x1D), A(0x24), A(0x64), A(0x27), D(A(0x30)), 0,
+};
+
+static const keyboard_layout_key_t nordicKeys[] = {
+    {0x00A3, A(0x20)}, // £
+    {0x00A4, S(0x21)}, // ¤
+    {0x00A7, K(0x35)}, // §
+    {0x00A8, D(K(0x30))}, // ¨
+    {0x00B4, D(K(0x2E))}, // ´
+    {0x00BD, S(0x35)}, // ½
+    {0x00C4, S(0x34)}, // Ä
+    {0x00C5, S(0x2F)}, // Å
+    {0x00D6, S(0x33)}, // Ö
+    {0x00E4, K(0x34)}, // ä
+    {0x00E5, K(0x2F)}, // å
+    {0x00F6, K(0x33)}, // ö
+    {0x20AC, A(0x08)}, // €
+};
+
+const keyboard_layout_t keyboardLayoutNordic = {
+    "Nordic", nordicAscii, nordicKeys,
+    sizeof(nordicKeys) / sizeof(nordicKeys[0]),
+    {D(S(0x2E)), D(K(0x2E)), D(S(0x30)), D(A(0x30)), D(K(0x30))}};
+
+// Letters typed as a dead key and their base letter, sorted by code point
+typedef struct {
+  uint16_t codepoint;
+  char base;
+  uint8_t accent; // LAYOUT_ACCENT_*
+} accented_letter_t;
+
+static const accented_letter_t accentedLetters[] = {
+    {0x00C0, 'A', LAYOUT_ACCENT_GRAVE},      // À
+    {0x00C1, 'A', LAYOUT_ACCENT_ACUTE},      // Á
+    {0x00C2, 'A', LAYOUT_ACCENT_CIRCUMFLEX}, // Â
+    {0x00C3, 'A', LAYOUT_ACCENT_TILDE},      // Ã
+    {0x00C4, 'A', LAYOUT_ACCENT_DIAERESIS},  // Ä
+    {0x00C8, 'E', LAYOUT_ACCENT_GRAVE},      // È
+    {0x00C9, 'E', LAYOUT_ACCENT_ACUTE},      // É
+    {0x00CA, 'E', LAYOUT_ACCENT_CIRCUMFLEX}, // Ê
+    {0x00CB, 'E', LAYOUT_ACCENT_DIAERESIS},  // Ë
+    {0x00CC, 'I', LAYOUT_ACCENT_GRAVE},      // Ì
+    {0x00CD, 'I', LAYOUT_ACCENT_ACUTE},      // Í
+    {0x00CE, 'I', LAYOUT_ACCENT_CIRCUMFLEX}, // Î
+    {0x00CF, 'I', LAYOUT_ACCENT_DIAERESIS},  // Ï
+    {0x00D1, 'N', LAYOUT_ACCENT_TILDE},      // Ñ
+    {0x00D2, 'O', LAYOUT_ACCENT_GRAVE},      // Ò
+    {0x00D3, 'O', LAYOUT_ACCENT_ACUTE},      // Ó
+    {0x00D4, 'O', LAYOUT_ACCENT_CIRCUMFLEX}, // Ô
+    {0x00D5, 'O', LAYOUT_ACCENT_TILDE},      // Õ
+    {0x00D6, 'O', LAYOUT_ACCENT_DIAERESIS},  // Ö
+    {0x00D9, 'U', LAYOUT_ACCENT_GRAVE},      // Ù
+    {0x00DA, 'U', LAYOUT_ACCENT_ACUTE},      // Ú
+    {0x00DB, 'U', LAYOUT_ACCENT_CIRCUMFLEX}, // Û
+    {0x00DC, 'U', LAYOUT_ACCENT_DIAERESIS},  // Ü
+    {0x00DD, 'Y', LAYOUT_ACCENT_ACUTE},      // Ý
+    {0x00E0, 'a', LAYOUT_ACCENT_GRAVE},      // à
+    {0x00E1, 'a', LAYOUT_ACCENT_ACUTE},      // á
+    {0x00E2, 'a', LAYOUT_ACCENT_CIRCUMFLEX}, // â
+    {0x00E3, 'a', LAYOUT_ACCENT_TILDE},      // ã
+    {0x00E4, 'a', LAYOUT_ACCENT_DIAERESIS},  // ä
+    {0x00E8, 'e', LAYOUT_ACCENT_GRAVE},      // è
+    {0x00E9, 'e', LAYOUT_ACCENT_ACUTE},      // é
+    {0x00EA, 'e', LAYOUT_ACCENT_CIRCUMFLEX}, // ê
+    {0x00EB, 'e', LAYOUT_ACCENT_DIAERESIS},  // ë
+    {0x00EC, 'i', LAYOUT_ACCENT_GRAVE},      // ì
+    {0x00ED, 'i', LAYOUT_ACCENT_ACUTE},      // í
+    {0x00EE, 'i', LAYOUT_ACCENT_CIRCUMFLEX}, // î
+    {0x00EF, 'i', LAYOUT_ACCENT_DIAERESIS},  // ï
+    {0x00F1, 'n', LAYOUT_ACCENT_TILDE},      // ñ
+    {0x00F2, 'o', LAYOUT_ACCENT_GRAVE},      // ò
+    {0x00F3, 'o', LAYOUT_ACCENT_ACUTE},      // ó
+    {0x00F4, 'o', LAYOUT_ACCENT_CIRCUMFLEX}, // ô
+    {0x00F5, 'o', LAYOUT_ACCENT_TILDE},      // õ
+    {0x00F6, 'o', LAYOUT_ACCENT_DIAERESIS},  // ö
+    {0x00F9, 'u', LAYOUT_ACCENT_GRAVE},      // ù
+    {0x00FA, 'u', LAYOUT_ACCENT_ACUTE},      // ú
+    {0x00FB, 'u', LAYOUT_ACCENT_CIRCUMFLEX}, // û
+    {0x00FC, 'u', LAYOUT_ACCENT_DIAERESIS},  // ü
+    {0x00FD, 'y', LAYOUT_ACCENT_ACUTE},      // ý
+    {0x00FF, 'y', LAYOUT_ACCENT_DIAERESIS},  // ÿ
+    {0x0178, 'Y', LAYOUT_ACCENT_DIAERESIS},  // Ÿ
+};
+
+#define ACCENTED_LETTER_COUNT                                                  \
+  (sizeof(accentedLetters) / sizeof(accentedLetters[0]))
+
+// Key of a character outside ASCII with a key of its own, 0 if none
+static uint16_t findLayoutKey(const keyboard_layout_t *layout,
+                              uint32_t codepoint) {
+  uint8_t low = 0;
+  uint8_t high = layout->keyCount;
+  while (low < high) {
+    uint8_t middle = (low + high) / 2;
+    if (layout->keys[middle].codepoint < codepoint) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  if (low < layout->keyCount && layout->keys[low].codepoint == codepoint) {
+    return layout->keys[low].key;
+  }
+  return 0;
+}
+
+static const accented_letter_t *findAccentedLetter(uint32_t codepoint) {
+  uint8_t low = 0;
+  uint8_t high = ACCENTED_LETTER_COUNT;
+  while (low < high) {
+    uint8_t middle = (low + high) / 2;
+    if (accentedLetters[middle].codepoint < codepoint) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  if (low < ACCENTED_LETTER_COUNT &&
+      accentedLetters[low].codepoint == codepoint) {
+    return &accentedLetters[low];
+  }
+  return nullptr;
+}
+
+uint8_t keyboardLayoutKeys(const keyboard_layout_t *layout, uint32_t codepoint,
+                           uint16_t keys[LAYOUT_MAX_KEYS]) {
+  uint16_t key = codepoint < 0x80 ? layout->ascii[codepoint]
+                                  : findLayoutKey(layout, codepoint);
+  if (key != 0) {
+    keys[0] = key;
+    if ((key & LAYOUT_DEAD) == 0) {
+      return 1;
+    }
+    // A dead key followed by a space types the accent itself
+    keys[1] = layout->ascii[' '];
+    return 2;
+  }
+
+  const accented_letter_t *letter = findAccentedLetter(codepoint);
+  if (letter == nullptr) {
+    return 0;
+  }
+
+  uint16_t deadKey = layout->deadKeys[letter->accent];
+  uint16_t baseKey = layout->ascii[(uint8_t)letter->base];
+  if (deadKey == 0 || baseKey == 0) {
+    return 0;
+  }
+  keys[0] = deadKey;
+  keys[1] = baseKey;
+  return 2;
+}
+
+uint8_t decodeUtf8(const char *str, uint32_t *codepoint) {
+  const uint8_t *bytes = (const uint8_t *)str;
+  uint8_t length;
+  uint32_t value;
+  uint32_t minimum;
+
+  if (bytes[0] < 0x80) {
+    *codepoint = bytes[0];
+    return 1;
+  } else if ((bytes[0] & 0xE0) == 0xC0) {
+    length = 2;
+    value = bytes[0] & 0x1F;
+    minimum = 0x80;
+  } else if ((bytes[0] & 0xF0) == 0xE0) {
+    length = 3;
+    value = bytes[0] & 0x0F;
+    minimum = 0x800;
+  } else if ((bytes[0] & 0xF8) == 0xF0) {
+    length = 4;
+    value = bytes[0] & 0x07;
+    minimum = 0x10000;
+  } else {
+    *codepoint = 0xFFFD;
+    return 1;
+  }
+
+  // A terminating zero is not a continuation byte, so this stops at the end
+  for (uint8_t i = 1; i < length; i++) {
+    if ((bytes[i] & 0xC0) != 0x80) {
+      *codepoint = 0xFFFD;
+      return 1;
+    }
+    value = value << 6 | (bytes[i] & 0x3F);
+  }
+
+  // Overlong forms, surrogates and values past U+10FFFF
+  if (value < minimum || (value >= 0xD800 && value <= 0xDFFF) ||
+      value > 0x10FFFF) {
+    *codepoint = 0xFFFD;
+    return 1;
+  }
+
+  *codepoint = value;
+  return length;
+}
@@ -0,0 +1,61 @@
+#ifndef ESP32_BLE_KEYBOARD_LAYOUT_H
+#define ESP32_BLE_KEYBOARD_LAYOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A key of a layout packed into 16 bits: the HID usage in bits 0-6, the
+// modifier byte of the keyboard report (KEY_MOD_*) in bits 8-15. Bit 7 marks
+// a dead key, which types nothing by itself but changes the next key.
+#define LAYOUT_KEY(usage, modifiers) ((uint16_t)((modifiers) << 8 | (usage)))
+#define LAYOUT_DEAD 0x80
+#define LAYOUT_USAGE(key) ((uint8_t)((key) & 0x7F))
+#define LAYOUT_MODIFIERS(key) ((uint8_t)((key) >> 8))
+
+// Accents a layout can have a dead key for
+#define LAYOUT_ACCENT_GRAVE 0
+#define LAYOUT_ACCENT_ACUTE 1
+#define LAYOUT_ACCENT_CIRCUMFLEX 2
+#define LAYOUT_ACCENT_TILDE 3
+#define LAYOUT_ACCENT_DIAERESIS 4
+#define LAYOUT_ACCENTS 5
+
+// Most keys a single character takes: a dead key and the key after it
+#define LAYOUT_MAX_KEYS 2
+
+// A character outside ASCII with a key of its own
+typedef struct {
+  uint16_t codepoint;
+  uint16_t key; // LAYOUT_KEY()
+} keyboard_layout_key_t;
+
+// Where the host's keyboard layout puts each character. ASCII is a direct
+// lookup; other characters are looked up in keys, which is sorted by code
+// point, or typed as a dead key followed by the base letter.
+typedef struct {
+  const char *name;
+  const uint16_t *ascii; // 128 LAYOUT_KEY() values, 0 where there is no key
+  const keyboard_layout_key_t *keys;
+  uint8_t keyCount;
+  uint16_t deadKeys[LAYOUT_ACCENTS]; // By LAYOUT_ACCENT_*, 0 if missing
+} keyboard_layout_t;
+
+// Layouts as set on the host. Nordic is the Swedish/Finnish layout.
+extern const keyboard_layout_t keyboardLayoutUS;
+extern const keyboard_layout_t keyboardLayoutUK;
+extern const keyboard_layout_t keyboardLayoutDE;
+extern const keyboard_layout_t keyboardLayoutFR;
+extern const keyboard_layout_t keyboardLayoutNordic;
+
+// Writes the keys that type codepoint on layout into keys, in order, and
+// returns how many there are: 0 if the layout cannot type it. A dead
+// character such as '^' on a German layout is its dead key and a space.
+uint8_t keyboardLayoutKeys(const keyboard_layout_t *layout, uint32_t codepoint,
+                           uint16_t keys[LAYOUT_MAX_KEYS]);
+
+// Decodes the UTF-8 character at the start of str, which must not be empty,
+// and returns its length in bytes. A malformed sequence decodes as one byte
+// of U+FFFD, so decoding always moves on.
+uint8_t decodeUtf8(const char *str, uint32_t *codepoint);
+
+#endif // ESP32_BLE_KEYBOARD_LAYOUT_H
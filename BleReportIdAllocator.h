@@ -0,0 +1,44 @@
+#ifndef ESP32_BLE_REPORT_ID_ALLOCATOR_H
+#define ESP32_BLE_REPORT_ID_ALLOCATOR_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Hands out HID report IDs (1-255) so no two collections in a report map use
+// the same one. IDs chosen by the configuration are reserved first; the rest
+// are allocated from a preferred ID upwards.
+class BleReportIdAllocator {
+public:
+  BleReportIdAllocator() { memset(used, 0, sizeof(used)); }
+
+  // False if reportId is 0 or already taken
+  bool reserve(uint8_t reportId) {
+    if (reportId == 0 || isUsed(reportId)) {
+      return false;
+    }
+    used[reportId / 32] |= 1UL << (reportId % 32);
+    return true;
+  }
+
+  // The first free ID from preferred upwards, wrapping around to 1. Returns 0
+  // if all 255 are taken.
+  uint8_t allocate(uint8_t preferred) {
+    uint8_t reportId = preferred == 0 ? 1 : preferred;
+    for (uint16_t tried = 0; tried < 255; tried++) {
+      if (reserve(reportId)) {
+        return reportId;
+      }
+      reportId = reportId == 255 ? 1 : reportId + 1;
+    }
+    return 0;
+  }
+
+  bool isUsed(uint8_t reportId) {
+    return (used[reportId / 32] & (1UL << (reportId % 32))) != 0;
+  }
+
+private:
+  uint32_t used[8];
+};
+
+#endif // ESP32_BLE_REPORT_ID_ALLOCATOR_H
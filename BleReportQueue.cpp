@@ -0,0 +1,256 @@
+#include "BleReportQueue.h"
+#include <Arduino.h>
+
+BleReportQueue::BleReportQueue()
+    : characteristic(nullptr), slots(nullptr), lengths(nullptr), reportSize(0),
+      depth(0), policy(REPORT_QUEUE_MERGE), relativeOffset(0),
+      payloadLimit(0), holding(false), dropping(false), heldSince(0), head(0),
+      count(0), droppedCount(0), retryCount(0), mergedCount(0), sentCount(0),
+      bytesSent(0) {}
+
+BleReportQueue::~BleReportQueue() {
+  delete[] slots;
+  delete[] lengths;
+}
+
+void BleReportQueue::begin(uint16_t reportSize, uint8_t depth, uint8_t policy,
+                           uint16_t relativeOffset) {
+  if (depth == 0) {
+    depth = 1;
+  }
+
+  delete[] slots;
+  delete[] lengths;
+  slots = new uint8_t[reportSize * depth];
+  lengths = new uint16_t[depth];
+
+  this->reportSize = reportSize;
+  this->depth = depth;
+  this->policy = policy;
+  this->relativeOffset = relativeOffset;
+  head = 0;
+  count = 0;
+  resetHold();
+}
+
+void BleReportQueue::setCharacteristic(NimBLECharacteristic *characteristic) {
+  this->characteristic = characteristic;
+}
+
+// A new limit gets a new wait before reports that do not fit are dropped
+void BleReportQueue::setPayloadLimit(uint16_t limit) {
+  if (limit != payloadLimit) {
+    resetHold();
+  }
+  payloadLimit = limit;
+}
+
+void BleReportQueue::resetHold() {
+  holding = false;
+  dropping = false;
+}
+
+bool BleReportQueue::fits(size_t length) {
+  return payloadLimit == 0 || length <= payloadLimit;
+}
+
+// Whether a report that does not fit is still held for the limit to be raised:
+// for REPORT_QUEUE_MTU_WAIT_MS from the first one held, after which it is
+// dropped
+bool BleReportQueue::holdOversized() {
+  if (dropping) {
+    return false;
+  }
+  if (!holding) {
+    holding = true;
+    heldSince = millis();
+    return true;
+  }
+  if (millis() - heldSince < REPORT_QUEUE_MTU_WAIT_MS) {
+    return true;
+  }
+  dropping = true;
+  return false;
+}
+
+void BleReportQueue::setPolicy(uint8_t policy) { this->policy = policy; }
+
+uint8_t BleReportQueue::getPolicy() { return policy; }
+
+uint8_t *BleReportQueue::slot(uint8_t index) {
+  return slots + ((head + index) % depth) * reportSize;
+}
+
+bool BleReportQueue::send(const uint8_t *report, size_t length) {
+  if (characteristic == nullptr) {
+    return false;
+  }
+
+  // Anything still queued goes first, so reports never overtake each other
+  if (flush()) {
+    if (!fits(length)) {
+      if (!holdOversized()) {
+        droppedCount++;
+        return false;
+      }
+    } else if (notify(report, length)) {
+      sentCount++;
+      bytesSent += length;
+      return true;
+    } else {
+      retryCount++;
+    }
+  }
+
+  if (slots == nullptr || length > reportSize) {
+    droppedCount++;
+    return false;
+  }
+
+  return push(report, length);
+}
+
+// The report is stored in the characteristic too, so a host reading the input
+// report (GET_REPORT, or after reconnecting) gets the last one notified
+bool BleReportQueue::notify(const uint8_t *report, size_t length) {
+  characteristic->setValue(report, length);
+  return characteristic->notify();
+}
+
+bool BleReportQueue::flush() {
+  if (characteristic == nullptr) {
+    return count == 0;
+  }
+
+  while (count > 0) {
+    if (!fits(lengths[head])) {
+      if (holdOversized()) {
+        return false;
+      }
+      droppedCount++;
+    } else if (notify(slot(0), lengths[head])) {
+      sentCount++;
+      bytesSent += lengths[head];
+    } else {
+      retryCount++;
+      return false;
+    }
+    head = (head + 1) % depth;
+    count--;
+  }
+
+  return true;
+}
+
+void BleReportQueue::clear() {
+  head = 0;
+  count = 0;
+  resetHold();
+}
+
+// Sums the relative bytes of report into pending. Fails without touching
+// pending if the absolute bytes differ or a sum does not fit in an int8_t.
+bool BleReportQueue::accumulate(uint8_t *pending, const uint8_t *report,
+                                size_t length) {
+  if (memcmp(pending, report, relativeOffset) != 0) {
+    return false;
+  }
+
+  for (size_t i = relativeOffset; i < length; i++) {
+    int16_t sum = (int8_t)pending[i] + (int8_t)report[i];
+    if (sum < -128 || sum > 127) {
+      return false;
+    }
+  }
+
+  for (size_t i = relativeOffset; i < length; i++) {
+    pending[i] = (uint8_t)((int8_t)pending[i] + (int8_t)report[i]);
+  }
+
+  return true;
+}
+
+// Whether report only differs from the newest queued one in its relative
+// bytes, so REPORT_QUEUE_ACCUMULATE can add it in without losing an edge
+bool BleReportQueue::sameButtons(const uint8_t *report, size_t length) {
+  if (policy != REPORT_QUEUE_ACCUMULATE || count == 0) {
+    return false;
+  }
+  uint8_t newest = (head + count - 1) % depth;
+  return lengths[newest] == length &&
+         memcmp(slot(count - 1), report, relativeOffset) == 0;
+}
+
+// Adds the relative bytes of report into pending, clamped to an int8_t
+void BleReportQueue::saturate(uint8_t *pending, const uint8_t *report,
+                              size_t length) {
+  for (size_t i = relativeOffset; i < length; i++) {
+    int16_t sum = (int8_t)pending[i] + (int8_t)report[i];
+    pending[i] = (uint8_t)(int8_t)(sum < -128 ? -128 : sum > 127 ? 127 : sum);
+  }
+}
+
+bool BleReportQueue::push(const uint8_t *report, size_t length) {
+  if (count > 0) {
+    uint8_t newest = (head + count - 1) % depth;
+    uint8_t *pending = slot(count - 1);
+
+    if (policy == REPORT_QUEUE_MERGE) {
+      memcpy(pending, report, length);
+      lengths[newest] = length;
+      mergedCount++;
+      return true;
+    }
+
+    if (policy == REPORT_QUEUE_ACCUMULATE && lengths[newest] == length &&
+        accumulate(pending, report, length)) {
+      mergedCount++;
+      return true;
+    }
+
+    // Full: overwriting the newest report could lose a key or button edge, so
+    // only motion is combined, and anything else is dropped
+    if (count == depth) {
+      if (!sameButtons(report, length)) {
+        droppedCount++;
+        return false;
+      }
+      saturate(pending, report, length);
+      mergedCount++;
+      return true;
+    }
+  }
+
+  memcpy(slot(count), report, length);
+  lengths[(head + count) % depth] = length;
+  count++;
+
+  return true;
+}
+
+bool BleReportQueue::hasRoomFor(const uint8_t *report, size_t length) {
+  return count < depth || policy == REPORT_QUEUE_MERGE ||
+         length > reportSize || sameButtons(report, length);
+}
+
+uint8_t BleReportQueue::getPendingCount() { return count; }
+
+bool BleReportQueue::isFull() { return count == depth; }
+
+uint32_t BleReportQueue::getDroppedCount() { return droppedCount; }
+
+uint32_t BleReportQueue::getRetryCount() { return retryCount; }
+
+uint32_t BleReportQueue::getMergedCount() { return mergedCount; }
+
+uint32_t BleReportQueue::getSentCount() { return sentCount; }
+
+uint32_t BleReportQueue::getBytesSent() { return bytesSent; }
+
+void BleReportQueue::resetCounters() {
+  droppedCount = 0;
+  retryCount = 0;
+  mergedCount = 0;
+  sentCount = 0;
+  bytesSent = 0;
+}
@@ -0,0 +1,106 @@
+#ifndef ESP32_BLE_REPORT_QUEUE_H
+#define ESP32_BLE_REPORT_QUEUE_H
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include "nimconfig.h"
+#if defined(CONFIG_BT_NIMBLE_ROLE_PERIPHERAL)
+
+#include "NimBLECharacteristic.h"
+
+// What happens to a report that cannot be notified straight away
+#define REPORT_QUEUE_MERGE 0      // Replace the pending report (absolute state)
+#define REPORT_QUEUE_ACCUMULATE 1 // Add relative bytes into the pending report
+#define REPORT_QUEUE_FIFO 2       // Keep every report in order
+
+// How long a report longer than the payload limit waits for the limit to be
+// raised before it is dropped
+#define REPORT_QUEUE_MTU_WAIT_MS 2000
+
+// Bounded send queue for one input report characteristic. Reports are
+// notified directly while the link keeps up; once a notify fails they are
+// queued and retried in order on the next send() or flush().
+//
+// send() never waits. A full queue never overwrites a queued report that could
+// carry a key or button edge: REPORT_QUEUE_MERGE replaces its newest report,
+// REPORT_QUEUE_ACCUMULATE adds motion into it (clamped to an int8_t) only while
+// its buttons are the same, and anything else, always including
+// REPORT_QUEUE_FIFO, is dropped and counted in getDroppedCount(). Senders that
+// must not lose an edge wait for hasRoomFor() before sending.
+//
+// A report longer than the payload limit (ATT MTU - 3) is held in the queue
+// and goes out once the limit is raised. HID over GATT has no way to split one
+// report across notifications, and a truncated one no longer matches the
+// report map. If the limit has not been raised within
+// REPORT_QUEUE_MTU_WAIT_MS, the held report and every later one that does not
+// fit are dropped and counted in getDroppedCount(), until the limit changes or
+// the queue is cleared.
+//
+// A queue is not locked and must only be used from one task at a time.
+class BleReportQueue {
+public:
+  BleReportQueue();
+  ~BleReportQueue();
+
+  // relativeOffset is the first byte summed by REPORT_QUEUE_ACCUMULATE; the
+  // bytes before it must match for two reports to be combined
+  void begin(uint16_t reportSize, uint8_t depth, uint8_t policy,
+             uint16_t relativeOffset = 0);
+  void setCharacteristic(NimBLECharacteristic *characteristic);
+  // Longest report a notification can carry, 0 for no limit
+  void setPayloadLimit(uint16_t limit);
+  void setPolicy(uint8_t policy);
+  uint8_t getPolicy();
+
+  // Returns false if the report was dropped: no characteristic, longer than
+  // the report size, or the queue is full, see hasRoomFor()
+  bool send(const uint8_t *report, size_t length);
+  // Whether send() would queue or combine report rather than drop it for a
+  // full queue
+  bool hasRoomFor(const uint8_t *report, size_t length);
+  // Returns true once nothing is pending
+  bool flush();
+  void clear();
+
+  uint8_t getPendingCount();
+  bool isFull();
+  uint32_t getDroppedCount();
+  uint32_t getRetryCount();
+  uint32_t getMergedCount();
+  uint32_t getSentCount();
+  uint32_t getBytesSent();
+  void resetCounters();
+
+private:
+  NimBLECharacteristic *characteristic;
+  uint8_t *slots;
+  uint16_t *lengths;
+  uint16_t reportSize;
+  uint8_t depth;
+  uint8_t policy;
+  uint16_t relativeOffset;
+  uint16_t payloadLimit;
+  bool holding;    // A report does not fit, waiting since heldSince
+  bool dropping;   // The wait is over, reports that do not fit are dropped
+  uint32_t heldSince;
+  uint8_t head;
+  uint8_t count;
+  uint32_t droppedCount;
+  uint32_t retryCount;
+  uint32_t mergedCount;
+  uint32_t sentCount;
+  uint32_t bytesSent;
+
+  uint8_t *slot(uint8_t index);
+  bool fits(size_t length);
+  bool holdOversized();
+  void resetHold();
+  bool notify(const uint8_t *report, size_t length);
+  bool accumulate(uint8_t *pending, const uint8_t *report, size_t length);
+  bool sameButtons(const uint8_t *report, size_t length);
+  void saturate(uint8_t *pending, const uint8_t *report, size_t length);
+  bool push(const uint8_t *report, size_t length);
+};
+
+#endif // CONFIG_BT_NIMBLE_ROLE_PERIPHERAL
+#endif // CONFIG_BT_ENABLED
+#endif // ESP32_BLE_REPORT_QUEUE_H
@@ -0,0 +1,81 @@
+#ifndef ESP32_BLE_SPSC_RING_H
+#define ESP32_BLE_SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free ring buffer for exactly one producer task and one consumer task,
+// which may run on different cores. push() is only called by the producer and
+// pop()/peek() only by the consumer; neither ever blocks.
+//
+// The capacity is rounded up to a power of two so the free running indices
+// can be masked instead of wrapped.
+template <typename T> class BleSpscRing {
+public:
+  BleSpscRing() : items(nullptr), mask(0), head(0), tail(0) {}
+  ~BleSpscRing() { delete[] items; }
+
+  // Not thread safe, call before either side starts using the ring
+  void begin(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+
+    delete[] items;
+    items = new T[size];
+    mask = size - 1;
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+  }
+
+  // Producer side. Returns false if the ring is full.
+  bool push(const T &item) {
+    uint32_t writeIndex = head.load(std::memory_order_relaxed);
+    if (items == nullptr ||
+        writeIndex - tail.load(std::memory_order_acquire) > mask) {
+      return false;
+    }
+
+    items[writeIndex & mask] = item;
+    head.store(writeIndex + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false if the ring is empty.
+  bool pop(T &item) {
+    uint32_t readIndex = tail.load(std::memory_order_relaxed);
+    if (readIndex == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    item = items[readIndex & mask];
+    tail.store(readIndex + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Either side; only a snapshot while the other side is running
+  size_t size() const {
+    return head.load(std::memory_order_acquire) -
+           tail.load(std::memory_order_acquire);
+  }
+
+  bool empty() const { return size() == 0; }
+
+  size_t capacity() const { return items == nullptr ? 0 : mask + 1; }
+
+private:
+  T *items;
+  uint32_t mask;
+
+  // Written by the producer only
+  std::atomic<uint32_t> head;
+  // Written by the consumer only
+  std::atomic<uint32_t> tail;
+
+  BleSpscRing(const BleSpscRing &);
+  BleSpscRing &operator=(const BleSpscRing &);
+};
+
+#endif // ESP32_BLE_SPSC_RING_H
@@ -0,0 +1,186 @@
+#ifndef ESP32_BLE_STATIC_LAYOUT_H
+#define ESP32_BLE_STATIC_LAYOUT_H
+
+#include <stdint.h>
+
+// Axes of a static layout, one bit per X_AXIS..SLIDER2 index
+#define LAYOUT_AXIS_X (1 << 0)
+#define LAYOUT_AXIS_Y (1 << 1)
+#define LAYOUT_AXIS_Z (1 << 2)
+#define LAYOUT_AXIS_RX (1 << 3)
+#define LAYOUT_AXIS_RY (1 << 4)
+#define LAYOUT_AXIS_RZ (1 << 5)
+#define LAYOUT_AXIS_SLIDER1 (1 << 6)
+#define LAYOUT_AXIS_SLIDER2 (1 << 7)
+#define LAYOUT_AXES_ALL 0xFF
+
+// Motion sensors of a static layout
+#define LAYOUT_MOTION_GYROSCOPE 0x01
+#define LAYOUT_MOTION_ACCELEROMETER 0x02
+
+// Compile-time byte strings. Only the final descriptor's data[] is ever
+// instantiated, so it is the only copy that ends up in flash. Everything here
+// is plain C++11, as used by the Arduino-ESP32 2.x toolchain.
+template <uint8_t... Bytes> struct BleHidBytes {
+  static const uint16_t size = sizeof...(Bytes);
+  static const uint8_t data[];
+};
+
+template <uint8_t... Bytes>
+const uint8_t BleHidBytes<Bytes...>::data[] = {Bytes...};
+
+template <typename... Parts> struct BleHidConcat;
+
+template <> struct BleHidConcat<> {
+  typedef BleHidBytes<> type;
+};
+
+template <typename Part> struct BleHidConcat<Part> {
+  typedef Part type;
+};
+
+template <uint8_t... A, uint8_t... B, typename... Rest>
+struct BleHidConcat<BleHidBytes<A...>, BleHidBytes<B...>, Rest...> {
+  typedef typename BleHidConcat<BleHidBytes<A..., B...>, Rest...>::type type;
+};
+
+template <bool Condition, typename Part> struct BleHidIf {
+  typedef Part type;
+};
+
+template <typename Part> struct BleHidIf<false, Part> {
+  typedef BleHidBytes<> type;
+};
+
+template <uint8_t Count, typename Part> struct BleHidRepeat {
+  typedef typename BleHidConcat<
+      Part, typename BleHidRepeat<Count - 1, Part>::type>::type type;
+};
+
+template <typename Part> struct BleHidRepeat<0, Part> {
+  typedef BleHidBytes<> type;
+};
+
+constexpr uint8_t bleLayoutBitCount(uint8_t bits) {
+  return bits == 0 ? 0 : (bits & 1) + bleLayoutBitCount(bits >> 1);
+}
+
+constexpr uint8_t bleLayoutLowByte(int32_t value) {
+  return (uint8_t)(value & 0xFF);
+}
+
+constexpr uint8_t bleLayoutHighByte(int32_t value) {
+  return (uint8_t)((value >> 8) & 0xFF);
+}
+
+// A controller layout fixed at compile time, for BleController::beginStatic().
+// The report map is a constant array in flash and the report is packed by
+// code specialised for exactly these fields, so neither is built in begin().
+// It describes the controller only, without keyboard or mouse.
+//
+// The defaults match a default BleControllerConfiguration:
+//
+//   typedef BleControllerLayout<8, LAYOUT_AXIS_X | LAYOUT_AXIS_Y, 1> Layout;
+//   BleController.beginStatic<Layout>();
+template <uint8_t ButtonCount = 16, uint8_t Axes = LAYOUT_AXES_ALL,
+          uint8_t HatCount = 1, uint8_t Motion = 0, uint8_t ReportId = 3,
+          uint8_t ControllerType = 0x05, int16_t AxesMin = 0,
+          int16_t AxesMax = 0x7FFF, int16_t MotionMin = 0,
+          int16_t MotionMax = 0x7FFF>
+struct BleControllerLayout {
+  static_assert(ButtonCount <= 128, "at most 128 buttons");
+  static_assert(HatCount <= 4, "at most 4 hat switches");
+
+  static const uint8_t buttonCount = ButtonCount;
+  static const uint8_t axes = Axes;
+  static const uint8_t hatCount = HatCount;
+  static const uint8_t motion = Motion;
+  static const uint8_t reportId = ReportId;
+  static const uint8_t controllerType = ControllerType;
+  static const int16_t axesMin = AxesMin;
+  static const int16_t axesMax = AxesMax;
+  static const int16_t motionMin = MotionMin;
+  static const int16_t motionMax = MotionMax;
+
+  static const uint8_t axisCount = bleLayoutBitCount(Axes);
+  static const uint8_t buttonBytes = (ButtonCount + 7) / 8;
+  static const uint8_t buttonPadding = buttonBytes * 8 - ButtonCount;
+  static const uint8_t motionBytes =
+      bleLayoutBitCount(Motion & (LAYOUT_MOTION_GYROSCOPE |
+                                  LAYOUT_MOTION_ACCELEROMETER)) *
+      6;
+  static const uint16_t reportSize =
+      buttonBytes + axisCount * 2 + motionBytes + HatCount;
+
+  typedef typename BleHidIf<
+      (ButtonCount > 0),
+      typename BleHidConcat<
+          BleHidBytes<0x05, 0x09, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x19,
+                      0x01, 0x29, ButtonCount, 0x95, ButtonCount, 0x81, 0x02>,
+          typename BleHidIf<(buttonPadding > 0),
+                            BleHidBytes<0x75, 0x01, 0x95, buttonPadding, 0x81,
+                                        0x03>>::type>::type>::type
+      ButtonItems;
+
+  // Usages in report order: X, Y, Z, Rz, Rx, Ry, Slider, Slider
+  typedef typename BleHidIf<
+      (axisCount > 0),
+      typename BleHidConcat<
+          BleHidBytes<0x05, 0x01, 0x16, bleLayoutLowByte(AxesMin),
+                      bleLayoutHighByte(AxesMin), 0x26,
+                      bleLayoutLowByte(AxesMax), bleLayoutHighByte(AxesMax),
+                      0x75, 0x10, 0x95, axisCount, 0xA1, 0x00>,
+          typename BleHidIf<(Axes & LAYOUT_AXIS_X) != 0,
+                            BleHidBytes<0x09, 0x30>>::type,
+          typename BleHidIf<(Axes & LAYOUT_AXIS_Y) != 0,
+                            BleHidBytes<0x09, 0x31>>::type,
+          typename BleHidIf<(Axes & LAYOUT_AXIS_Z) != 0,
+                            BleHidBytes<0x09, 0x32>>::type,
+          typename BleHidIf<(Axes & LAYOUT_AXIS_RZ) != 0,
+                            BleHidBytes<0x09, 0x35>>::type,
+          typename BleHidIf<(Axes & LAYOUT_AXIS_RX) != 0,
+                            BleHidBytes<0x09, 0x33>>::type,
+          typename BleHidIf<(Axes & LAYOUT_AXIS_RY) != 0,
+                            BleHidBytes<0x09, 0x34>>::type,
+          typename BleHidIf<(Axes & LAYOUT_AXIS_SLIDER1) != 0,
+                            BleHidBytes<0x09, 0x36>>::type,
+          typename BleHidIf<(Axes & LAYOUT_AXIS_SLIDER2) != 0,
+                            BleHidBytes<0x09, 0x36>>::type,
+          BleHidBytes<0x81, 0x02, 0xC0>>::type>::type AxisItems;
+
+  typedef BleHidBytes<0x16, bleLayoutLowByte(MotionMin),
+                      bleLayoutHighByte(MotionMin), 0x26,
+                      bleLayoutLowByte(MotionMax),
+                      bleLayoutHighByte(MotionMax), 0x75, 0x10, 0x95, 0x03,
+                      0x81, 0x02, 0xC0>
+      MotionRange;
+
+  typedef typename BleHidIf<
+      (Motion & LAYOUT_MOTION_GYROSCOPE) != 0,
+      typename BleHidConcat<BleHidBytes<0xA1, 0x00, 0x05, 0x01, 0x09, 0x33,
+                                        0x09, 0x34, 0x09, 0x35>,
+                            MotionRange>::type>::type GyroscopeItems;
+
+  typedef typename BleHidIf<
+      (Motion & LAYOUT_MOTION_ACCELEROMETER) != 0,
+      typename BleHidConcat<BleHidBytes<0xA1, 0x00, 0x05, 0x01, 0x09, 0x40,
+                                        0x09, 0x41, 0x09, 0x42>,
+                            MotionRange>::type>::type AccelerometerItems;
+
+  typedef typename BleHidIf<
+      (HatCount > 0),
+      typename BleHidConcat<
+          BleHidBytes<0xA1, 0x00, 0x05, 0x01>,
+          typename BleHidRepeat<HatCount, BleHidBytes<0x09, 0x39>>::type,
+          BleHidBytes<0x15, 0x01, 0x25, 0x08, 0x35, 0x00, 0x46, 0x3B, 0x01,
+                      0x65, 0x12, 0x75, 0x08, 0x95, HatCount, 0x81, 0x42,
+                      0xC0>>::type>::type HatItems;
+
+  typedef typename BleHidConcat<
+      BleHidBytes<0x05, 0x01, 0x09, ControllerType, 0xA1, 0x01, 0x85,
+                  ReportId>,
+      ButtonItems, AxisItems, GyroscopeItems, AccelerometerItems, HatItems,
+      BleHidBytes<0xC0>>::type Descriptor;
+};
+
+#endif // ESP32_BLE_STATIC_LAYOUT_H
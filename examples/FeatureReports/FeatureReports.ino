@@ -0,0 +1,86 @@
+/*
+ * Tuning the controller from the host over HID feature reports
+ *
+ * Report ID 5 holds two settings the host can read and write: the stick deadzone and the
+ * sampling period in milliseconds. Report ID 6 is read-only and returns report statistics.
+ * A host tool reads them with HidD_GetFeature / HidD_SetFeature on Windows or
+ * hid_get_feature_report / hid_send_feature_report with hidapi; the first byte of the
+ * buffer is the report ID.
+ *
+ * The callbacks run on the NimBLE task, so they only copy values in and out.
+ */
+
+#include <Arduino.h>
+#include <BleController.h>
+
+#define SETTINGS_REPORT_ID 5
+#define STATS_REPORT_ID 6
+
+const int axisPins[2] = {34, 35};
+
+volatile uint8_t deadzone = 8;       // In percent of half the axis range
+volatile uint8_t samplePeriodMs = 5;
+
+BleController BleController;
+
+class FeatureReports : public BleFeatureReportCallbacks
+{
+    void onGetFeatureReport(uint8_t reportId, uint8_t *report, uint16_t size) override
+    {
+        if (reportId == SETTINGS_REPORT_ID)
+        {
+            report[0] = deadzone;
+            report[1] = samplePeriodMs;
+        }
+        else if (reportId == STATS_REPORT_ID)
+        {
+            ble_controller_stats_t stats = BleController.getStats();
+            memcpy(report, &stats.controllerReports, 4);
+            memcpy(report + 4, &stats.notifyFailures, 4);
+            memcpy(report + 8, &stats.droppedReports, 4);
+        }
+    }
+
+    void onSetFeatureReport(uint8_t reportId, const uint8_t *report, uint16_t length) override
+    {
+        if (reportId == SETTINGS_REPORT_ID && length == 2)
+        {
+            deadzone = report[0] > 50 ? 50 : report[0];
+            samplePeriodMs = report[1] < 1 ? 1 : report[1];
+        }
+    }
+};
+
+FeatureReports featureReports;
+
+int16_t applyDeadzone(int value)
+{
+    // analogRead() is 0..4095, the axis 0..32767 with its center at 16384
+    int16_t axis = value * 8;
+    int16_t limit = 16384 * deadzone / 100;
+    return abs(axis - 16384) < limit ? 16384 : axis;
+}
+
+void setup()
+{
+    Serial.begin(115200);
+
+    BleControllerConfiguration bleControllerConfig;
+    bleControllerConfig.setButtonCount(0);
+    bleControllerConfig.setWhichAxes(true, true, false, false, false, false, false, false);
+    bleControllerConfig.setHatSwitchCount(0);
+
+    BleController.addFeatureReport(SETTINGS_REPORT_ID, 2, &featureReports);
+    BleController.addFeatureReport(STATS_REPORT_ID, 12, &featureReports, true);
+    BleController.begin(&bleControllerConfig);
+}
+
+void loop()
+{
+    if (BleController.isConnected())
+    {
+        BleController.setX(applyDeadzone(analogRead(axisPins[0])));
+        BleController.setY(applyDeadzone(analogRead(axisPins[1])));
+    }
+    delay(samplePeriodMs);
+}
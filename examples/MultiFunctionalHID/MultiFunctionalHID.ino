@@ -51,6 +51,8 @@ void setup() {
   BleControllerConfig.setHatSwitchCount(2); // 2 hat switches
   BleControllerConfig.setAxesMax(32767);    // 16-bit axes resolution
   BleControllerConfig.setAxesMin(-32767);
+  BleControllerConfig.setIncludeKeyboard(true); // Keyboard and mouse are off by default
+  BleControllerConfig.setIncludeMouse(true);
 
   // Begin the BLE Controller with multi-HID support
   BleController.begin(&BleControllerConfig);
@@ -129,7 +131,7 @@ void demoKeyboard() {
 
     case 2:
       // Type with modifier (Ctrl+A to select all)
-      BleController.setKeyboardModifiers(KEY_MOD_LCTRL);
+      BleController.keyboardPress(KEY_LEFT_CTRL);
       BleController.keyboardPress(0x04); // 'A' key
       delay(10);
       BleController.keyboardReleaseAll();
@@ -256,7 +258,8 @@ void handleHardwareButtons() {
 
 void gamingKeyboardMacro() {
   // Gaming macro: Ctrl+Shift+F1 (common for game overlays)
-  BleController.setKeyboardModifiers(KEY_MOD_LCTRL | KEY_MOD_LSHIFT);
+  BleController.keyboardPress(KEY_LEFT_CTRL);
+  BleController.keyboardPress(KEY_LEFT_SHIFT);
   BleController.keyboardPress(KEY_F1);
   delay(10);
   BleController.keyboardReleaseAll();
@@ -0,0 +1,67 @@
+/*
+ * Two players in one BLE device, for example in an arcade cabinet
+ *
+ * setControllerCount() adds a controller collection per player. Player 1 uses the report ID set
+ * with setHidReportId(), the next players use the following report IDs. BleController.controller(i)
+ * addresses player i + 1; only the controller functions (buttons, axes, hats, ...) apply to it.
+ *
+ * With the report scheduler enabled, the reports of all players are sent together on every tick,
+ * so they reach the host in the same connection event.
+ */
+
+#include <Arduino.h>
+#include <BleController.h>
+
+#define PLAYERS 2
+
+const int buttonPins[PLAYERS][4] = {{12, 13, 14, 15}, {25, 26, 27, 32}};
+const int axisPins[PLAYERS][2] = {{34, 35}, {36, 39}};
+
+BleController BleController("Arcade Cabinet", "Espressif", 100);
+
+void setup()
+{
+    Serial.begin(115200);
+
+    for (int player = 0; player < PLAYERS; player++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            pinMode(buttonPins[player][i], INPUT_PULLUP);
+        }
+    }
+
+    BleControllerConfiguration bleControllerConfig;
+    bleControllerConfig.setHidReportId(4); // Players use report IDs 4 and 5
+    bleControllerConfig.setControllerCount(PLAYERS);
+    bleControllerConfig.setButtonCount(4);
+    bleControllerConfig.setWhichAxes(true, true, false, false, false, false, false, false);
+    bleControllerConfig.setHatSwitchCount(0);
+    bleControllerConfig.setEnableReportScheduler(true);
+    BleController.begin(&bleControllerConfig);
+}
+
+void loop()
+{
+    if (BleController.isConnected())
+    {
+        for (int player = 0; player < PLAYERS; player++)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                if (digitalRead(buttonPins[player][i]) == LOW)
+                {
+                    BleController.controller(player).press(BUTTON_1 + i);
+                }
+                else
+                {
+                    BleController.controller(player).release(BUTTON_1 + i);
+                }
+            }
+
+            BleController.controller(player).setX(analogRead(axisPins[player][0]) * 8);
+            BleController.controller(player).setY(analogRead(axisPins[player][1]) * 8);
+        }
+    }
+    delay(5);
+}
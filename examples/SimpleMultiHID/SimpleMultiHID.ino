@@ -15,8 +15,11 @@ void setup() {
   Serial.begin(115200);
   Serial.println("ESP32-C3 Multi-functional HID Device");
 
-  // Start the multi-HID device
-  bleDevice.begin();
+  // Start the multi-HID device; keyboard and mouse are off by default
+  BleControllerConfiguration bleDeviceConfig;
+  bleDeviceConfig.setIncludeKeyboard(true);
+  bleDeviceConfig.setIncludeMouse(true);
+  bleDevice.begin(&bleDeviceConfig);
   Serial.println("Waiting for Bluetooth connection...");
 }
 
@@ -0,0 +1,53 @@
+/*
+ * A controller whose layout is fixed at compile time
+ *
+ * BleControllerLayout<buttons, axes, hats, motion, report ID, controller type, ...> describes the controller.
+ * Its HID report map is a constant array in flash and its report is packed by code made for exactly
+ * these fields, so begin() does not build a descriptor and each report is packed at fixed offsets.
+ *
+ * Here: 8 buttons, X and Y axes, one hat switch and a gyroscope
+ *
+ * Possible axes are:
+ * LAYOUT_AXIS_X, LAYOUT_AXIS_Y, LAYOUT_AXIS_Z, LAYOUT_AXIS_RX, LAYOUT_AXIS_RY, LAYOUT_AXIS_RZ,
+ * LAYOUT_AXIS_SLIDER1, LAYOUT_AXIS_SLIDER2 (or LAYOUT_AXES_ALL)
+ *
+ * Possible motion sensors are:
+ * LAYOUT_MOTION_GYROSCOPE, LAYOUT_MOTION_ACCELEROMETER
+ */
+
+#include <Arduino.h>
+#include <BleController.h>
+
+typedef BleControllerLayout<8, LAYOUT_AXIS_X | LAYOUT_AXIS_Y, 1, LAYOUT_MOTION_GYROSCOPE> StaticLayout;
+
+BleController BleController;
+
+void setup()
+{
+    Serial.begin(115200);
+    Serial.println("Starting BLE work!");
+
+    // Settings other than the layout (auto report, VID/PID, ...) still come from a configuration
+    BleControllerConfiguration bleControllerConfig;
+    bleControllerConfig.setAutoReport(false);
+    BleController.beginStatic<StaticLayout>(&bleControllerConfig);
+}
+
+void loop()
+{
+    if (BleController.isConnected())
+    {
+        BleController.press(BUTTON_1);
+        BleController.setX(analogRead(34) * 8);
+        BleController.setY(analogRead(35) * 8);
+        BleController.setHat1(HAT_UP);
+        BleController.setGyroscope(100, 200, 300);
+        BleController.sendReport();
+        delay(500);
+
+        BleController.release(BUTTON_1);
+        BleController.setHat1(HAT_CENTERED);
+        BleController.sendReport();
+        delay(500);
+    }
+}
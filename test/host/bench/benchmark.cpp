@@ -0,0 +1,313 @@
+// Host benchmarks for the report, descriptor, keyboard and NUS paths.
+//
+// The library is built against the stub NimBLE layer in ../stubs, so the
+// numbers are the library's own CPU cost per call (ns/op) on the host. They
+// are meant for comparing changes, not for predicting ESP32 timings.
+//
+//   cd test/host && pio run -e bench -t exec
+
+#include <BleController.h>
+#include <BleKeyboardKeys.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+struct BenchConfig {
+  const char *name;
+  void (*apply)(BleControllerConfiguration &config);
+};
+
+// examples/Gamepad: library defaults
+void gamepadConfig(BleControllerConfiguration &config) { (void)config; }
+
+// examples/FlightControllerTest
+void flightControllerConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+  config.setControllerType(CONTROLLER_TYPE_MULTI_AXIS);
+  config.setButtonCount(16);
+  config.setIncludeStart(true);
+  config.setIncludeSelect(true);
+  config.setWhichAxes(true, true, false, false, false, false, false, false);
+  config.setWhichSimulationControls(true, true, false, true, false);
+  config.setHatSwitchCount(0);
+  config.setAxesMin(0x8001);
+  config.setAxesMax(0x7FFF);
+  config.setSimulationMin(-255);
+  config.setSimulationMax(255);
+}
+
+// examples/MultiFunctionalHID
+void multiFunctionalConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+  config.setButtonCount(16);
+  config.setHatSwitchCount(2);
+  config.setAxesMax(32767);
+  config.setAxesMin(-32767);
+  config.setIncludeKeyboard(true);
+  config.setIncludeMouse(true);
+}
+
+const BenchConfig configs[] = {
+    {"Gamepad", gamepadConfig},
+    {"FlightControllerTest", flightControllerConfig},
+    {"MultiFunctionalHID", multiFunctionalConfig},
+};
+
+// Iteration counts can be scaled down for quick runs, e.g. BENCH_SCALE=0.1
+double scale = 1.0;
+
+uint32_t iterations(uint32_t count) {
+  uint32_t scaled = (uint32_t)(count * scale);
+  return scaled > 0 ? scaled : 1;
+}
+
+double nowNs() {
+  return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void report(const char *config, const char *operation, double nsPerOp) {
+  printf("%-22s %-34s %12.1f\n", config, operation, nsPerOp);
+}
+
+template <typename Operation>
+void bench(const char *config, const char *name, uint32_t count,
+           Operation operation) {
+  count = iterations(count);
+
+  for (uint32_t i = 0; i < count / 10; i++) {
+    operation(i);
+  }
+
+  double start = nowNs();
+  for (uint32_t i = 0; i < count; i++) {
+    operation(i);
+  }
+  report(config, name, (nowNs() - start) / count);
+}
+
+void stopRecording() {
+  NimBLEHIDDevice *hid = host::hidDevice();
+  for (uint8_t reportId = 1; reportId <= 3; reportId++) {
+    NimBLECharacteristic *input = hid->findInputReport(reportId);
+    if (input) {
+      input->recordNotifications = false;
+    }
+  }
+}
+
+// begin() builds the descriptor and report layout, then starts the server
+// task. Only the begin() call itself is timed.
+void benchBegin(BleController &controller, const BenchConfig &config) {
+  BleControllerConfiguration bleConfig;
+  config.apply(bleConfig);
+
+  uint32_t count = iterations(200);
+  double total = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    host::resetStack();
+    double start = nowNs();
+    controller.begin(&bleConfig);
+    total += nowNs() - start;
+    host::waitForServer();
+  }
+  report(config.name, "begin()", total / count);
+}
+
+void benchController(BleController &controller, const char *name) {
+  const uint32_t count = 200000;
+  int16_t axes[POSSIBLEAXES] = {0};
+  uint8_t buttons[16] = {0};
+
+  controller.configuration.setAutoReport(false);
+
+  bench(name, "press/release", count, [&](uint32_t i) {
+    if (i & 1) {
+      controller.release(BUTTON_5);
+    } else {
+      controller.press(BUTTON_5);
+    }
+  });
+  bench(name, "pressStart/releaseStart", count, [&](uint32_t i) {
+    if (i & 1) {
+      controller.releaseStart();
+    } else {
+      controller.pressStart();
+    }
+  });
+  bench(name, "setX", count, [&](uint32_t i) { controller.setX(i); });
+  bench(name, "setLeftThumb", count,
+        [&](uint32_t i) { controller.setLeftThumb(i, -i); });
+  bench(name, "setTriggers", count,
+        [&](uint32_t i) { controller.setTriggers(i, i); });
+  bench(name, "setAxes", count, [&](uint32_t i) {
+    controller.setAxes(i, i, i, i, i, i, i, i);
+  });
+  bench(name, "setAllAxes", count, [&](uint32_t i) {
+    axes[i % POSSIBLEAXES] = i;
+    controller.setAllAxes(axes);
+  });
+  bench(name, "setButtons", count, [&](uint32_t i) {
+    buttons[i % 16] ^= 1;
+    controller.setButtons(buttons);
+  });
+  bench(name, "setHat1", count,
+        [&](uint32_t i) { controller.setHat1(i % 9); });
+  bench(name, "setHats", count, [&](uint32_t i) {
+    controller.setHats(i % 9, (i + 1) % 9, (i + 2) % 9, (i + 3) % 9);
+  });
+  bench(name, "setSimulationControls", count, [&](uint32_t i) {
+    controller.setSimulationControls(i, i, i, i, i);
+  });
+  bench(name, "setMotionControls", count, [&](uint32_t i) {
+    controller.setMotionControls(i, i, i, i, i, i);
+  });
+
+  bench(name, "setX + sendReport()", count, [&](uint32_t i) {
+    controller.setX(i);
+    controller.sendReport();
+  });
+  bench(name, "sendReport() unchanged", count,
+        [&](uint32_t i) { controller.sendReport(); });
+
+  controller.configuration.setAutoReport(true);
+  bench(name, "setX (auto report)", count,
+        [&](uint32_t i) { controller.setX(i); });
+  bench(name, "setAxes (auto report)", count, [&](uint32_t i) {
+    controller.setAxes(i, i, i, i, i, i, i, i);
+  });
+  bench(name, "press/release (auto report)", count, [&](uint32_t i) {
+    if (i & 1) {
+      controller.release(BUTTON_5);
+    } else {
+      controller.press(BUTTON_5);
+    }
+  });
+  controller.configuration.setAutoReport(false);
+}
+
+std::mutex typingMutex;
+std::condition_variable typingDone;
+
+void onTypingComplete() {
+  std::lock_guard<std::mutex> lock(typingMutex);
+  typingDone.notify_all();
+}
+
+void waitForTyping(BleController &controller) {
+  std::unique_lock<std::mutex> lock(typingMutex);
+  typingDone.wait(lock, [&] { return !controller.isTyping(); });
+}
+
+// keyboardWrite() only queues keys for the typing task, so only queueing is
+// timed. Operations run until the queue is full; the typing task then empties
+// it, untimed, before the next batch.
+template <typename Operation>
+void benchTyping(BleController &controller, const char *config,
+                 const char *name, uint32_t count, Operation operation) {
+  count = iterations(count);
+
+  double total = 0;
+  uint32_t done = 0;
+  while (done < count) {
+    waitForTyping(controller);
+    double start = nowNs();
+    while (done < count && operation()) {
+      done++;
+    }
+    total += nowNs() - start;
+  }
+  waitForTyping(controller);
+  report(config, name, total / count);
+}
+
+void benchKeyboard(BleController &controller, const char *name) {
+  controller.setTypingCompleteCallback(onTypingComplete);
+  benchTyping(controller, name, "keyboardWrite(key)", 100000,
+              [&] { return controller.keyboardWrite(KEY_RETURN) == 1; });
+  const char *text = "Hello, World!";
+  benchTyping(controller, name, "keyboardWrite(\"Hello, World!\")", 20000,
+              [&] { return controller.keyboardWrite(text) == strlen(text); });
+  bench(name, "keyboardPress/Release", 100000, [&](uint32_t i) {
+    controller.keyboardPress(KEY_LEFT_ARROW);
+    controller.keyboardRelease(KEY_LEFT_ARROW);
+  });
+}
+
+void onNusData(const uint8_t *data, size_t length) {
+  (void)data;
+  (void)length;
+}
+
+// ns per byte read, from a full 244 byte write (MTU 247)
+void benchNus(BleController &controller, const char *name) {
+  controller.beginNUS();
+  controller.setNUSDataReceivedCallback(onNusData);
+
+  NimBLEService *service =
+      NimBLEDevice::getServer()->getServiceByUUID(NUS_SERVICE_UUID);
+  NimBLECharacteristic *rx =
+      service->getCharacteristic(NUS_RX_CHARACTERISTIC_UUID);
+  BleNUS *nus = controller.getNUS();
+
+  uint8_t chunk[244];
+  for (size_t i = 0; i < sizeof(chunk); i++) {
+    chunk[i] = 'a' + i % 26;
+  }
+
+  uint32_t count = iterations(2000);
+  double total = 0;
+  uint32_t bytes = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    rx->hostWrite(chunk, sizeof(chunk));
+    double start = nowNs();
+    while (nus->available() > 0) {
+      nus->read();
+      bytes++;
+    }
+    total += nowNs() - start;
+  }
+  report(name, "NUS read() per byte", total / bytes);
+}
+
+} // namespace
+
+int main() {
+  const char *scaleEnv = getenv("BENCH_SCALE");
+  if (scaleEnv) {
+    scale = atof(scaleEnv);
+  }
+
+  setvbuf(stdout, nullptr, _IONBF, 0);
+  host::skipDelays = true;
+
+  printf("%-22s %-34s %12s\n", "config", "operation", "ns/op");
+
+  for (const BenchConfig &config : configs) {
+    BleController controller;
+
+    benchBegin(controller, config);
+
+    NimBLEServer *server = host::waitForServer();
+    server->hostConnect();
+    stopRecording();
+
+    benchController(controller, config.name);
+    if (controller.getKeyboardReportId() != 0) {
+      benchKeyboard(controller, config.name);
+    }
+
+    if (&config == &configs[2]) {
+      benchNus(controller, config.name);
+    }
+  }
+
+  return 0;
+}
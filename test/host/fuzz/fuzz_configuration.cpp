@@ -0,0 +1,151 @@
+// Fuzz target over BleControllerConfiguration: each input is turned into a
+// configuration, and the report map begin() writes must agree with the
+// reports the controller sends (see ControllerCheck.h). Any mismatch aborts.
+//
+// With libFuzzer (clang), as one command line:
+//
+//   clang++ -std=gnu++17 -g -O1 -fsanitize=fuzzer,address
+//       -DBLE_FUZZ_LIBFUZZER -Istubs -I../.. fuzz/fuzz_configuration.cpp
+//       hid/*.cpp stubs/HostStubs.cpp ../../*.cpp -o fuzz_configuration
+//   ./fuzz_configuration -max_total_time=600
+//
+// Without it, main() below runs the files given on the command line, or a
+// fixed number of pseudo-random inputs:
+//
+//   cd test/host && pio run -e fuzz -t exec
+
+#include "../hid/ControllerCheck.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+// Reads the input front to back; past the end every value is 0
+class FuzzInput {
+public:
+  FuzzInput(const uint8_t *data, size_t size) : data(data), size(size) {}
+
+  uint8_t byte() { return offset < size ? data[offset++] : 0; }
+  bool flag() { return (byte() & 1) != 0; }
+  uint16_t word() {
+    uint8_t low = byte();
+    return low | byte() << 8;
+  }
+  uint8_t range(uint8_t minimum, uint8_t maximum) {
+    return minimum + byte() % (maximum - minimum + 1);
+  }
+
+private:
+  const uint8_t *data;
+  size_t size;
+  size_t offset = 0;
+};
+
+const uint8_t controllerTypes[] = {CONTROLLER_TYPE_JOYSTICK,
+                                   CONTROLLER_TYPE_CONTROLLER,
+                                   CONTROLLER_TYPE_MULTI_AXIS};
+const uint8_t valueBits[] = {8, 10, 12, 16};
+
+// An inverted range is a configuration error, not something to describe
+void setRange(FuzzInput &input, BleControllerConfiguration &config,
+              void (BleControllerConfiguration::*setMinimum)(int16_t),
+              void (BleControllerConfiguration::*setMaximum)(int16_t)) {
+  int16_t a = input.word();
+  int16_t b = input.word();
+  (config.*setMinimum)(a < b ? a : b);
+  (config.*setMaximum)(a < b ? b : a);
+}
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  FuzzInput input(data, size);
+  BleControllerConfiguration config;
+
+  config.setControllerType(controllerTypes[input.byte() % 3]);
+  config.setHidReportId(input.range(1, 32));
+  config.setButtonCount(input.byte() % 129);
+  uint8_t axes = input.byte();
+  config.setWhichAxes(axes & 0x01, axes & 0x02, axes & 0x04, axes & 0x08,
+                      axes & 0x10, axes & 0x20, axes & 0x40, axes & 0x80);
+  uint8_t special = input.byte();
+  config.setWhichSpecialButtons(special & 0x01, special & 0x02, special & 0x04,
+                                special & 0x08, special & 0x10, special & 0x20,
+                                special & 0x40, special & 0x80);
+  uint8_t simulation = input.byte();
+  config.setWhichSimulationControls(simulation & 0x01, simulation & 0x02,
+                                    simulation & 0x04, simulation & 0x08,
+                                    simulation & 0x10);
+  config.setHatSwitchCount(input.range(0, 4));
+  config.setIncludeGyroscope(input.flag());
+  config.setIncludeAccelerometer(input.flag());
+
+  setRange(input, config, &BleControllerConfiguration::setAxesMin,
+           &BleControllerConfiguration::setAxesMax);
+  setRange(input, config, &BleControllerConfiguration::setSimulationMin,
+           &BleControllerConfiguration::setSimulationMax);
+  setRange(input, config, &BleControllerConfiguration::setMotionMin,
+           &BleControllerConfiguration::setMotionMax);
+  config.setAxesBits(valueBits[input.byte() % 4]);
+  config.setSimulationBits(valueBits[input.byte() % 4]);
+  config.setMotionBits(valueBits[input.byte() % 4]);
+  config.setHatBits(input.flag() ? 4 : 8);
+
+  for (uint8_t group = 0; group < FIELD_GROUPS; group++) {
+    config.setFieldGroupReportId(group, input.flag() ? input.range(1, 40) : 0);
+  }
+  config.setControllerCount(input.range(1, POSSIBLECONTROLLERS));
+  config.setEnableOutputReport(input.flag());
+  config.setOutputReportLength(input.range(1, 64));
+  config.setIncludeKeyboard(input.flag());
+  config.setIncludeMouse(input.flag());
+
+  std::string error =
+      checkControllerConfiguration(config, input.range(0, MAX_FEATURE_REPORTS));
+  if (!error.empty()) {
+    fprintf(stderr, "%s\n", error.c_str());
+    fflush(stderr);
+    abort();
+  }
+  return 0;
+}
+
+#ifndef BLE_FUZZ_LIBFUZZER
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) {
+      FILE *file = fopen(argv[i], "rb");
+      if (file == nullptr) {
+        perror(argv[i]);
+        return 1;
+      }
+      std::vector<uint8_t> data;
+      int c;
+      while ((c = fgetc(file)) != EOF) {
+        data.push_back(c);
+      }
+      fclose(file);
+      LLVMFuzzerTestOneInput(data.data(), data.size());
+    }
+    printf("%d input(s) ok\n", argc - 1);
+    return 0;
+  }
+
+  const char *runsValue = getenv("FUZZ_RUNS");
+  int runs = runsValue ? atoi(runsValue) : 2000;
+  uint32_t seed = 1;
+  uint8_t data[48];
+  for (int run = 0; run < runs; run++) {
+    for (uint8_t &byte : data) {
+      seed = seed * 1103515245 + 12345;
+      byte = seed >> 16;
+    }
+    LLVMFuzzerTestOneInput(data, sizeof(data));
+  }
+  printf("%d input(s) ok\n", runs);
+  fflush(stdout);
+  _Exit(0);
+}
+#endif
@@ -0,0 +1,431 @@
+// Golden report map and report sequences for every sketch in examples/.
+//
+// Each case repeats the example's BleControllerConfiguration, drives the same
+// fixed sequence of setter calls and records the report map and every report
+// notified after each step. The recording must match golden/data/<Example>.bin
+// byte for byte, so a change to begin() or the report path that alters what a
+// host receives shows up here.
+//
+//   cd test/host && pio run -e golden -t exec
+//
+// After an intended change, rewrite the files with GOLDEN_UPDATE=1 and review
+// the diff. GOLDEN_DIR overrides where the files are.
+
+#include <BleController.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Record types in a golden file. Each record is the type, the report ID, a
+// little-endian 16 bit length and that many bytes.
+#define RECORD_REPORT_MAP 0
+#define RECORD_STEP 1 // Marks the end of a step, without data
+#define RECORD_INPUT_REPORT 2
+
+struct GoldenCase {
+  const char *name;
+  void (*apply)(BleControllerConfiguration &config);
+  bool staticLayout; // examples/StaticLayout starts with beginStatic()
+};
+
+void defaultConfig(BleControllerConfiguration &config) { (void)config; }
+
+// examples/CharacteristicsConfiguration
+void characteristicsConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+  config.setControllerType(CONTROLLER_TYPE_CONTROLLER);
+  config.setVid(0xe502);
+  config.setPid(0xabcd);
+  config.setAxesMin(0x0000);
+  config.setAxesMax(0x7FFF);
+}
+
+// examples/DrivingControllerTest
+void drivingConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+  config.setControllerType(CONTROLLER_TYPE_CONTROLLER);
+  config.setButtonCount(10);
+  config.setWhichAxes(false, false, false, false, false, false, false, false);
+  config.setWhichSimulationControls(false, false, true, true, true);
+  config.setHatSwitchCount(0);
+  config.setSimulationMin(0x00);
+  config.setSimulationMax(0x7FFF);
+}
+
+// examples/FeatureReports
+void featureReportsConfig(BleControllerConfiguration &config) {
+  config.setButtonCount(0);
+  config.setWhichAxes(true, true, false, false, false, false, false, false);
+  config.setHatSwitchCount(0);
+}
+
+// examples/Fightstick
+void fightstickConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+  config.setWhichAxes(0, 0, 0, 0, 0, 0, 0, 0);
+  config.setButtonCount(11);
+  config.setHatSwitchCount(1);
+}
+
+// examples/FlightControllerTest
+void flightControllerConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+  config.setControllerType(CONTROLLER_TYPE_MULTI_AXIS);
+  config.setButtonCount(16);
+  config.setIncludeStart(true);
+  config.setIncludeSelect(true);
+  config.setWhichAxes(true, true, false, false, false, false, false, false);
+  config.setWhichSimulationControls(true, true, false, true, false);
+  config.setHatSwitchCount(0);
+  config.setAxesMin(0x8001);
+  config.setAxesMax(0x7FFF);
+  config.setSimulationMin(-255);
+  config.setSimulationMax(255);
+}
+
+// examples/IndividualAxes
+void individualAxesConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+  config.setButtonCount(128);
+  config.setHatSwitchCount(2);
+}
+
+// examples/Keypad4x4
+void keypadConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+}
+
+// examples/MotionController
+void motionControllerConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+  config.setControllerType(CONTROLLER_TYPE_MULTI_AXIS);
+  config.setButtonCount(28);
+  config.setWhichAxes(false, false, false, false, false, false, false, false);
+  config.setHatSwitchCount(0);
+  config.setIncludeGyroscope(true);
+  config.setIncludeAccelerometer(true);
+  config.setMotionMin(0x8000);
+  config.setMotionMax(0x7FFF);
+}
+
+// examples/MultiFunctionalHID
+void multiFunctionalConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+  config.setButtonCount(16);
+  config.setHatSwitchCount(2);
+  config.setAxesMax(32767);
+  config.setAxesMin(-32767);
+  config.setIncludeKeyboard(true);
+  config.setIncludeMouse(true);
+}
+
+// examples/MultipleButtons and examples/MultipleButtonsDebounce
+void multipleButtonsConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+  config.setButtonCount(10);
+}
+
+// examples/MultipleButtonsAndHats
+void multipleButtonsAndHatsConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+  config.setButtonCount(4);
+  config.setHatSwitchCount(1);
+}
+
+// examples/MultipleControllers. The report scheduler is left off: its ticks
+// depend on wall-clock time, and the reports it sends are the same.
+void multipleControllersConfig(BleControllerConfiguration &config) {
+  config.setHidReportId(4);
+  config.setControllerCount(2);
+  config.setButtonCount(4);
+  config.setWhichAxes(true, true, false, false, false, false, false, false);
+  config.setHatSwitchCount(0);
+}
+
+// examples/SimpleMultiHID
+void simpleMultiHidConfig(BleControllerConfiguration &config) {
+  config.setIncludeKeyboard(true);
+  config.setIncludeMouse(true);
+}
+
+// examples/SpecialButtons
+void specialButtonsConfig(BleControllerConfiguration &config) {
+  config.setWhichSpecialButtons(true, true, true, true, true, true, true, true);
+}
+
+// examples/StaticLayout, see beginStatic() below
+void staticLayoutConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+}
+
+// examples/TestAll
+void testAllConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+  config.setControllerType(CONTROLLER_TYPE_CONTROLLER);
+  config.setButtonCount(64);
+  config.setHatSwitchCount(4);
+  config.setVid(0xe502);
+  config.setPid(0xabcd);
+  config.setAxesMin(0x0000);
+  config.setAxesMax(0x7FFF);
+}
+
+// examples/TestReceivingOutputReport
+void outputReportConfig(BleControllerConfiguration &config) {
+  config.setAutoReport(false);
+  config.setControllerType(CONTROLLER_TYPE_CONTROLLER);
+  config.setEnableOutputReport(true);
+  config.setOutputReportLength(128);
+  config.setHidReportId(0x05);
+  config.setButtonCount(16);
+  config.setAxesMin(0x0000);
+  config.setAxesMax(0x7FFF);
+  config.setVid(0x1234);
+  config.setPid(0x0001);
+}
+
+const GoldenCase cases[] = {
+    {"CharacteristicsConfiguration", characteristicsConfig, false},
+    {"DrivingControllerTest", drivingConfig, false},
+    {"FeatureReports", featureReportsConfig, false},
+    {"Fightstick", fightstickConfig, false},
+    {"FlightControllerTest", flightControllerConfig, false},
+    {"ForcePairingMode", defaultConfig, false},
+    {"Gamepad", defaultConfig, false},
+    {"GetPeerInfo", defaultConfig, false},
+    {"IndividualAxes", individualAxesConfig, false},
+    {"Keypad4x4", keypadConfig, false},
+    {"MotionController", motionControllerConfig, false},
+    {"MultiFunctionalHID", multiFunctionalConfig, false},
+    {"MultipleButtons", multipleButtonsConfig, false},
+    {"MultipleButtonsAndHats", multipleButtonsAndHatsConfig, false},
+    {"MultipleButtonsDebounce", multipleButtonsConfig, false},
+    {"MultipleControllers", multipleControllersConfig, false},
+    {"PotAsAxis", defaultConfig, false},
+    {"SetBatteryLevel", defaultConfig, false},
+    {"SetBatteryPowerState", defaultConfig, false},
+    {"SimpleMultiHID", simpleMultiHidConfig, false},
+    {"SingleButton", defaultConfig, false},
+    {"SingleButtonDebounce", defaultConfig, false},
+    {"SpecialButtons", specialButtonsConfig, false},
+    {"StaticLayout", staticLayoutConfig, true},
+    {"TestAll", testAllConfig, false},
+    {"TestReceivingOutputReport", outputReportConfig, false},
+};
+
+typedef BleControllerLayout<8, LAYOUT_AXIS_X | LAYOUT_AXIS_Y, 1,
+                            LAYOUT_MOTION_GYROSCOPE>
+    StaticLayout;
+
+class Recorder {
+public:
+  std::vector<uint8_t> data;
+
+  void record(uint8_t type, uint8_t reportId, const std::vector<uint8_t> &bytes) {
+    data.push_back(type);
+    data.push_back(reportId);
+    data.push_back(bytes.size() & 0xFF);
+    data.push_back(bytes.size() >> 8);
+    data.insert(data.end(), bytes.begin(), bytes.end());
+  }
+
+  // New notifications of every input report since the previous step, in
+  // report ID order
+  void step() {
+    for (int reportId = 1; reportId <= 0xFF; reportId++) {
+      NimBLECharacteristic *input =
+          host::hidDevice()->findInputReport(reportId);
+      if (input == nullptr) {
+        continue;
+      }
+      for (const std::vector<uint8_t> &report : input->notifications) {
+        record(RECORD_INPUT_REPORT, reportId, report);
+      }
+      input->notifications.clear();
+    }
+    record(RECORD_STEP, 0, std::vector<uint8_t>());
+  }
+};
+
+// The same calls for every example; setters for fields an example does not
+// have must leave its reports alone
+std::vector<uint8_t> runCase(const GoldenCase &golden) {
+  host::resetStack();
+
+  // Leaked on purpose, the server task may still use it
+  BleController *controller = new BleController();
+  BleControllerConfiguration config;
+  golden.apply(config);
+  if (golden.staticLayout) {
+    controller->beginStatic<StaticLayout>(&config);
+  } else {
+    if (std::string(golden.name) == "FeatureReports") {
+      controller->addFeatureReport(5, 2, nullptr);
+      controller->addFeatureReport(6, 12, nullptr, true);
+    }
+    controller->begin(&config);
+  }
+  host::waitForServer()->hostConnect(247);
+
+  Recorder recorder;
+  recorder.record(RECORD_REPORT_MAP, 0, host::hidDevice()->reportMap);
+
+  for (uint8_t i = 0; i < controller->getControllerCount(); i++) {
+    BleController &player = controller->controller(i);
+    int16_t offset = i * 100;
+
+    player.sendReport();
+    recorder.step();
+
+    player.press(BUTTON_1);
+    player.press(BUTTON_4 + i);
+    player.sendReport();
+    recorder.step();
+
+    player.setAxes(1000 + offset, -1000, 0x3FFF, 0x7FFF, 300, -300, 12345,
+                   -12345);
+    player.sendReport();
+    recorder.step();
+
+    player.setSimulationControls(10, 200 + offset, 0x7FFF, 0, -255);
+    player.setHats(HAT_RIGHT, HAT_DOWN, HAT_LEFT, HAT_UP_LEFT);
+    player.sendReport();
+    recorder.step();
+
+    player.setMotionControls(-32768, 1 + offset, 32767, 4096, -4096, 17);
+    player.pressStart();
+    player.pressHome();
+    player.pressVolumeMute();
+    player.sendReport();
+    recorder.step();
+
+    // Nothing changed, so nothing is sent
+    player.sendReport();
+    recorder.step();
+
+    player.release(BUTTON_1);
+    player.setHat(HAT_CENTERED);
+    player.releaseStart();
+    player.sendReport();
+    recorder.step();
+  }
+
+  if (controller->getKeyboardReportId() != 0) {
+    controller->sendRawKeyboard(KEY_MOD_LSHIFT, 0x04, 0x05);
+    controller->sendRawKeyboard(0, 0);
+    recorder.step();
+  }
+  if (controller->getMouseReportId() != 0) {
+    controller->sendRawMouse(MOUSE_LEFT, 10, -10, 1);
+    controller->sendRawMouse(0, 0, 0, 0);
+    recorder.step();
+  }
+  return recorder.data;
+}
+
+std::string goldenPath(const char *name) {
+  const char *directory = getenv("GOLDEN_DIR");
+  if (directory != nullptr) {
+    return std::string(directory) + "/" + name + ".bin";
+  }
+  std::string file = __FILE__;
+  return file.substr(0, file.find_last_of('/') + 1) + "data/" + name + ".bin";
+}
+
+bool readFile(const std::string &path, std::vector<uint8_t> &data) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  data.clear();
+  int c;
+  while ((c = fgetc(file)) != EOF) {
+    data.push_back(c);
+  }
+  fclose(file);
+  return true;
+}
+
+bool writeFile(const std::string &path, const std::vector<uint8_t> &data) {
+  FILE *file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+  return fclose(file) == 0 && written;
+}
+
+// Prints the record holding the first differing byte of each recording
+void printRecordAt(const char *label, const std::vector<uint8_t> &data,
+                   size_t offset) {
+  size_t record = 0;
+  int step = 0;
+  while (record + 4 <= data.size()) {
+    size_t length = data[record + 2] | data[record + 3] << 8;
+    if (offset < record + 4 + length) {
+      break;
+    }
+    step += data[record] == RECORD_STEP;
+    record += 4 + length;
+  }
+  if (record + 4 > data.size()) {
+    printf("     %s: ends after step %d\n", label, step);
+    return;
+  }
+
+  size_t length = data[record + 2] | data[record + 3] << 8;
+  printf("     %s: step %d, type %d, report ID %d:", label, step, data[record],
+         data[record + 1]);
+  for (size_t i = 0; i < length && record + 4 + i < data.size(); i++) {
+    printf(" %02X", data[record + 4 + i]);
+  }
+  printf("\n");
+}
+
+} // namespace
+
+int main() {
+  bool update = getenv("GOLDEN_UPDATE") != nullptr;
+  int failures = 0;
+
+  for (const GoldenCase &golden : cases) {
+    std::vector<uint8_t> actual = runCase(golden);
+    std::string path = goldenPath(golden.name);
+
+    if (update) {
+      bool written = writeFile(path, actual);
+      printf("%s %s\n", written ? "wrote" : "FAIL ", path.c_str());
+      failures += !written;
+      continue;
+    }
+
+    std::vector<uint8_t> expected;
+    if (!readFile(path, expected)) {
+      printf("FAIL %s: cannot read %s\n", golden.name, path.c_str());
+      failures++;
+      continue;
+    }
+    if (actual == expected) {
+      printf("ok   %s\n", golden.name);
+      continue;
+    }
+
+    size_t offset = 0;
+    while (offset < actual.size() && offset < expected.size() &&
+           actual[offset] == expected[offset]) {
+      offset++;
+    }
+    printf("FAIL %s differs at byte %u\n", golden.name, (unsigned)offset);
+    printRecordAt("expected", expected, offset);
+    printRecordAt("actual  ", actual, offset);
+    failures++;
+  }
+
+  printf("%d failure(s)\n", failures);
+  fflush(stdout);
+  _Exit(failures == 0 ? 0 : 1);
+}
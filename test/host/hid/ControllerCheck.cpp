@@ -0,0 +1,284 @@
+#include "ControllerCheck.h"
+#include "HidDescriptorParser.h"
+
+#include <stdio.h>
+
+namespace {
+
+#define USAGE_PAGE(usage) ((usage) >> 16)
+#define USAGE_ID(usage) ((usage)&0xFFFF)
+
+#define PAGE_GENERIC_DESKTOP 0x01
+#define PAGE_SIMULATION 0x02
+#define PAGE_BUTTON 0x09
+#define PAGE_CONSUMER 0x0C
+#define USAGE_HAT_SWITCH 0x39
+#define USAGE_START 0x3D
+#define USAGE_SELECT 0x3E
+#define USAGE_APP_MENU 0x86
+
+BleFeatureReportCallbacks featureCallbacks;
+
+std::string format(const char *text, int a = 0, int b = 0, int c = 0,
+                   int d = 0) {
+  char buffer[160];
+  snprintf(buffer, sizeof(buffer), text, a, b, c, d);
+  return buffer;
+}
+
+// Controller state every controller is put in before its reports are read
+struct State {
+  const char *name;
+  bool atMaximum;
+  signed char hat;
+  bool specialButtons;
+  uint16_t pressed[3]; // Buttons, 0 for none
+};
+
+bool isPressed(const State &state, uint16_t button) {
+  for (uint16_t pressed : state.pressed) {
+    if (pressed == button && button != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void applyState(BleController &controller, const State &state) {
+  BleControllerConfiguration &config = controller.configuration;
+  int16_t axis = state.atMaximum ? config.getAxesMax() : config.getAxesMin();
+  int16_t simulation =
+      state.atMaximum ? config.getSimulationMax() : config.getSimulationMin();
+  int16_t motion =
+      state.atMaximum ? config.getMotionMax() : config.getMotionMin();
+
+  controller.setAxes(axis, axis, axis, axis, axis, axis, axis, axis);
+  controller.setSimulationControls(simulation, simulation, simulation,
+                                   simulation, simulation);
+  controller.setMotionControls(motion, motion, motion, motion, motion, motion);
+  controller.setHats(state.hat, state.hat, state.hat, state.hat);
+
+  controller.resetButtons();
+  for (uint16_t button : state.pressed) {
+    if (button != 0 && button <= config.getButtonCount()) {
+      controller.press(button);
+    }
+  }
+
+  const uint8_t specialButtons[] = {
+      START_BUTTON,      SELECT_BUTTON,     MENU_BUTTON,
+      HOME_BUTTON,       BACK_BUTTON,       VOLUME_INC_BUTTON,
+      VOLUME_DEC_BUTTON, VOLUME_MUTE_BUTTON};
+  for (uint8_t button : specialButtons) {
+    if (state.specialButtons) {
+      controller.pressSpecialButton(button);
+    } else {
+      controller.releaseSpecialButton(button);
+    }
+  }
+}
+
+// What the host should read for one element of a controller report, false if
+// the element is not something the check sets
+bool expectedValue(const HidField &field, uint32_t usage, const State &state,
+                   int32_t &expected) {
+  uint16_t page = USAGE_PAGE(usage);
+  uint16_t id = USAGE_ID(usage);
+
+  if (page == PAGE_BUTTON) {
+    expected = isPressed(state, id) ? 1 : 0;
+    return true;
+  }
+  if (page == PAGE_GENERIC_DESKTOP && id == USAGE_HAT_SWITCH) {
+    expected = state.hat;
+    return true;
+  }
+  if ((page == PAGE_GENERIC_DESKTOP &&
+       (id == USAGE_START || id == USAGE_SELECT || id == USAGE_APP_MENU)) ||
+      page == PAGE_CONSUMER) {
+    expected = state.specialButtons ? 1 : 0;
+    return true;
+  }
+  if (page == PAGE_GENERIC_DESKTOP || page == PAGE_SIMULATION) {
+    expected = state.atMaximum ? field.logicalMaximum : field.logicalMinimum;
+    return true;
+  }
+  return false;
+}
+
+std::string checkValues(const HidDescriptorParser &parser,
+                        const std::vector<uint8_t> &controllerReportIds,
+                        const State &state) {
+  for (uint8_t reportId : controllerReportIds) {
+    NimBLECharacteristic *input = host::hidDevice()->findInputReport(reportId);
+    if (input->notifications.empty()) {
+      return format("report ID %d: nothing sent", reportId);
+    }
+    const std::vector<uint8_t> &report = input->notifications.back();
+
+    for (const HidField &field : parser.getFields()) {
+      if (field.type != HID_PARSER_INPUT || field.reportId != reportId ||
+          field.isConstant()) {
+        continue;
+      }
+      for (uint16_t i = 0; i < field.count; i++) {
+        uint32_t usage = field.usage(i);
+        int32_t expected;
+        if (!expectedValue(field, usage, state, expected)) {
+          continue;
+        }
+        int32_t actual = HidDescriptorParser::extract(
+            report.data(), report.size(), field, i);
+        if (actual != expected) {
+          return std::string(state.name) +
+                 format(": report ID %d usage %04X: read %d, expected %d",
+                        reportId, USAGE_ID(usage), actual, expected);
+        }
+      }
+    }
+  }
+  return "";
+}
+
+} // namespace
+
+std::string
+checkControllerConfiguration(const BleControllerConfiguration &config,
+                             uint8_t featureReports) {
+  host::resetStack();
+
+  // Leaked on purpose, the server task may still use it
+  BleController *controller = new BleController();
+  for (uint8_t i = 0; i < featureReports; i++) {
+    controller->addFeatureReport(0xF0 + i, 1 + i * 7, &featureCallbacks,
+                                 i % 2 == 1);
+  }
+
+  // Reports are sent explicitly below, and no task may outlive the check
+  BleControllerConfiguration copy = config;
+  copy.setAutoReport(false);
+  copy.setEnableReportScheduler(false);
+  copy.setEnablePipeline(false);
+  copy.setEnableNordicUARTService(false);
+  controller->begin(&copy);
+  host::waitForServer()->hostConnect(247);
+
+  const std::vector<uint8_t> &map = host::hidDevice()->reportMap;
+  HidDescriptorParser parser;
+  if (!parser.parse(map.data(), map.size())) {
+    return "report map: " + parser.getError();
+  }
+
+  uint8_t keyboardReportId = controller->getKeyboardReportId();
+  uint8_t mouseReportId = controller->getMouseReportId();
+  uint8_t keyboardNkroReportId = controller->getKeyboardNkroReportId();
+  std::vector<uint8_t> controllerReportIds;
+  for (uint8_t reportId : parser.getReportIds(HID_PARSER_INPUT)) {
+    if (host::hidDevice()->findInputReport(reportId) == nullptr) {
+      return format("report ID %d: no input characteristic", reportId);
+    }
+    if (reportId != keyboardReportId && reportId != mouseReportId &&
+        reportId != keyboardNkroReportId) {
+      controllerReportIds.push_back(reportId);
+    }
+  }
+  if (keyboardReportId != 0 &&
+      parser.getReportSize(keyboardReportId, HID_PARSER_INPUT) !=
+          sizeof(keyboard_report_t)) {
+    return format("keyboard report ID %d: described as %d bytes",
+                  keyboardReportId,
+                  parser.getReportSize(keyboardReportId, HID_PARSER_INPUT));
+  }
+  if (mouseReportId != 0 &&
+      parser.getReportSize(mouseReportId, HID_PARSER_INPUT) !=
+          sizeof(mouse_report_t)) {
+    return format("mouse report ID %d: described as %d bytes", mouseReportId,
+                  parser.getReportSize(mouseReportId, HID_PARSER_INPUT));
+  }
+  if (keyboardNkroReportId != 0 &&
+      parser.getReportSize(keyboardNkroReportId, HID_PARSER_INPUT) !=
+          sizeof(keyboard_nkro_report_t)) {
+    return format(
+        "N-key rollover report ID %d: described as %d bytes",
+        keyboardNkroReportId,
+        parser.getReportSize(keyboardNkroReportId, HID_PARSER_INPUT));
+  }
+
+  BleControllerConfiguration &active = controller->configuration;
+  std::vector<uint8_t> outputReportIds =
+      parser.getReportIds(HID_PARSER_OUTPUT);
+  if (active.getEnableOutputReport()) {
+    uint16_t size =
+        parser.getReportSize(active.getHidReportId(), HID_PARSER_OUTPUT);
+    if (outputReportIds.size() != 1 ||
+        size != active.getOutputReportLength()) {
+      return format("output report: described as %d bytes, expected %d",
+                    size, active.getOutputReportLength());
+    }
+  } else if (!outputReportIds.empty()) {
+    return "output report described but not enabled";
+  }
+
+  if (parser.getReportIds(HID_PARSER_FEATURE).size() != featureReports) {
+    return format("%d feature reports described, expected %d",
+                  parser.getReportIds(HID_PARSER_FEATURE).size(),
+                  featureReports);
+  }
+  for (uint8_t i = 0; i < featureReports; i++) {
+    uint16_t size = parser.getReportSize(0xF0 + i, HID_PARSER_FEATURE);
+    if (size != 1 + i * 7) {
+      return format("feature report ID %d: described as %d bytes, expected %d",
+                    0xF0 + i, size, 1 + i * 7);
+    }
+  }
+
+  const State states[] = {
+      {"maximum", true, HAT_DOWN_LEFT, true, {1, 9, 128}},
+      {"minimum", false, HAT_UP_RIGHT, false, {2, 16, 64}},
+      {"centered", true, HAT_CENTERED, true, {0, 0, 0}},
+  };
+  for (const State &state : states) {
+    for (uint8_t i = 0; i < controller->getControllerCount(); i++) {
+      applyState(controller->controller(i), state);
+      controller->controller(i).sendReport();
+    }
+    std::string error = checkValues(parser, controllerReportIds, state);
+    if (!error.empty()) {
+      return error;
+    }
+  }
+
+  if (keyboardReportId != 0) {
+    controller->sendRawKeyboard(KEY_MOD_LSHIFT, 0x04);
+  }
+  if (mouseReportId != 0) {
+    controller->sendRawMouse(MOUSE_LEFT, 1, -1, 1);
+  }
+  if (keyboardNkroReportId != 0) {
+    controller->keyboardPress(0x04);
+  }
+
+  // Every notification of every report, including the first ones sent on
+  // connect, has the length the report map describes
+  for (uint8_t reportId : parser.getReportIds(HID_PARSER_INPUT)) {
+    NimBLECharacteristic *input = host::hidDevice()->findInputReport(reportId);
+    if (input->notifications.empty()) {
+      return format("report ID %d: nothing sent", reportId);
+    }
+    uint16_t size = parser.getReportSize(reportId, HID_PARSER_INPUT);
+    for (const std::vector<uint8_t> &report : input->notifications) {
+      if (report.size() != size) {
+        return format("report ID %d: sent %d bytes, described as %d",
+                      reportId, report.size(), size);
+      }
+    }
+
+    // A host reading the input report gets the last one notified
+    const std::vector<uint8_t> &last = input->notifications.back();
+    if (input->getValue() != std::string(last.begin(), last.end())) {
+      return format("report ID %d: value differs from the last notification",
+                    reportId);
+    }
+  }
+  return "";
+}
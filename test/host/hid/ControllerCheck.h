@@ -0,0 +1,18 @@
+#ifndef CONTROLLER_CHECK_H
+#define CONTROLLER_CHECK_H
+
+#include <BleController.h>
+
+#include <string>
+
+// Starts a controller with config on the stub stack and checks the report map
+// it writes against the reports it sends: every report ID the descriptor
+// declares must be notified with exactly the described length, and every
+// described button, hat and value must read back what the setters stored.
+// featureReports adds that many feature reports before begin().
+//
+// Returns an empty string if everything matches, otherwise what did not.
+std::string checkControllerConfiguration(
+    const BleControllerConfiguration &config, uint8_t featureReports = 0);
+
+#endif // CONTROLLER_CHECK_H
@@ -0,0 +1,297 @@
+#include "HidDescriptorParser.h"
+
+#include <stdio.h>
+
+// Item tags with the size bits cleared (HID 1.11, 6.2.2)
+#define ITEM_INPUT 0x80
+#define ITEM_OUTPUT 0x90
+#define ITEM_COLLECTION 0xA0
+#define ITEM_FEATURE 0xB0
+#define ITEM_END_COLLECTION 0xC0
+#define ITEM_USAGE_PAGE 0x04
+#define ITEM_LOGICAL_MINIMUM 0x14
+#define ITEM_LOGICAL_MAXIMUM 0x24
+#define ITEM_PHYSICAL_MINIMUM 0x34
+#define ITEM_PHYSICAL_MAXIMUM 0x44
+#define ITEM_UNIT_EXPONENT 0x54
+#define ITEM_UNIT 0x64
+#define ITEM_REPORT_SIZE 0x74
+#define ITEM_REPORT_ID 0x84
+#define ITEM_REPORT_COUNT 0x94
+#define ITEM_PUSH 0xA4
+#define ITEM_POP 0xB4
+#define ITEM_USAGE 0x08
+#define ITEM_USAGE_MINIMUM 0x18
+#define ITEM_USAGE_MAXIMUM 0x28
+#define ITEM_LONG 0xFE
+
+// Far more than any report of this library, but keeps a hostile descriptor
+// from allocating without bound
+#define MAX_USAGES 1024
+#define MAX_REPORT_BITS (4096 * 8)
+
+uint32_t HidField::usage(uint16_t index) const {
+  if (usages.empty()) {
+    return 0;
+  }
+  return index < usages.size() ? usages[index] : usages.back();
+}
+
+bool HidDescriptorParser::fail(size_t offset, const char *message) {
+  char text[96];
+  snprintf(text, sizeof(text), "offset %u: %s", (unsigned)offset, message);
+  error = text;
+  return false;
+}
+
+HidDescriptorParser::ReportBits &
+HidDescriptorParser::findReport(uint8_t reportId) {
+  for (ReportBits &report : reports) {
+    if (report.reportId == reportId) {
+      return report;
+    }
+  }
+  ReportBits report = {reportId, {0, 0, 0}};
+  reports.push_back(report);
+  return reports.back();
+}
+
+bool HidDescriptorParser::parse(const uint8_t *descriptor, size_t size) {
+  fields.clear();
+  reports.clear();
+  error.clear();
+
+  Globals globals = {};
+  std::vector<Globals> globalStack;
+  std::vector<uint32_t> usages;
+  bool hasUsageMinimum = false;
+  uint32_t usageMinimum = 0;
+  int collectionDepth = 0;
+  bool usesReportIds = false;
+  bool hasMainItems = false;
+
+  size_t offset = 0;
+  while (offset < size) {
+    size_t itemOffset = offset;
+    uint8_t prefix = descriptor[offset++];
+
+    if (prefix == ITEM_LONG) {
+      if (offset + 2 > size) {
+        return fail(itemOffset, "truncated long item");
+      }
+      offset += 2 + descriptor[offset];
+      if (offset > size) {
+        return fail(itemOffset, "truncated long item");
+      }
+      continue;
+    }
+
+    uint8_t dataSize = prefix & 0x03;
+    if (dataSize == 3) {
+      dataSize = 4;
+    }
+    if (offset + dataSize > size) {
+      return fail(itemOffset, "truncated item");
+    }
+
+    uint32_t data = 0;
+    for (uint8_t i = 0; i < dataSize; i++) {
+      data |= (uint32_t)descriptor[offset + i] << (8 * i);
+    }
+    offset += dataSize;
+
+    // Signed interpretation for minimum and maximum items
+    int32_t value = (int32_t)data;
+    if (dataSize == 1) {
+      value = (int8_t)data;
+    } else if (dataSize == 2) {
+      value = (int16_t)data;
+    }
+
+    uint8_t tag = prefix & 0xFC;
+    switch (tag) {
+    case ITEM_INPUT:
+    case ITEM_OUTPUT:
+    case ITEM_FEATURE: {
+      if (!globals.hasReportSize || !globals.hasReportCount) {
+        return fail(itemOffset, "main item before Report Size and Count");
+      }
+      if (collectionDepth == 0) {
+        return fail(itemOffset, "main item outside a collection");
+      }
+      if (hasMainItems && usesReportIds != (globals.reportId != 0)) {
+        return fail(itemOffset, "reports with and without a Report ID");
+      }
+      usesReportIds = globals.reportId != 0;
+      hasMainItems = true;
+
+      HidField field;
+      field.type = tag == ITEM_INPUT    ? HID_PARSER_INPUT
+                   : tag == ITEM_OUTPUT ? HID_PARSER_OUTPUT
+                                        : HID_PARSER_FEATURE;
+      field.reportId = globals.reportId;
+      field.bitSize = globals.reportSize;
+      field.count = globals.reportCount;
+      field.flags = data & 0xFF;
+      field.logicalMinimum = globals.logicalMinimum;
+      field.logicalMaximum = globals.logicalMaximum;
+      field.usages = usages;
+
+      if (!field.isConstant() && field.bitSize > 0 &&
+          field.logicalMinimum > field.logicalMaximum) {
+        return fail(itemOffset, "Logical Minimum above Logical Maximum");
+      }
+
+      ReportBits &report = findReport(field.reportId);
+      field.bitOffset = report.bits[field.type];
+      report.bits[field.type] += (uint32_t)field.bitSize * field.count;
+      if (report.bits[field.type] > MAX_REPORT_BITS) {
+        return fail(itemOffset, "report too long");
+      }
+      fields.push_back(field);
+
+      usages.clear();
+      hasUsageMinimum = false;
+      break;
+    }
+
+    case ITEM_COLLECTION:
+      collectionDepth++;
+      usages.clear();
+      hasUsageMinimum = false;
+      break;
+
+    case ITEM_END_COLLECTION:
+      if (collectionDepth == 0) {
+        return fail(itemOffset, "End Collection without a collection");
+      }
+      collectionDepth--;
+      break;
+
+    case ITEM_USAGE_PAGE:
+      globals.usagePage = data & 0xFFFF;
+      break;
+    case ITEM_LOGICAL_MINIMUM:
+      globals.logicalMinimum = value;
+      break;
+    case ITEM_LOGICAL_MAXIMUM:
+      globals.logicalMaximum = value;
+      break;
+    case ITEM_PHYSICAL_MINIMUM:
+    case ITEM_PHYSICAL_MAXIMUM:
+    case ITEM_UNIT_EXPONENT:
+    case ITEM_UNIT:
+      break;
+    case ITEM_REPORT_SIZE:
+      if (data == 0 || data > 32) {
+        return fail(itemOffset, "Report Size outside 1..32");
+      }
+      globals.reportSize = data;
+      globals.hasReportSize = true;
+      break;
+    case ITEM_REPORT_ID:
+      if (data == 0 || data > 0xFF) {
+        return fail(itemOffset, "Report ID outside 1..255");
+      }
+      globals.reportId = data;
+      break;
+    case ITEM_REPORT_COUNT:
+      if (data > 0xFFFF) {
+        return fail(itemOffset, "Report Count too large");
+      }
+      globals.reportCount = data;
+      globals.hasReportCount = true;
+      break;
+    case ITEM_PUSH:
+      globalStack.push_back(globals);
+      break;
+    case ITEM_POP:
+      if (globalStack.empty()) {
+        return fail(itemOffset, "Pop without Push");
+      }
+      globals = globalStack.back();
+      globalStack.pop_back();
+      break;
+
+    case ITEM_USAGE:
+      if (usages.size() == MAX_USAGES) {
+        return fail(itemOffset, "too many usages");
+      }
+      usages.push_back(dataSize == 4 ? data
+                                     : (uint32_t)globals.usagePage << 16 |
+                                           (data & 0xFFFF));
+      break;
+    case ITEM_USAGE_MINIMUM:
+      usageMinimum =
+          dataSize == 4 ? data : (uint32_t)globals.usagePage << 16 | data;
+      hasUsageMinimum = true;
+      break;
+    case ITEM_USAGE_MAXIMUM: {
+      uint32_t usageMaximum =
+          dataSize == 4 ? data : (uint32_t)globals.usagePage << 16 | data;
+      if (!hasUsageMinimum || usageMaximum < usageMinimum) {
+        return fail(itemOffset, "Usage Maximum without a lower minimum");
+      }
+      if (usageMaximum - usageMinimum >= MAX_USAGES - usages.size()) {
+        return fail(itemOffset, "too many usages");
+      }
+      for (uint32_t usage = usageMinimum; usage <= usageMaximum; usage++) {
+        usages.push_back(usage);
+      }
+      hasUsageMinimum = false;
+      break;
+    }
+
+    default:
+      return fail(itemOffset, "unknown item");
+    }
+  }
+
+  if (collectionDepth != 0) {
+    return fail(size, "unclosed collection");
+  }
+  return true;
+}
+
+std::vector<uint8_t> HidDescriptorParser::getReportIds(uint8_t type) const {
+  std::vector<uint8_t> reportIds;
+  for (const ReportBits &report : reports) {
+    if (type <= HID_PARSER_FEATURE && report.bits[type] > 0) {
+      reportIds.push_back(report.reportId);
+    }
+  }
+  return reportIds;
+}
+
+uint32_t HidDescriptorParser::getReportBits(uint8_t reportId,
+                                            uint8_t type) const {
+  for (const ReportBits &report : reports) {
+    if (report.reportId == reportId && type <= HID_PARSER_FEATURE) {
+      return report.bits[type];
+    }
+  }
+  return 0;
+}
+
+uint16_t HidDescriptorParser::getReportSize(uint8_t reportId,
+                                            uint8_t type) const {
+  return (getReportBits(reportId, type) + 7) / 8;
+}
+
+int32_t HidDescriptorParser::extract(const uint8_t *report, size_t size,
+                                     const HidField &field, uint16_t index) {
+  uint32_t bitOffset = field.bitOffset + (uint32_t)index * field.bitSize;
+  uint32_t value = 0;
+  for (uint8_t i = 0; i < field.bitSize; i++) {
+    uint32_t bit = bitOffset + i;
+    if (bit / 8 < size && (report[bit / 8] >> (bit % 8) & 1)) {
+      value |= 1UL << i;
+    }
+  }
+
+  if (field.logicalMinimum < 0 && field.bitSize < 32 &&
+      (value >> (field.bitSize - 1) & 1)) {
+    value |= ~0UL << field.bitSize;
+  }
+  return (int32_t)value;
+}
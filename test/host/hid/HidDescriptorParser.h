@@ -0,0 +1,77 @@
+#ifndef HID_DESCRIPTOR_PARSER_H
+#define HID_DESCRIPTOR_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Report types, the same values as the builder's HID_REPORT_*
+#define HID_PARSER_INPUT 0
+#define HID_PARSER_OUTPUT 1
+#define HID_PARSER_FEATURE 2
+
+// One Input, Output or Feature main item
+struct HidField {
+  uint8_t type; // HID_PARSER_*
+  uint8_t reportId;
+  uint32_t bitOffset; // From the first byte after the report ID
+  uint8_t bitSize;
+  uint16_t count;
+  uint8_t flags;
+  int32_t logicalMinimum;
+  int32_t logicalMaximum;
+  // (usage page << 16) | usage of each element. Elements past the last usage
+  // repeat it; empty for padding.
+  std::vector<uint32_t> usages;
+
+  bool isConstant() const { return (flags & 0x01) != 0; }
+  uint32_t usage(uint16_t index) const;
+};
+
+// Reads a HID report descriptor the way a host does, independently of
+// BleHidDescriptorBuilder, and works out every report's layout from it.
+// parse() stops at the first item a host would reject.
+class HidDescriptorParser {
+public:
+  bool parse(const uint8_t *descriptor, size_t size);
+  const std::string &getError() const { return error; }
+
+  const std::vector<HidField> &getFields() const { return fields; }
+  // Report IDs with at least one field of the given type, in first use order
+  std::vector<uint8_t> getReportIds(uint8_t type) const;
+  uint32_t getReportBits(uint8_t reportId, uint8_t type) const;
+  // Bytes without the report ID, as notified over HID over GATT
+  uint16_t getReportSize(uint8_t reportId, uint8_t type) const;
+
+  // Element index of a field in report, sign extended when the field's
+  // logical minimum is negative
+  static int32_t extract(const uint8_t *report, size_t size,
+                         const HidField &field, uint16_t index);
+
+private:
+  struct Globals {
+    uint16_t usagePage;
+    int32_t logicalMinimum;
+    int32_t logicalMaximum;
+    uint8_t reportSize;
+    uint16_t reportCount;
+    uint8_t reportId;
+    bool hasReportSize;
+    bool hasReportCount;
+  };
+
+  struct ReportBits {
+    uint8_t reportId;
+    uint32_t bits[3];
+  };
+
+  std::vector<HidField> fields;
+  std::vector<ReportBits> reports;
+  std::string error;
+
+  bool fail(size_t offset, const char *message);
+  ReportBits &findReport(uint8_t reportId);
+};
+
+#endif // HID_DESCRIPTOR_PARSER_H
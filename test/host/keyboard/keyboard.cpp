@@ -0,0 +1,628 @@
+// Checks the keyboard against the stub NimBLE layer: text is typed by the
+// library's typing task and decoded back from the notified keyboard reports.
+//
+//   cd test/host && pio run -e keyboard -t exec
+
+#include <BleController.h>
+#include <BleKeyboardKeys.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char *what) {
+  printf("%s %s\n", condition ? "ok  " : "FAIL", what);
+  if (!condition) {
+    failures++;
+  }
+}
+
+std::atomic<int> completions(0);
+
+void onTypingComplete() { completions++; }
+
+struct Keyboard {
+  BleController controller;
+  NimBLECharacteristic *input;
+
+  explicit Keyboard(uint8_t typingDelay, uint16_t queueDepth = 128,
+                    bool rollover = false,
+                    const keyboard_layout_t *layout = &keyboardLayoutUS) {
+    host::resetStack();
+    BleControllerConfiguration config;
+    config.setAutoReport(false);
+    config.setIncludeKeyboard(true);
+    config.setTypingDelay(typingDelay);
+    config.setTypingQueueDepth(queueDepth);
+    config.setTypingRollover(rollover);
+    config.setKeyboardLayout(layout);
+    controller.begin(&config);
+    host::waitForServer()->hostConnect();
+    input = host::hidDevice()->findInputReport(
+        controller.getKeyboardReportId());
+    controller.setTypingCompleteCallback(onTypingComplete);
+  }
+
+  // Milliseconds to type text, from the first keyboardWrite() call until the
+  // last key is released
+  unsigned long type(const char *text) {
+    unsigned long start = millis();
+    keyboardWriteAll(text);
+    waitForTyping(10000);
+    return millis() - start;
+  }
+
+  void keyboardWriteAll(const char *text) {
+    size_t written = 0;
+    while (text[written] != '\0' && waitForTyping(10000)) {
+      written += controller.keyboardWrite(text + written);
+    }
+  }
+
+  bool waitForTyping(unsigned long timeoutMs) {
+    unsigned long start = millis();
+    while (controller.isTyping()) {
+      if (millis() - start > timeoutMs) {
+        return false;
+      }
+      delay(1);
+    }
+    return true;
+  }
+};
+
+// What a US host makes of the notified reports: a character for every key
+// that goes down, shifted if a shift modifier is held
+std::string decode(const std::vector<std::vector<uint8_t>> &reports) {
+  std::map<uint16_t, char> characters;
+  for (int c = 127; c > 0; c--) {
+    uint8_t usage = asciiToHID((char)c);
+    if (usage != 0) {
+      characters[(needsShift((char)c) ? 0x100 : 0) | usage] = (char)c;
+    }
+  }
+
+  std::string text;
+  uint8_t previous[6] = {0};
+  for (const std::vector<uint8_t> &report : reports) {
+    bool shift = (report[0] & (KEY_MOD_LSHIFT | KEY_MOD_RSHIFT)) != 0;
+    for (int i = 2; i < 8; i++) {
+      uint8_t usage = report[i];
+      bool held = false;
+      for (int j = 0; j < 6; j++) {
+        held = held || (usage != 0 && previous[j] == usage);
+      }
+      if (usage != 0 && !held) {
+        std::map<uint16_t, char>::iterator found =
+            characters.find((shift ? 0x100 : 0) | usage);
+        text += found != characters.end() ? found->second : '?';
+      }
+    }
+    memcpy(previous, &report[2], sizeof(previous));
+  }
+  return text;
+}
+
+// Keys that go down in a report, compared with the report before it
+int newKeys(const std::vector<uint8_t> &previous,
+            const std::vector<uint8_t> &report) {
+  int count = 0;
+  for (int i = 2; i < 8; i++) {
+    bool held = false;
+    for (int j = 2; j < 8; j++) {
+      held = held || previous[j] == report[i];
+    }
+    count += report[i] != 0 && !held;
+  }
+  return count;
+}
+
+// Every key that goes down, as LAYOUT_KEY(usage, modifiers)
+std::vector<uint16_t> pressedKeys(
+    const std::vector<std::vector<uint8_t>> &reports) {
+  std::vector<uint16_t> keys;
+  std::vector<uint8_t> previous(8, 0);
+  for (const std::vector<uint8_t> &report : reports) {
+    for (int i = 2; i < 8; i++) {
+      bool held = false;
+      for (int j = 2; j < 8; j++) {
+        held = held || previous[j] == report[i];
+      }
+      if (report[i] != 0 && !held) {
+        keys.push_back(LAYOUT_KEY(report[i], report[0]));
+      }
+    }
+    previous = report;
+  }
+  return keys;
+}
+
+void testTyping() {
+  Keyboard &keyboard = *new Keyboard(15);
+  const char *text = "Hello, World!\n";
+
+  unsigned long start = millis();
+  size_t written = keyboard.controller.keyboardWrite(text);
+  unsigned long elapsed = millis() - start;
+
+  check(written == strlen(text), "keyboardWrite() queues the whole string");
+  check(elapsed < 15, "keyboardWrite() returns before the text is typed");
+  check(keyboard.controller.isTyping(), "isTyping() while keys are queued");
+
+  // A controller report is not held up by the typing
+  keyboard.controller.setX(1000);
+  keyboard.controller.sendReport();
+  NimBLECharacteristic *controllerInput = host::hidDevice()->findInputReport(
+      keyboard.controller.configuration.getHidReportId());
+  check(!controllerInput->notifications.empty(),
+        "controller report sent while typing");
+
+  check(keyboard.waitForTyping(2000), "typing finishes");
+  check(keyboard.controller.getTypingQueueCount() == 0, "queue drained");
+  check(completions == 1, "completion callback runs once");
+  check(decode(keyboard.input->notifications) == text,
+        "host receives the typed text");
+  check(keyboard.input->notifications.size() == 2 * strlen(text),
+        "each character is one press and one release report");
+}
+
+void testQueueFull() {
+  Keyboard &keyboard = *new Keyboard(20, 8);
+  check(keyboard.controller.getTypingQueueCapacity() == 0,
+        "typing queue is created on first use");
+
+  const char *text = "abcdefghijklmnopqrstuvwxyz";
+  size_t written = keyboard.controller.keyboardWrite(text);
+  check(keyboard.controller.getTypingQueueCapacity() == 8,
+        "typing queue has the configured depth");
+  check(written >= 8 && written < strlen(text),
+        "a full queue takes only the characters that fit");
+
+  keyboard.keyboardWriteAll(text + written);
+  check(keyboard.waitForTyping(2000), "the rest is typed too");
+  check(decode(keyboard.input->notifications) == text,
+        "nothing is lost or typed twice");
+}
+
+void testRollover() {
+  const char *text = "the quick brown fox jumps over the lazy dog\n"
+                     "Hello, World! 0123456789 ABCDEF abcdef\n";
+
+  Keyboard &plain = *new Keyboard(15);
+  unsigned long plainTime = plain.type(text);
+  size_t plainReports = plain.input->notifications.size();
+
+  Keyboard &rollover = *new Keyboard(0, 128, true);
+  unsigned long rolloverTime = rollover.type(text);
+  const std::vector<std::vector<uint8_t>> &reports =
+      rollover.input->notifications;
+
+  check(decode(reports) == text, "rollover typing gives the same text");
+  check(reports.size() * 3 < plainReports * 2,
+        "rollover typing needs fewer than 2/3 of the reports");
+  check(rolloverTime * 2 < plainTime,
+        "rollover typing at the connection interval is over twice as fast");
+
+  bool oneKeyPerReport = true;
+  bool releasedOnShift = true;
+  std::vector<uint8_t> previous(8, 0);
+  for (const std::vector<uint8_t> &report : reports) {
+    oneKeyPerReport = oneKeyPerReport && newKeys(previous, report) <= 1;
+    if (report[0] != previous[0]) {
+      for (int i = 2; i < 8; i++) {
+        bool held = false;
+        for (int j = 2; j < 8; j++) {
+          held = held || (report[i] != 0 && previous[j] == report[i]);
+        }
+        releasedOnShift = releasedOnShift && !held;
+      }
+    }
+    previous = report;
+  }
+  check(oneKeyPerReport, "each report presses at most one new key");
+  check(releasedOnShift, "no key is held across a modifier change");
+  check(reports.back() == std::vector<uint8_t>(8, 0),
+        "all keys are released at the end");
+}
+
+struct LayoutCase {
+  const keyboard_layout_t *layout;
+  const char *text;
+  std::vector<uint16_t> keys;
+};
+
+#define SHIFT 0x02
+#define ALTGR 0x40
+
+void testLayouts() {
+  const LayoutCase cases[] = {
+      {&keyboardLayoutUS,
+       "aA1!",
+       {LAYOUT_KEY(0x04, 0), LAYOUT_KEY(0x04, SHIFT), LAYOUT_KEY(0x1E, 0),
+        LAYOUT_KEY(0x1E, SHIFT)}},
+      {&keyboardLayoutUK,
+       "\"@#\xC2\xA3", // "@#£
+       {LAYOUT_KEY(0x1F, SHIFT), LAYOUT_KEY(0x34, SHIFT), LAYOUT_KEY(0x32, 0),
+        LAYOUT_KEY(0x20, SHIFT)}},
+      {&keyboardLayoutDE,
+       "yz@\xC3\xA4^\xC3\xA9\xE2\x82\xAC", // yz@ä^é€
+       {LAYOUT_KEY(0x1D, 0), LAYOUT_KEY(0x1C, 0), LAYOUT_KEY(0x14, ALTGR),
+        LAYOUT_KEY(0x34, 0), LAYOUT_KEY(0x35, 0), LAYOUT_KEY(0x2C, 0),
+        LAYOUT_KEY(0x2E, 0), LAYOUT_KEY(0x08, 0), LAYOUT_KEY(0x08, ALTGR)}},
+      {&keyboardLayoutFR,
+       "aqm1&\xC3\xAA", // aqm1&ê
+       {LAYOUT_KEY(0x14, 0), LAYOUT_KEY(0x04, 0), LAYOUT_KEY(0x33, 0),
+        LAYOUT_KEY(0x1E, SHIFT), LAYOUT_KEY(0x1E, 0), LAYOUT_KEY(0x2F, 0),
+        LAYOUT_KEY(0x08, 0)}},
+      {&keyboardLayoutNordic,
+       "\xC3\xA5~\xC3\xBC@", // å~ü@
+       {LAYOUT_KEY(0x2F, 0), LAYOUT_KEY(0x30, ALTGR), LAYOUT_KEY(0x2C, 0),
+        LAYOUT_KEY(0x30, 0), LAYOUT_KEY(0x18, 0), LAYOUT_KEY(0x1F, ALTGR)}},
+      // Neither has a key on the US layout
+      {&keyboardLayoutUS, "\xE2\x82\xAC\xF0\x9F\x98\x80", {}}, // €😀
+  };
+
+  bool matches = true;
+  for (const LayoutCase &test : cases) {
+    std::vector<uint16_t> keys;
+    for (const char *c = test.text; *c != '\0';) {
+      uint32_t codepoint;
+      c += decodeUtf8(c, &codepoint);
+      uint16_t characterKeys[LAYOUT_MAX_KEYS];
+      uint8_t count =
+          keyboardLayoutKeys(test.layout, codepoint, characterKeys);
+      for (uint8_t i = 0; i < count; i++) {
+        keys.push_back(characterKeys[i] & ~LAYOUT_DEAD);
+      }
+    }
+    if (keys != test.keys) {
+      printf("     %s: %s\n", test.layout->name, test.text);
+      matches = false;
+    }
+  }
+  check(matches, "layouts translate characters and dead keys");
+
+  const keyboard_layout_t *layouts[] = {&keyboardLayoutUS, &keyboardLayoutUK,
+                                        &keyboardLayoutDE, &keyboardLayoutFR,
+                                        &keyboardLayoutNordic};
+  bool complete = true;
+  bool distinct = true;
+  bool sorted = true;
+  for (const keyboard_layout_t *layout : layouts) {
+    std::map<uint16_t, char> used;
+    for (int c = 0x20; c < 0x7F; c++) {
+      uint16_t key = layout->ascii[c];
+      complete = complete && key != 0;
+      distinct = distinct && used.count(key) == 0;
+      used[key] = (char)c;
+    }
+    for (uint8_t i = 1; i < layout->keyCount; i++) {
+      sorted = sorted &&
+               layout->keys[i - 1].codepoint < layout->keys[i].codepoint;
+    }
+  }
+  check(complete, "every layout types all printable ASCII");
+  check(distinct, "no two ASCII characters share a key");
+  check(sorted, "layout keys are sorted by code point");
+}
+
+void testUtf8() {
+  struct {
+    const char *text;
+    uint32_t codepoint;
+    uint8_t length;
+  } cases[] = {
+      {"a", 'a', 1},
+      {"\xC3\xA9", 0xE9, 2},
+      {"\xE2\x82\xAC", 0x20AC, 3},
+      {"\xF0\x9F\x98\x80", 0x1F600, 4},
+      {"\xC3" "a", 0xFFFD, 1},         // Missing continuation byte
+      {"\xE2\x82", 0xFFFD, 1},         // Cut off by the end of the string
+      {"\xC0\xAF", 0xFFFD, 1},         // Overlong '/'
+      {"\xED\xA0\x80", 0xFFFD, 1},     // Surrogate
+      {"\xF4\x90\x80\x80", 0xFFFD, 1}, // Past U+10FFFF
+      {"\x80", 0xFFFD, 1},
+  };
+
+  bool decoded = true;
+  for (const auto &test : cases) {
+    uint32_t codepoint;
+    uint8_t length = decodeUtf8(test.text, &codepoint);
+    decoded = decoded && codepoint == test.codepoint && length == test.length;
+  }
+  check(decoded, "UTF-8 decodes and rejects malformed sequences");
+}
+
+// German layout with rollover: multi-byte characters and a dead key, which is
+// released before the next key goes down
+void testLayoutTyping() {
+  Keyboard &keyboard = *new Keyboard(1, 128, true, &keyboardLayoutDE);
+  const char *text = "Gr\xC3\xBC\xC3\x9F" "e ^_^"; // Grüße ^_^
+
+  check(keyboard.controller.keyboardWrite(text) == strlen(text),
+        "keyboardWrite() counts bytes of UTF-8 text");
+  check(keyboard.waitForTyping(2000), "typing finishes");
+
+  const std::vector<uint16_t> expected = {
+      LAYOUT_KEY(0x0A, SHIFT), LAYOUT_KEY(0x15, 0), LAYOUT_KEY(0x2F, 0),
+      LAYOUT_KEY(0x2D, 0),     LAYOUT_KEY(0x08, 0), LAYOUT_KEY(0x2C, 0),
+      LAYOUT_KEY(0x35, 0),     LAYOUT_KEY(0x2C, 0), LAYOUT_KEY(0x38, SHIFT),
+      LAYOUT_KEY(0x35, 0),     LAYOUT_KEY(0x2C, 0)};
+  const std::vector<std::vector<uint8_t>> &reports =
+      keyboard.input->notifications;
+  check(pressedKeys(reports) == expected, "host receives the German keys");
+
+  bool deadReleased = true;
+  for (size_t i = 0; i + 1 < reports.size(); i++) {
+    if (reports[i][2] == 0x35) {
+      deadReleased = deadReleased && reports[i + 1][2] == 0;
+    }
+  }
+  check(deadReleased, "dead key is released before the next key");
+
+
+  // Each ^ takes two keys, and the queue has room for two to three
+  Keyboard &partial = *new Keyboard(20, 2, false, &keyboardLayoutDE);
+  size_t written = partial.controller.keyboardWrite("^^^");
+  check(partial.waitForTyping(2000), "typing finishes");
+  check(written >= 1 && written < 3 &&
+            pressedKeys(partial.input->notifications).size() == 2 * written,
+        "a character is queued whole or not at all");
+}
+
+// BleKeyboardKeys.h codes reach the host as HID usages and modifier bits
+void testKeyCodes() {
+  check(keyToHID(KEY_RETURN) == LAYOUT_KEY(0x28, 0) &&
+            keyToHID(KEY_F1) == LAYOUT_KEY(0x3A, 0) &&
+            keyToHID(KEY_UP_ARROW) == LAYOUT_KEY(0x52, 0) &&
+            keyToHID(KEY_KP_DOT) == LAYOUT_KEY(0x63, 0) &&
+            keyToHID(KEY_MENU) == LAYOUT_KEY(0x65, 0),
+        "key codes translate to HID usages");
+  check(keyToHID(KEY_LEFT_CTRL) == LAYOUT_KEY(0, KEY_MOD_LCTRL) &&
+            keyToHID(KEY_LEFT_SHIFT) == LAYOUT_KEY(0, KEY_MOD_LSHIFT) &&
+            keyToHID(KEY_RIGHT_ALT) == LAYOUT_KEY(0, KEY_MOD_RALT) &&
+            keyToHID(KEY_RIGHT_GUI) == LAYOUT_KEY(0, KEY_MOD_RMETA),
+        "modifier codes translate to modifier bits");
+  check(keyToHID(0x04) == LAYOUT_KEY(0x04, 0),
+        "values below 0x80 stay HID usages");
+
+  Keyboard &keyboard = *new Keyboard(1);
+  delay(20);
+  keyboard.input->notifications.clear();
+  keyboard.controller.keyboardPress(KEY_LEFT_CTRL);
+  keyboard.controller.keyboardPress(KEY_RIGHT_SHIFT);
+  keyboard.controller.keyboardPress(KEY_RETURN);
+  keyboard.controller.keyboardPress(KEY_F1);
+  keyboard.controller.keyboardPress(0x04);
+  keyboard.controller.keyboardRelease(KEY_LEFT_CTRL);
+  keyboard.controller.keyboardRelease(KEY_RETURN);
+  delay(200);
+
+  const std::vector<std::vector<uint8_t>> &reports =
+      keyboard.input->notifications;
+  check(reports.size() == 7, "every press and release is reported");
+  if (reports.size() == 7) {
+    check(reports[1] == std::vector<uint8_t>({0x21, 0, 0, 0, 0, 0, 0, 0}),
+          "modifier codes set modifier bits and take no key slot");
+    check(reports[4] ==
+              std::vector<uint8_t>({0x21, 0, 0x28, 0x3A, 0x04, 0, 0, 0}),
+          "keys are pressed as HID usages");
+    check(reports[6] ==
+              std::vector<uint8_t>({0x20, 0, 0x3A, 0x04, 0, 0, 0, 0}),
+          "releases clear the modifier bit and the usage");
+  }
+
+  keyboard.controller.keyboardReleaseAll();
+  delay(20);
+  keyboard.input->notifications.clear();
+  keyboard.controller.keyboardWrite(KEY_TAB);
+  keyboard.controller.keyboardWrite(KEY_LEFT_GUI);
+  check(keyboard.waitForTyping(1000), "typing finishes");
+  check(reports.size() == 4 &&
+            reports[0] ==
+                std::vector<uint8_t>({0, 0, 0x2B, 0, 0, 0, 0, 0}) &&
+            reports[2] == std::vector<uint8_t>({KEY_MOD_LMETA, 0, 0, 0, 0,
+                                                0, 0, 0}),
+        "keyboardWrite() translates key codes");
+}
+
+// A congested link: keyboard functions must not wait for it and the host
+// must end up with the latest keys, while typed text still arrives whole
+void testCongestion() {
+  Keyboard &keyboard = *new Keyboard(1, 128);
+  delay(20);
+  keyboard.controller.resetStats();
+  const std::vector<std::vector<uint8_t>> &reports =
+      keyboard.input->notifications;
+  keyboard.input->notifications.clear();
+
+  // Far more failures than the queue holds, so the calls have to wait
+  keyboard.input->failNextNotifies = 40;
+  for (int i = 0; i < 20; i++) {
+    keyboard.controller.keyboardPress(asciiToHID('a'));
+    keyboard.controller.keyboardRelease(asciiToHID('a'));
+  }
+  keyboard.controller.keyboardPress(asciiToHID('b'));
+  keyboard.controller.flushReports();
+
+  std::vector<std::vector<uint8_t>> expected;
+  for (int i = 0; i < 20; i++) {
+    expected.push_back({0, 0, asciiToHID('a'), 0, 0, 0, 0, 0});
+    expected.push_back(std::vector<uint8_t>(8, 0));
+  }
+  expected.push_back({0, 0, asciiToHID('b'), 0, 0, 0, 0, 0});
+  check(reports == expected,
+        "a full keyboard queue keeps every press and release");
+  check(keyboard.controller.getStats().droppedReports == 0,
+        "keyboard calls wait for room instead of dropping reports");
+
+  keyboard.input->notifications.clear();
+  keyboard.input->failNextNotifies = 40;
+  keyboard.keyboardWriteAll("congested link");
+  check(keyboard.waitForTyping(5000), "typing finishes");
+  check(decode(keyboard.input->notifications) == "congested link",
+        "typing waits for the queue instead of losing keys");
+
+  // Sent to a full queue directly, a report is dropped and counted rather
+  // than overwriting the queued press
+  BleReportQueue queue;
+  queue.begin(8, 2, REPORT_QUEUE_FIFO);
+  queue.setCharacteristic(keyboard.input);
+  keyboard.input->notifications.clear();
+  keyboard.input->failNextNotifies = 1000000;
+  const uint8_t press[8] = {0, 0, asciiToHID('c')};
+  const uint8_t release[8] = {0};
+  queue.send(release, sizeof(release));
+  queue.send(press, sizeof(press));
+  check(!queue.send(release, sizeof(release)) &&
+            queue.getDroppedCount() == 1,
+        "a full FIFO queue drops and counts the new report");
+  keyboard.input->failNextNotifies = 0;
+  queue.flush();
+  check(reports.size() == 2 && reports[1][2] == asciiToHID('c'),
+        "a full FIFO queue keeps its queued reports");
+
+  host::resetStack();
+  BleController &controller = *new BleController();
+  BleControllerConfiguration config;
+  config.setAutoReport(false);
+  config.setIncludeMouse(true);
+  config.setReportQueueDepth(2);
+  controller.begin(&config);
+  host::waitForServer()->hostConnect();
+  delay(20);
+  NimBLECharacteristic *mouse =
+      host::hidDevice()->findInputReport(controller.getMouseReportId());
+  mouse->notifications.clear();
+
+  mouse->failNextNotifies = 20;
+  controller.mouseMove(10, 0);
+  controller.mousePress(MOUSE_LEFT);
+  controller.mouseMove(10, 0);
+  controller.mouseRelease(MOUSE_LEFT);
+  controller.mouseMove(10, 0);
+  controller.flushReports();
+
+  std::vector<uint8_t> buttons;
+  int x = 0;
+  for (const std::vector<uint8_t> &report : mouse->notifications) {
+    if (buttons.empty() || buttons.back() != report[0]) {
+      buttons.push_back(report[0]);
+    }
+    x += (int8_t)report[1];
+  }
+  check(buttons == std::vector<uint8_t>({0, MOUSE_LEFT, 0}) && x == 30,
+        "a full mouse queue keeps the click and adds up the movement");
+}
+
+// Bit of usage in an N-key rollover report
+bool nkroKey(const std::vector<uint8_t> &report, uint8_t usage) {
+  return (report[1 + usage / 8] >> (usage % 8) & 1) != 0;
+}
+
+int nkroKeyCount(const std::vector<uint8_t> &report) {
+  int count = 0;
+  for (size_t i = 1; i < report.size(); i++) {
+    count += __builtin_popcount(report[i]);
+  }
+  return count;
+}
+
+void testNkro() {
+  host::resetStack();
+  BleController &controller = *new BleController();
+  BleControllerConfiguration config;
+  config.setAutoReport(false);
+  config.setIncludeKeyboard(true);
+  config.setIncludeMouse(true);
+  config.setKeyboardNkro(true);
+  controller.begin(&config);
+  host::waitForServer()->hostConnect();
+  delay(20);
+
+  check(controller.getKeyboardReportId() == KEYBOARD_REPORT_ID &&
+            controller.getMouseReportId() == 4 &&
+            controller.getKeyboardNkroReportId() == 5,
+        "N-key rollover report takes the next free report ID");
+  NimBLECharacteristic *boot = host::hidDevice()->findInputReport(
+      controller.getKeyboardReportId());
+  NimBLECharacteristic *nkro = host::hidDevice()->findInputReport(
+      controller.getKeyboardNkroReportId());
+  check(nkro != nullptr, "N-key rollover report has an input characteristic");
+  if (nkro == nullptr) {
+    return;
+  }
+  boot->notifications.clear();
+  nkro->notifications.clear();
+
+  const char *keys = "qwertyuiopasdfghjkl";
+  for (const char *c = keys; *c != '\0'; c++) {
+    controller.keyboardPress(asciiToHID(*c));
+  }
+  controller.keyboardPress(KEY_LEFT_SHIFT);
+  controller.keyboardPress(KEY_F12);
+  controller.keyboardPress(KEY_KP_DOT);
+  controller.keyboardRelease(asciiToHID('q'));
+  delay(300);
+
+  const std::vector<std::vector<uint8_t>> &reports = nkro->notifications;
+  check(reports.size() == strlen(keys) + 4,
+        "every press and release is reported");
+  if (reports.size() == strlen(keys) + 4) {
+    const std::vector<uint8_t> &held = reports[reports.size() - 2];
+    check(held.size() == sizeof(keyboard_nkro_report_t) &&
+              nkroKeyCount(held) == (int)strlen(keys) + 2 &&
+              held[0] == KEY_MOD_LSHIFT && nkroKey(held, 0x45) &&
+              nkroKey(held, 0x63) && !nkroKey(held, 0),
+          "all keys are held at once");
+    check(!nkroKey(reports.back(), asciiToHID('q')) &&
+              nkroKeyCount(reports.back()) == (int)strlen(keys) + 1,
+          "a release clears only its key");
+  }
+  check(boot->notifications.empty(), "the 6 key report is left alone");
+
+  controller.keyboardReleaseAll();
+  delay(20);
+  check(nkroKeyCount(reports.back()) == 0 && reports.back()[0] == 0,
+        "release all clears every key");
+}
+
+void testDisconnected() {
+  Keyboard &keyboard = *new Keyboard(1);
+  keyboard.controller.keyboardWrite("abc");
+  check(keyboard.waitForTyping(1000), "typing finishes");
+  keyboard.input->notifications.clear();
+
+  host::waitForServer()->hostDisconnect();
+  check(keyboard.controller.keyboardWrite("abc") == 0,
+        "nothing is queued while disconnected");
+  check(!keyboard.controller.isTyping(), "not typing while disconnected");
+  check(keyboard.input->notifications.empty(), "no report while disconnected");
+}
+
+} // namespace
+
+int main() {
+  setvbuf(stdout, nullptr, _IONBF, 0);
+
+  testTyping();
+  testQueueFull();
+  testRollover();
+  testLayouts();
+  testUtf8();
+  testLayoutTyping();
+  testKeyCodes();
+  testCongestion();
+  testNkro();
+  testDisconnected();
+
+  printf("%d failure(s)\n", failures);
+  // The library tasks never return, so skip static destructors
+  _Exit(failures == 0 ? 0 : 1);
+}
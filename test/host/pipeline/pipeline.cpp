@@ -0,0 +1,286 @@
+// Two-thread check of the input pipeline against the stub NimBLE layer. One
+// thread plays the input task and the library's pipeline task sends the
+// reports; every report must carry whole setter calls and every button edge.
+// Without the pipeline, several producer threads send the reports themselves.
+// getStats() is checked against the reports sent per report ID, and a report
+// longer than the MTU allows against the hold and drop of its queue.
+//
+//   cd test/host && pio run -e pipeline -t exec
+
+#include <BleController.h>
+#include <BleSpscRing.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char *what) {
+  printf("%s %s\n", condition ? "ok  " : "FAIL", what);
+  if (!condition) {
+    failures++;
+  }
+}
+
+int16_t readInt16(const std::vector<uint8_t> &report, size_t offset) {
+  return (int16_t)(report[offset] | report[offset + 1] << 8);
+}
+
+void testRing() {
+  BleSpscRing<uint32_t> ring;
+  ring.begin(100);
+  check(ring.capacity() == 128, "ring capacity rounds up to a power of two");
+
+  const uint32_t count = 1000000;
+  std::thread producer([&] {
+    for (uint32_t i = 0; i < count;) {
+      if (ring.push(i)) {
+        i++;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  bool ordered = true;
+  uint32_t value;
+  for (uint32_t expected = 0; expected < count;) {
+    if (ring.pop(value)) {
+      ordered = ordered && value == expected;
+      expected++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+
+  check(ordered, "ring keeps every item in order across threads");
+  check(ring.empty(), "ring is empty after draining");
+}
+
+// Default configuration: 16 buttons (2 bytes), then the 8 axes, then one hat
+void testPipeline() {
+  BleController controller;
+  BleControllerConfiguration config;
+  config.setHidReportId(1);
+  config.setEnablePipeline(true);
+  config.setPipelineDepth(16);
+  controller.begin(&config);
+
+  host::waitForServer()->hostConnect();
+  delay(20);
+
+  NimBLECharacteristic *input = host::hidDevice()->findInputReport(1);
+  input->notifications.clear();
+
+  const int steps = 2000;
+  std::thread inputTask([&] {
+    for (int i = 1; i <= steps; i++) {
+      controller.setAxes(i, i, i, i, i, i, i, i);
+      if (i % 10 == 0) {
+        controller.press(BUTTON_1);
+        controller.release(BUTTON_1);
+      }
+    }
+
+    BleControllerUpdate update(controller);
+    controller.setAxes(-1, -1, -1, -1, -1, -1, -1, -1);
+    controller.press(BUTTON_2);
+  });
+  inputTask.join();
+  delay(200);
+
+  uint32_t torn = 0;
+  uint32_t presses = 0;
+  for (const std::vector<uint8_t> &report : input->notifications) {
+    for (uint8_t axis = 1; axis < 8; axis++) {
+      if (readInt16(report, 2 + axis * 2) != readInt16(report, 2)) {
+        torn++;
+        break;
+      }
+    }
+    if (report[0] & 0x01) {
+      presses++;
+    }
+  }
+
+  const std::vector<uint8_t> &last = input->notifications.back();
+  check(torn == 0, "no report mixes two setAxes() calls");
+  check(presses == steps / 10, "every button press reaches the host");
+  check(readInt16(last, 2) == -1 && last[0] == 0x02,
+        "batch update arrives as one final report");
+  check(controller.getPipelineDroppedCount() == 0, "no state change dropped");
+}
+
+// Auto-report on and no pipeline: every producer thread sends the report
+// itself. Each thread owns one axis and only counts it up, so a report sent
+// out of order or packed by two threads at once shows up as an axis going
+// back.
+void testConcurrentSenders() {
+  host::resetStack();
+  BleController controller;
+  BleControllerConfiguration config;
+  config.setHidReportId(1);
+  controller.begin(&config);
+
+  host::waitForServer()->hostConnect();
+  delay(20);
+
+  NimBLECharacteristic *input = host::hidDevice()->findInputReport(1);
+  input->notifications.clear();
+  input->notifyDelayUs = 50;
+
+  const int producers = 4;
+  const int steps = 2000;
+  std::vector<std::thread> threads;
+  for (int axis = 0; axis < producers; axis++) {
+    threads.emplace_back([&controller, axis] {
+      for (int16_t i = 1; i <= steps; i++) {
+        switch (axis) {
+        case 0:
+          controller.setX(i);
+          break;
+        case 1:
+          controller.setY(i);
+          break;
+        case 2:
+          controller.setZ(i);
+          break;
+        default:
+          controller.setRZ(i);
+          break;
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  delay(200);
+
+  // X, Y, Z and Rz are the first four axes, after the 16 button bits
+  bool ordered = true;
+  int16_t previous[producers] = {0};
+  for (const std::vector<uint8_t> &report : input->notifications) {
+    for (int axis = 0; axis < producers; axis++) {
+      int16_t value = readInt16(report, 2 + axis * 2);
+      ordered = ordered && value >= previous[axis];
+      previous[axis] = value;
+    }
+  }
+
+  check(!input->notifications.empty(), "producer threads send reports");
+  check(input->overlappingNotifies == 0, "one thread sends at a time");
+  check(ordered, "no axis goes back between reports");
+  bool final = true;
+  for (int axis = 0; axis < producers; axis++) {
+    final = final && previous[axis] == steps;
+  }
+  check(final, "the last report carries every thread's last value");
+}
+
+// getStats() counts every notification under its controller report ID
+void testStatsPerReportId() {
+  host::resetStack();
+  BleController controller;
+  BleControllerConfiguration config;
+  config.setHidReportId(1);
+  config.setAutoReport(false);
+  config.setFieldGroupReportId(FIELD_GROUP_AXES, 4);
+  controller.begin(&config);
+
+  host::waitForServer()->hostConnect();
+  delay(20);
+  controller.resetStats();
+
+  for (int16_t i = 1; i <= 10; i++) {
+    controller.setX(i);
+    if (i % 5 == 0) {
+      controller.press(BUTTON_1 + i / 5);
+    }
+    controller.sendReport();
+  }
+
+  ble_controller_stats_t stats = controller.getStats();
+  check(stats.controllerReportCount == 2 &&
+            stats.controllerReportIds[0] == 1 &&
+            stats.controllerReportIds[1] == 4,
+        "stats list the controller report IDs");
+  // The first report of a connection sends both, then only changes
+  check(stats.controllerReportsSent[0] == 3 &&
+            stats.controllerReportsSent[1] == 10 &&
+            stats.controllerReports == 13,
+        "stats count the reports of each report ID");
+}
+
+void testOversizedReport() {
+  host::resetStack();
+  BleController controller;
+  BleControllerConfiguration config;
+  config.setHidReportId(1);
+  config.setAutoReport(false);
+  config.setButtonCount(128);
+  controller.begin(&config);
+
+  // No MTU exchange, so notifications carry 20 bytes
+  NimBLEServer *server = host::waitForServer();
+  server->hostConnect();
+  delay(20);
+  controller.resetStats();
+  NimBLECharacteristic *input = host::hidDevice()->findInputReport(1);
+  input->notifications.clear();
+
+  controller.press(BUTTON_1);
+  controller.sendReport();
+  controller.flushReports();
+  check(input->notifications.empty(),
+        "a report longer than the MTU is held back");
+
+  uint32_t start = millis();
+  while (controller.getStats().droppedReports == 0 &&
+         millis() - start < REPORT_QUEUE_MTU_WAIT_MS + 500) {
+    delay(10);
+    controller.flushReports();
+  }
+  uint32_t waited = millis() - start;
+  check(controller.getStats().droppedReports == 1 &&
+            input->notifications.empty(),
+        "a held report is dropped after REPORT_QUEUE_MTU_WAIT_MS");
+  check(waited + 50 >= REPORT_QUEUE_MTU_WAIT_MS,
+        "a held report waits for the MTU to be raised first");
+
+  controller.press(BUTTON_2);
+  controller.sendReport();
+  check(input->notifications.empty() &&
+            controller.getStats().droppedReports == 2,
+        "later reports are dropped without waiting again");
+
+  server->hostExchangeMtu(247);
+  controller.press(BUTTON_3);
+  controller.sendReport();
+  check(input->notifications.size() == 1 &&
+            input->notifications[0].size() > 20 &&
+            (input->notifications[0][0] & 0x07) == 0x07 &&
+            controller.getStats().droppedReports == 2,
+        "reports are sent whole once the MTU is raised");
+}
+
+} // namespace
+
+int main() {
+  setvbuf(stdout, nullptr, _IONBF, 0);
+
+  testRing();
+  testPipeline();
+  testConcurrentSenders();
+  testStatsPerReportId();
+  testOversizedReport();
+
+  printf("%d failure(s)\n", failures);
+  // The library tasks never return, so skip static destructors
+  _Exit(failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,124 @@
+// Host stub: the subset of the Arduino-ESP32 core (and the FreeRTOS API it
+// pulls in) that the library uses, implemented on top of the C++ standard
+// library so the sources can be built and exercised on a Linux host.
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+// ---------------------------------------------------------------- FreeRTOS
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+typedef struct HostTask *TaskHandle_t;
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name,
+                       uint32_t stackDepth, void *parameter,
+                       UBaseType_t priority, TaskHandle_t *createdTask);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name,
+                                   uint32_t stackDepth, void *parameter,
+                                   UBaseType_t priority,
+                                   TaskHandle_t *createdTask, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previousWakeTime, TickType_t increment);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+BaseType_t xPortGetCoreID(void);
+#define taskYIELD() std::this_thread::yield()
+
+// ----------------------------------------------------------------- Arduino
+
+#define HEX 16
+#define DEC 10
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+
+namespace host {
+// When set, delay(), delayMicroseconds() and timed vTaskDelay() return at
+// once, so benchmarks measure CPU time rather than the library's pacing.
+extern bool skipDelays;
+} // namespace host
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+char *itoa(int value, char *str, int base);
+char *ltoa(long value, char *str, int base);
+char *ultoa(unsigned long value, char *str, int base);
+char *dtostrf(double value, signed char width, unsigned char precision,
+              char *str);
+
+class String {
+public:
+  String() {}
+  String(const char *str) : value(str ? str : "") {}
+  String(const std::string &str) : value(str) {}
+  String(int number) : value(std::to_string(number)) {}
+  String(unsigned long number) : value(std::to_string(number)) {}
+
+  const char *c_str() const { return value.c_str(); }
+  unsigned int length() const { return value.length(); }
+  bool operator==(const String &other) const { return value == other.value; }
+  String operator+(const String &other) const { return value + other.value; }
+  String &operator+=(const String &other) {
+    value += other.value;
+    return *this;
+  }
+
+private:
+  std::string value;
+};
+
+class HostSerial {
+public:
+  void begin(unsigned long) {}
+  // Output is discarded unless enabled, mirroring an unopened UART
+  explicit operator bool() const { return enabled; }
+  size_t printf(const char *format, ...);
+  size_t print(const char *str);
+  size_t print(const String &str) { return print(str.c_str()); }
+  size_t print(long value, int base = DEC);
+  size_t println(const char *str = "");
+  size_t println(const String &str) { return println(str.c_str()); }
+  size_t println(long value, int base = DEC);
+
+  bool enabled = false;
+};
+
+extern HostSerial Serial;
+
+class HostEsp {
+public:
+  void restart();
+};
+
+extern HostEsp ESP;
@@ -0,0 +1,532 @@
+// Host stub implementations for Arduino.h and NimBLEStub.h
+#include <Arduino.h>
+#include <NimBLEStub.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+HostSerial Serial;
+HostEsp ESP;
+
+namespace host {
+bool skipDelays = false;
+} // namespace host
+
+// ---------------------------------------------------------------- FreeRTOS
+
+namespace {
+
+// Thrown to unwind a task that deletes itself or parks forever
+struct TaskExit {};
+
+const std::chrono::steady_clock::time_point bootTime =
+    std::chrono::steady_clock::now();
+
+} // namespace
+
+struct HostTask {
+  std::mutex lock;
+  std::condition_variable wake;
+  uint32_t notifications = 0;
+};
+
+static thread_local HostTask *currentTask = nullptr;
+
+static void runTask(TaskFunction_t task, void *parameter, HostTask *handle) {
+  currentTask = handle;
+  try {
+    task(parameter);
+  } catch (const TaskExit &) {
+  }
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name,
+                       uint32_t stackDepth, void *parameter,
+                       UBaseType_t priority, TaskHandle_t *createdTask) {
+  (void)name;
+  (void)stackDepth;
+  (void)priority;
+  HostTask *handle = new HostTask();
+  if (createdTask) {
+    *createdTask = handle;
+  }
+  std::thread(runTask, task, parameter, handle).detach();
+  return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name,
+                                   uint32_t stackDepth, void *parameter,
+                                   UBaseType_t priority,
+                                   TaskHandle_t *createdTask, BaseType_t core) {
+  (void)core;
+  return xTaskCreate(task, name, stackDepth, parameter, priority, createdTask);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (task == nullptr || task == currentTask) {
+    throw TaskExit();
+  }
+}
+
+void vTaskDelay(TickType_t ticks) {
+  if (ticks == portMAX_DELAY && currentTask != nullptr) {
+    throw TaskExit();
+  }
+  if (host::skipDelays) {
+    std::this_thread::yield();
+    return;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+void vTaskDelayUntil(TickType_t *previousWakeTime, TickType_t increment) {
+  TickType_t wakeTime = *previousWakeTime + increment;
+  TickType_t now = xTaskGetTickCount();
+  if ((int32_t)(wakeTime - now) > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(wakeTime - now));
+  }
+  *previousWakeTime = wakeTime;
+}
+
+TickType_t xTaskGetTickCount(void) { return (TickType_t)millis(); }
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return currentTask; }
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+  HostTask *task = currentTask;
+  if (task == nullptr) {
+    return 0;
+  }
+  std::unique_lock<std::mutex> guard(task->lock);
+  if (ticksToWait == portMAX_DELAY) {
+    task->wake.wait(guard, [task] { return task->notifications > 0; });
+  } else {
+    task->wake.wait_for(guard, std::chrono::milliseconds(ticksToWait),
+                        [task] { return task->notifications > 0; });
+  }
+  uint32_t count = task->notifications;
+  if (count > 0) {
+    task->notifications = clearCountOnExit ? 0 : count - 1;
+  }
+  return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  if (task == nullptr) {
+    return pdFAIL;
+  }
+  {
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notifications++;
+  }
+  task->wake.notify_one();
+  return pdPASS;
+}
+
+BaseType_t xPortGetCoreID(void) { return 0; }
+
+// ----------------------------------------------------------------- Arduino
+
+unsigned long millis(void) {
+  return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - bootTime)
+      .count();
+}
+
+unsigned long micros(void) {
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - bootTime)
+      .count();
+}
+
+void delay(uint32_t ms) {
+  if (!host::skipDelays) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  }
+}
+
+void delayMicroseconds(uint32_t us) {
+  if (!host::skipDelays) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+  }
+}
+
+char *ultoa(unsigned long value, char *str, int base) {
+  char digits[sizeof(unsigned long) * 8 + 1];
+  int length = 0;
+  do {
+    unsigned long digit = value % base;
+    digits[length++] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+    value /= base;
+  } while (value > 0);
+  for (int i = 0; i < length; i++) {
+    str[i] = digits[length - 1 - i];
+  }
+  str[length] = '\0';
+  return str;
+}
+
+char *ltoa(long value, char *str, int base) {
+  if (value < 0 && base == 10) {
+    str[0] = '-';
+    ultoa(-(unsigned long)value, str + 1, base);
+    return str;
+  }
+  return ultoa((unsigned long)value, str, base);
+}
+
+char *itoa(int value, char *str, int base) { return ltoa(value, str, base); }
+
+char *dtostrf(double value, signed char width, unsigned char precision,
+              char *str) {
+  sprintf(str, "%*.*f", width, precision, value);
+  return str;
+}
+
+size_t HostSerial::printf(const char *format, ...) {
+  if (!enabled) {
+    return 0;
+  }
+  va_list args;
+  va_start(args, format);
+  int written = vprintf(format, args);
+  va_end(args);
+  return written < 0 ? 0 : written;
+}
+
+size_t HostSerial::print(const char *str) { return printf("%s", str); }
+
+size_t HostSerial::print(long value, int base) {
+  return printf(base == HEX ? "%lX" : "%ld", value);
+}
+
+size_t HostSerial::println(const char *str) { return printf("%s\n", str); }
+
+size_t HostSerial::println(long value, int base) {
+  return print(value, base) + print("\n");
+}
+
+void HostEsp::restart() { std::abort(); }
+
+// ------------------------------------------------------------------ NimBLE
+
+namespace {
+
+std::mutex stackLock;
+std::condition_variable stackChanged;
+bool initialized = false;
+NimBLEServer *server = nullptr;
+NimBLEHIDDevice *lastHidDevice = nullptr;
+bool servicesStarted = false;
+int8_t txPower = 9;
+uint16_t preferredMtu = 255;
+
+} // namespace
+
+bool NimBLECharacteristic::notify(const uint8_t *data, size_t length,
+                                  uint16_t connHandle) {
+  (void)connHandle;
+  if (notifying.fetch_add(1) != 0) {
+    overlappingNotifies++;
+  }
+  if (notifyDelayUs > 0) {
+    delayMicroseconds(notifyDelayUs);
+  }
+
+  bool sent = true;
+  notifyCount++;
+  if (failNextNotifies > 0) {
+    failNextNotifies--;
+    sent = false;
+  } else if (recordNotifications) {
+    notifications.emplace_back(data, data + length);
+  }
+  notifying.fetch_sub(1);
+  return sent;
+}
+
+void NimBLECharacteristic::hostWrite(const uint8_t *data, size_t length) {
+  setValue(data, length);
+  if (callbacks) {
+    NimBLEConnInfo info;
+    callbacks->onWrite(this, info);
+  }
+}
+
+std::string NimBLECharacteristic::hostRead() {
+  if (callbacks) {
+    NimBLEConnInfo info;
+    callbacks->onRead(this, info);
+  }
+  return value;
+}
+
+NimBLEService::~NimBLEService() {
+  for (NimBLECharacteristic *characteristic : characteristics) {
+    delete characteristic;
+  }
+}
+
+NimBLECharacteristic *NimBLEService::createCharacteristic(
+    const NimBLEUUID &uuid, uint16_t properties) {
+  NimBLECharacteristic *characteristic =
+      new NimBLECharacteristic(uuid, properties);
+  characteristics.push_back(characteristic);
+  return characteristic;
+}
+
+NimBLECharacteristic *NimBLEService::getCharacteristic(const NimBLEUUID &uuid) {
+  for (NimBLECharacteristic *characteristic : characteristics) {
+    if (characteristic->getUUID() == uuid) {
+      return characteristic;
+    }
+  }
+  return nullptr;
+}
+
+NimBLEServer::~NimBLEServer() {
+  for (NimBLEService *service : services) {
+    delete service;
+  }
+}
+
+NimBLEService *NimBLEServer::createService(const NimBLEUUID &uuid) {
+  NimBLEService *service = new NimBLEService(uuid);
+  services.push_back(service);
+  return service;
+}
+
+NimBLEService *NimBLEServer::getServiceByUUID(const NimBLEUUID &uuid) {
+  for (NimBLEService *service : services) {
+    if (service->getUUID() == uuid) {
+      return service;
+    }
+  }
+  return nullptr;
+}
+
+bool NimBLEServer::disconnect(uint16_t connHandle, uint8_t reason) {
+  (void)connHandle;
+  if (connected) {
+    hostDisconnect();
+  }
+  (void)reason;
+  return true;
+}
+
+void NimBLEServer::updateConnParams(uint16_t connHandle, uint16_t minInterval,
+                                    uint16_t maxInterval, uint16_t latency,
+                                    uint16_t timeout) {
+  (void)connHandle;
+  (void)minInterval;
+  (void)latency;
+  (void)timeout;
+  peer.connInterval = maxInterval;
+  if (callbacks) {
+    callbacks->onConnParamsUpdate(peer);
+  }
+}
+
+void NimBLEServer::hostConnect(uint16_t mtu) {
+  connected = true;
+  peer.address = NimBLEAddress("11:22:33:44:55:66", 0);
+  peer.mtu = 23;
+  if (callbacks) {
+    callbacks->onConnect(this, peer);
+  }
+  if (mtu != 23) {
+    peer.mtu = mtu < preferredMtu ? mtu : preferredMtu;
+    if (callbacks) {
+      callbacks->onMTUChange(peer.mtu, peer);
+    }
+  }
+  if (callbacks) {
+    callbacks->onAuthenticationComplete(peer);
+  }
+}
+
+void NimBLEServer::hostExchangeMtu(uint16_t mtu) {
+  peer.mtu = mtu < preferredMtu ? mtu : preferredMtu;
+  if (callbacks) {
+    callbacks->onMTUChange(peer.mtu, peer);
+  }
+}
+
+void NimBLEServer::hostDisconnect() {
+  connected = false;
+  if (callbacks) {
+    callbacks->onDisconnect(this, peer, 0x13);
+  }
+}
+
+NimBLEHIDDevice::NimBLEHIDDevice(NimBLEServer *server) {
+  // UUID strings match the spelling the library looks services up by
+  deviceInfoService = server->createService("180A");
+  hidService = server->createService("1812");
+  batteryService = server->createService("180F");
+  std::lock_guard<std::mutex> guard(stackLock);
+  lastHidDevice = this;
+}
+
+void NimBLEHIDDevice::setReportMap(uint8_t *map, uint16_t size) {
+  reportMap.assign(map, map + size);
+}
+
+void NimBLEHIDDevice::startServices() {
+  {
+    std::lock_guard<std::mutex> guard(stackLock);
+    servicesStarted = true;
+  }
+  stackChanged.notify_all();
+}
+
+bool NimBLEHIDDevice::setManufacturer(const std::string &name) {
+  (void)name;
+  return true;
+}
+
+void NimBLEHIDDevice::setPnp(uint8_t sig, uint16_t vid, uint16_t pid,
+                             uint16_t version) {
+  (void)sig;
+  (void)vid;
+  (void)pid;
+  (void)version;
+}
+
+void NimBLEHIDDevice::setHidInfo(uint8_t country, uint8_t flags) {
+  (void)country;
+  (void)flags;
+}
+
+void NimBLEHIDDevice::setBatteryLevel(uint8_t level, bool notify) {
+  (void)notify;
+  batteryLevel = level;
+}
+
+NimBLECharacteristic *NimBLEHIDDevice::getReport(uint8_t reportId,
+                                                 uint8_t type) {
+  for (const Report &report : reports) {
+    if (report.id == reportId && report.type == type) {
+      return report.characteristic;
+    }
+  }
+  NimBLECharacteristic *characteristic = hidService->createCharacteristic(
+      "2a4d", NIMBLE_PROPERTY::READ | NIMBLE_PROPERTY::NOTIFY);
+  reports.push_back({reportId, type, characteristic});
+  return characteristic;
+}
+
+NimBLECharacteristic *NimBLEHIDDevice::getInputReport(uint8_t reportId) {
+  return getReport(reportId, 1);
+}
+
+NimBLECharacteristic *NimBLEHIDDevice::getOutputReport(uint8_t reportId) {
+  return getReport(reportId, 2);
+}
+
+NimBLECharacteristic *NimBLEHIDDevice::getFeatureReport(uint8_t reportId) {
+  return getReport(reportId, 3);
+}
+
+NimBLECharacteristic *NimBLEHIDDevice::findInputReport(uint8_t reportId) {
+  for (const Report &report : reports) {
+    if (report.id == reportId && report.type == 1) {
+      return report.characteristic;
+    }
+  }
+  return nullptr;
+}
+
+NimBLECharacteristic *NimBLEHIDDevice::findFeatureReport(uint8_t reportId) {
+  for (const Report &report : reports) {
+    if (report.id == reportId && report.type == 3) {
+      return report.characteristic;
+    }
+  }
+  return nullptr;
+}
+
+bool NimBLEDevice::init(const std::string &deviceName) {
+  (void)deviceName;
+  std::lock_guard<std::mutex> guard(stackLock);
+  initialized = true;
+  return true;
+}
+
+bool NimBLEDevice::deinit(bool clearAll) {
+  (void)clearAll;
+  host::resetStack();
+  return true;
+}
+
+bool NimBLEDevice::isInitialized() {
+  std::lock_guard<std::mutex> guard(stackLock);
+  return initialized;
+}
+
+NimBLEServer *NimBLEDevice::createServer() {
+  std::lock_guard<std::mutex> guard(stackLock);
+  if (server == nullptr) {
+    server = new NimBLEServer();
+  }
+  return server;
+}
+
+NimBLEServer *NimBLEDevice::getServer() {
+  std::lock_guard<std::mutex> guard(stackLock);
+  return server;
+}
+
+bool NimBLEDevice::setPower(int8_t dbm) {
+  txPower = dbm;
+  return true;
+}
+
+int NimBLEDevice::getPower() { return txPower; }
+
+int NimBLEDevice::setMTU(uint16_t mtu) {
+  preferredMtu = mtu;
+  return 0;
+}
+
+uint16_t NimBLEDevice::getMTU() { return preferredMtu; }
+
+void NimBLEDevice::setSecurityAuth(bool bonding, bool mitm, bool sc) {
+  (void)bonding;
+  (void)mitm;
+  (void)sc;
+}
+
+bool NimBLEDevice::deleteAllBonds() { return true; }
+
+bool NimBLEDevice::deleteBond(const NimBLEAddress &address) {
+  (void)address;
+  return true;
+}
+
+namespace host {
+
+NimBLEServer *waitForServer() {
+  std::unique_lock<std::mutex> guard(stackLock);
+  stackChanged.wait(guard, [] { return servicesStarted; });
+  return server;
+}
+
+NimBLEHIDDevice *hidDevice() {
+  std::lock_guard<std::mutex> guard(stackLock);
+  return lastHidDevice;
+}
+
+void resetStack() {
+  // Objects are intentionally leaked: controllers from earlier runs may
+  // still hold pointers into them.
+  std::lock_guard<std::mutex> guard(stackLock);
+  initialized = false;
+  server = nullptr;
+  lastHidDevice = nullptr;
+  servicesStarted = false;
+  preferredMtu = 255;
+}
+
+} // namespace host
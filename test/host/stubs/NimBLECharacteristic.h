@@ -0,0 +1,4 @@
+// Host stub: forwards to the single NimBLE stub header
+#pragma once
+
+#include "NimBLEStub.h"
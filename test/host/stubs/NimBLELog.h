@@ -0,0 +1,7 @@
+// Host stub: NimBLE logging is compiled out
+#pragma once
+
+#define NIMBLE_LOGD(tag, format, ...) ((void)(tag))
+#define NIMBLE_LOGI(tag, format, ...) ((void)(tag))
+#define NIMBLE_LOGW(tag, format, ...) ((void)(tag))
+#define NIMBLE_LOGE(tag, format, ...) ((void)(tag))
@@ -0,0 +1,318 @@
+// Host stub: the subset of the NimBLE-Arduino 2.x API used by the library.
+// Characteristics keep every notification they are asked to send so host
+// programs can inspect exactly what would have gone over the air.
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define BLE_HS_CONN_HANDLE_NONE 0xffff
+
+namespace NIMBLE_PROPERTY {
+enum {
+  BROADCAST = 0x0001,
+  READ = 0x0002,
+  WRITE_NR = 0x0004,
+  WRITE = 0x0008,
+  NOTIFY = 0x0010,
+  INDICATE = 0x0020,
+  READ_ENC = 0x0200,
+  WRITE_ENC = 0x1000,
+};
+}
+
+class NimBLEUUID {
+public:
+  NimBLEUUID() {}
+  NimBLEUUID(const char *uuid) : value(uuid) {}
+  NimBLEUUID(const std::string &uuid) : value(uuid) {}
+  bool operator==(const NimBLEUUID &other) const {
+    return value == other.value;
+  }
+  std::string toString() const { return value; }
+
+private:
+  std::string value;
+};
+
+class NimBLEAddress {
+public:
+  NimBLEAddress() : value("00:00:00:00:00:00") {}
+  NimBLEAddress(const std::string &address, uint8_t type)
+      : value(address) {
+    (void)type;
+  }
+  std::string toString() const { return value; }
+  operator std::string() const { return value; }
+  bool operator==(const NimBLEAddress &other) const {
+    return value == other.value;
+  }
+
+private:
+  std::string value;
+};
+
+class NimBLEConnInfo {
+public:
+  NimBLEAddress getAddress() const { return address; }
+  uint16_t getConnHandle() const { return connHandle; }
+  uint16_t getConnInterval() const { return connInterval; }
+  uint16_t getConnTimeout() const { return 600; }
+  uint16_t getConnLatency() const { return 0; }
+  uint16_t getMTU() const { return mtu; }
+
+  NimBLEAddress address;
+  uint16_t connHandle = 0;
+  uint16_t connInterval = 6; // 7.5 ms in 1.25 ms units
+  uint16_t mtu = 23;
+};
+
+class NimBLECharacteristic;
+
+class NimBLECharacteristicCallbacks {
+public:
+  virtual ~NimBLECharacteristicCallbacks() {}
+  virtual void onRead(NimBLECharacteristic *pCharacteristic,
+                      NimBLEConnInfo &connInfo) {}
+  virtual void onWrite(NimBLECharacteristic *pCharacteristic,
+                       NimBLEConnInfo &connInfo) {}
+  virtual void onStatus(NimBLECharacteristic *pCharacteristic, int code) {}
+};
+
+class NimBLECharacteristic {
+public:
+  NimBLECharacteristic(const NimBLEUUID &uuid, uint16_t properties)
+      : uuid(uuid), properties(properties) {}
+
+  void setValue(const uint8_t *data, size_t length) {
+    value.assign((const char *)data, length);
+  }
+  void setValue(const std::string &data) { value = data; }
+  template <typename T> void setValue(const T &data) {
+    setValue((const uint8_t *)&data, sizeof(T));
+  }
+  std::string getValue() const { return value; }
+  NimBLEUUID getUUID() const { return uuid; }
+  void setCallbacks(NimBLECharacteristicCallbacks *pCallbacks) {
+    callbacks = pCallbacks;
+  }
+  NimBLECharacteristicCallbacks *getCallbacks() const { return callbacks; }
+
+  bool notify(uint16_t connHandle = BLE_HS_CONN_HANDLE_NONE) {
+    return notify((const uint8_t *)value.data(), value.length(), connHandle);
+  }
+  bool notify(const uint8_t *data, size_t length,
+              uint16_t connHandle = BLE_HS_CONN_HANDLE_NONE);
+
+  // Host side helpers -----------------------------------------------------
+
+  // Simulates a central writing to (or reading from) this characteristic
+  void hostWrite(const uint8_t *data, size_t length);
+  std::string hostRead();
+
+  std::vector<std::vector<uint8_t>> notifications;
+  bool recordNotifications = true;
+  // Number of upcoming notify() calls that report congestion
+  unsigned int failNextNotifies = 0;
+  unsigned long notifyCount = 0;
+  // notify() calls that started while another one was still running, which
+  // the library must not do; notifyDelayUs widens the window
+  std::atomic<unsigned int> overlappingNotifies{0};
+  unsigned int notifyDelayUs = 0;
+
+private:
+  std::atomic<int> notifying{0};
+  NimBLEUUID uuid;
+  uint16_t properties;
+  std::string value;
+  NimBLECharacteristicCallbacks *callbacks = nullptr;
+};
+
+typedef NimBLECharacteristic BLECharacteristic;
+
+class NimBLEService {
+public:
+  NimBLEService(const NimBLEUUID &uuid) : uuid(uuid) {}
+  ~NimBLEService();
+  NimBLECharacteristic *createCharacteristic(const NimBLEUUID &uuid,
+                                             uint16_t properties);
+  NimBLECharacteristic *getCharacteristic(const NimBLEUUID &uuid);
+  bool start() { return true; }
+  NimBLEUUID getUUID() const { return uuid; }
+
+private:
+  NimBLEUUID uuid;
+  std::vector<NimBLECharacteristic *> characteristics;
+};
+
+class NimBLEAdvertisementData {
+public:
+  bool addServiceUUID(const NimBLEUUID &uuid) {
+    uuids.push_back(uuid);
+    return true;
+  }
+  std::vector<NimBLEUUID> uuids;
+};
+
+class NimBLEAdvertising {
+public:
+  bool setAppearance(uint16_t value) {
+    appearance = value;
+    return true;
+  }
+  bool setName(const std::string &value) {
+    name = value;
+    return true;
+  }
+  bool addServiceUUID(const NimBLEUUID &uuid) {
+    uuids.push_back(uuid);
+    return true;
+  }
+  bool setScanResponseData(const NimBLEAdvertisementData &data) {
+    scanResponse = data;
+    return true;
+  }
+  bool start() {
+    advertising = true;
+    return true;
+  }
+  bool stop() {
+    advertising = false;
+    return true;
+  }
+
+  uint16_t appearance = 0;
+  std::string name;
+  std::vector<NimBLEUUID> uuids;
+  NimBLEAdvertisementData scanResponse;
+  bool advertising = false;
+};
+
+class NimBLEServer;
+
+class NimBLEServerCallbacks {
+public:
+  virtual ~NimBLEServerCallbacks() {}
+  virtual void onConnect(NimBLEServer *pServer, NimBLEConnInfo &connInfo) {}
+  virtual void onDisconnect(NimBLEServer *pServer, NimBLEConnInfo &connInfo,
+                            int reason) {}
+  virtual void onMTUChange(uint16_t MTU, NimBLEConnInfo &connInfo) {}
+  virtual void onAuthenticationComplete(NimBLEConnInfo &connInfo) {}
+  virtual void onConnParamsUpdate(NimBLEConnInfo &connInfo) {}
+};
+
+class NimBLEServer {
+public:
+  ~NimBLEServer();
+  void setCallbacks(NimBLEServerCallbacks *pCallbacks) {
+    callbacks = pCallbacks;
+  }
+  void advertiseOnDisconnect(bool value) { (void)value; }
+  NimBLEService *createService(const NimBLEUUID &uuid);
+  NimBLEService *getServiceByUUID(const NimBLEUUID &uuid);
+  NimBLEAdvertising *getAdvertising() { return &advertising; }
+  NimBLEConnInfo getPeerInfo(size_t index) {
+    (void)index;
+    return peer;
+  }
+  std::vector<uint16_t> getPeerDevices() {
+    return connected ? std::vector<uint16_t>{peer.connHandle}
+                     : std::vector<uint16_t>{};
+  }
+  uint8_t getConnectedCount() { return connected ? 1 : 0; }
+  bool disconnect(uint16_t connHandle, uint8_t reason = 0x13);
+  void updateConnParams(uint16_t connHandle, uint16_t minInterval,
+                        uint16_t maxInterval, uint16_t latency,
+                        uint16_t timeout);
+
+  // Host side helpers -----------------------------------------------------
+
+  // Runs the callbacks a real central triggers while connecting and bonding
+  void hostConnect(uint16_t mtu = 23);
+  void hostDisconnect();
+  // MTU exchange after the connection is up, capped at NimBLEDevice::setMTU()
+  void hostExchangeMtu(uint16_t mtu);
+
+  NimBLEConnInfo peer;
+  bool connected = false;
+
+private:
+  NimBLEServerCallbacks *callbacks = nullptr;
+  NimBLEAdvertising advertising;
+  std::vector<NimBLEService *> services;
+};
+
+class NimBLEHIDDevice {
+public:
+  NimBLEHIDDevice(NimBLEServer *server);
+  void setReportMap(uint8_t *map, uint16_t size);
+  void startServices();
+  bool setManufacturer(const std::string &name);
+  void setPnp(uint8_t sig, uint16_t vid, uint16_t pid, uint16_t version);
+  void setHidInfo(uint8_t country, uint8_t flags);
+  void setBatteryLevel(uint8_t level, bool notify = false);
+  NimBLECharacteristic *getInputReport(uint8_t reportId);
+  NimBLECharacteristic *getOutputReport(uint8_t reportId);
+  NimBLECharacteristic *getFeatureReport(uint8_t reportId);
+  NimBLEService *getDeviceInfoService() { return deviceInfoService; }
+  NimBLEService *getHidService() { return hidService; }
+  NimBLEService *getBatteryService() { return batteryService; }
+
+  // Host side helpers -----------------------------------------------------
+
+  // Input report characteristic for a report ID, or nullptr
+  NimBLECharacteristic *findInputReport(uint8_t reportId);
+  NimBLECharacteristic *findFeatureReport(uint8_t reportId);
+
+  std::vector<uint8_t> reportMap;
+  uint8_t batteryLevel = 0;
+
+private:
+  struct Report {
+    uint8_t id;
+    uint8_t type;
+    NimBLECharacteristic *characteristic;
+  };
+  NimBLECharacteristic *getReport(uint8_t reportId, uint8_t type);
+
+  NimBLEService *deviceInfoService;
+  NimBLEService *hidService;
+  NimBLEService *batteryService;
+  std::vector<Report> reports;
+};
+
+class NimBLEDevice {
+public:
+  static bool init(const std::string &deviceName);
+  static bool deinit(bool clearAll = false);
+  static bool isInitialized();
+  static NimBLEServer *createServer();
+  static NimBLEServer *getServer();
+  static bool setPower(int8_t dbm);
+  static int getPower();
+  static int setMTU(uint16_t mtu);
+  static uint16_t getMTU();
+  static void setSecurityAuth(bool bonding, bool mitm, bool sc);
+  static bool deleteAllBonds();
+  static bool deleteBond(const NimBLEAddress &address);
+};
+
+namespace host {
+
+// Waits until the library's BLE server task has started the HID services and
+// returns the server it created.
+NimBLEServer *waitForServer();
+
+// The HID device created by the most recent server task
+NimBLEHIDDevice *hidDevice();
+
+// Tears the fake stack down so the next begin() starts from scratch
+void resetStack();
+
+} // namespace host
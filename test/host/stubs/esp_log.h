@@ -0,0 +1,2 @@
+// Host stub: ESP-IDF logging is compiled out
+#pragma once
@@ -0,0 +1,4 @@
+// Host stub: NimBLE role configuration
+#pragma once
+
+#define CONFIG_BT_NIMBLE_ROLE_PERIPHERAL 1
@@ -0,0 +1,6 @@
+// Host stub: minimal ESP-IDF sdkconfig for building the library natively
+#pragma once
+
+#define CONFIG_BT_ENABLED 1
+#define CONFIG_BT_NIMBLE_PINNED_TO_CORE 0
+#define CONFIG_FREERTOS_HZ 1000
@@ -0,0 +1,108 @@
+// Checks the report map begin() writes against the reports the controller
+// sends, across configurations. Every combination of the settings that
+// change the report layout (buttons, axes, hats, bit widths) is run; the
+// remaining settings rotate through their values from one case to the next.
+//
+//   cd test/host && pio run -e validate -t exec
+
+#include "../hid/ControllerCheck.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+int failures = 0;
+int cases = 0;
+
+const uint16_t buttonCounts[] = {0, 1, 8, 9, 64, 128};
+const uint8_t axisMasks[] = {0x00, 0x01, 0x03, 0x3F, 0xFF, 0x81};
+const uint8_t hatCounts[] = {0, 1, 4};
+const uint8_t valueBits[] = {16, 12, 10, 8};
+const uint8_t hatBits[] = {8, 4};
+
+// Rotated by case number
+const uint8_t simulationMasks[] = {0x00, 0x1F, 0x09};
+const uint8_t motionMasks[] = {0x00, 0x01, 0x03};
+const uint8_t specialButtonMasks[] = {0x00, 0xFF, 0x15};
+const int16_t valueRanges[][2] = {{0, 0x7FFF}, {-32767, 32767}, {-255, 255}};
+
+#define COUNT(array) (sizeof(array) / sizeof(array[0]))
+
+bool bit(uint8_t mask, uint8_t index) { return (mask >> index & 1) != 0; }
+
+void run(uint16_t buttons, uint8_t axes, uint8_t hats, uint8_t bits,
+         uint8_t hatWidth) {
+  int n = cases++;
+  uint8_t simulation = simulationMasks[n % COUNT(simulationMasks)];
+  uint8_t motion = motionMasks[n / 3 % COUNT(motionMasks)];
+  uint8_t special = specialButtonMasks[n / 9 % COUNT(specialButtonMasks)];
+  const int16_t *range = valueRanges[n / 2 % COUNT(valueRanges)];
+
+  BleControllerConfiguration config;
+  config.setButtonCount(buttons);
+  config.setWhichAxes(bit(axes, 0), bit(axes, 1), bit(axes, 2), bit(axes, 3),
+                      bit(axes, 4), bit(axes, 5), bit(axes, 6), bit(axes, 7));
+  config.setHatSwitchCount(hats);
+  config.setWhichSimulationControls(bit(simulation, 0), bit(simulation, 1),
+                                    bit(simulation, 2), bit(simulation, 3),
+                                    bit(simulation, 4));
+  config.setIncludeGyroscope(bit(motion, 0));
+  config.setIncludeAccelerometer(bit(motion, 1));
+  config.setWhichSpecialButtons(bit(special, 0), bit(special, 1),
+                                bit(special, 2), bit(special, 3),
+                                bit(special, 4), bit(special, 5),
+                                bit(special, 6), bit(special, 7));
+  config.setAxesMin(range[0]);
+  config.setAxesMax(range[1]);
+  config.setSimulationMin(range[0]);
+  config.setSimulationMax(range[1]);
+  config.setMotionMin(range[0]);
+  config.setMotionMax(range[1]);
+  config.setAxesBits(bits);
+  config.setSimulationBits(valueBits[(n + 1) % COUNT(valueBits)]);
+  config.setMotionBits(valueBits[(n + 2) % COUNT(valueBits)]);
+  config.setHatBits(hatWidth);
+
+  // Field groups in their own report IDs on every fourth case
+  if (n % 4 == 1) {
+    config.setFieldGroupReportId(FIELD_GROUP_AXES, 4);
+    config.setFieldGroupReportId(FIELD_GROUP_MOTION, 5);
+  } else if (n % 4 == 3) {
+    for (uint8_t group = 0; group < FIELD_GROUPS; group++) {
+      config.setFieldGroupReportId(group, 10 + group);
+    }
+  }
+  config.setControllerCount(1 + n % 5 % 3);
+  config.setEnableOutputReport(n % 7 == 0);
+  config.setIncludeKeyboard(n % 2 == 0);
+  config.setIncludeMouse(n % 3 == 0);
+  config.setKeyboardNkro(n % 4 == 0);
+
+  std::string error = checkControllerConfiguration(config, n % 3);
+  if (!error.empty()) {
+    printf("FAIL case %d (buttons %d, axes %02X, hats %d, bits %d/%d): %s\n",
+           n, buttons, axes, hats, bits, hatWidth, error.c_str());
+    failures++;
+  }
+}
+
+} // namespace
+
+int main() {
+  for (uint16_t buttons : buttonCounts) {
+    for (uint8_t axes : axisMasks) {
+      for (uint8_t hats : hatCounts) {
+        for (uint8_t bits : valueBits) {
+          for (uint8_t hatWidth : hatBits) {
+            run(buttons, axes, hats, bits, hatWidth);
+          }
+        }
+      }
+    }
+  }
+
+  printf("%d configuration(s), %d failure(s)\n", cases, failures);
+  fflush(stdout);
+  _Exit(failures == 0 ? 0 : 1);
+}